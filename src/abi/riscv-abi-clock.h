@@ -0,0 +1,172 @@
+//
+//  riscv-abi-clock.h
+//
+
+#ifndef riscv_abi_clock_h
+#define riscv_abi_clock_h
+
+namespace riscv {
+
+	/* source of guest time in proxy mode */
+
+	enum proxy_clock_mode
+	{
+		proxy_clock_host,    /* host clock_gettime for every request */
+		proxy_clock_tsc,     /* cycle counter calibrated against the host clocks */
+		proxy_clock_instret  /* deterministic virtual time derived from instret */
+	};
+
+	/*
+	 * Proxy time service answering gettimeofday, clock_gettime and the time
+	 * CSR without a host syscall, in the manner of the Linux vDSO.
+	 *
+	 * In tsc mode cpu_cycle_clock is calibrated once against CLOCK_MONOTONIC
+	 * and CLOCK_REALTIME and time is extrapolated from the cycle counter
+	 * with a 32.32 fixed point scale. Every resync_ns the host clocks are
+	 * sampled again and the scale is refined over the whole elapsed interval;
+	 * monotonic time never goes backwards across a resync. Readers take a
+	 * snapshot under a sequence lock so guest threads never block.
+	 *
+	 * In instret mode time starts at the epoch and advances ns_per_instret
+	 * per retired instruction, so runs are reproducible.
+	 */
+
+	struct proxy_clock
+	{
+		enum : u64 {
+			resync_ns = 100000000,   /* 100ms between host clock samples */
+			calibrate_ns = 2000000,  /* 2ms initial calibration interval */
+			ns_per_instret = 1,
+			time_csr_ns = 100        /* time CSR runs at 10MHz */
+		};
+
+		struct snapshot
+		{
+			u64 cycles;              /* cycle counter at the last sample */
+			u64 mono_ns;             /* CLOCK_MONOTONIC at the last sample */
+			u64 real_ns;             /* CLOCK_REALTIME at the last sample */
+			u64 mult;                /* nanoseconds per cycle in 32.32 fixed point */
+		};
+
+		proxy_clock_mode mode;
+		std::atomic<u32> seq;
+		snapshot snap;
+		std::mutex resync_lock;
+		u64 start_cycles;
+		u64 start_mono_ns;
+
+		std::atomic<u64> fast_reads; /* statistics */
+		std::atomic<u64> host_reads;
+		std::atomic<u64> resyncs;
+
+		proxy_clock() : mode(proxy_clock_host), seq(0), snap(), start_cycles(0), start_mono_ns(0),
+			fast_reads(0), host_reads(0), resyncs(0) {}
+
+		static u64 host_ns(clockid_t clock_id)
+		{
+			struct timespec ts;
+			clock_gettime(clock_id, &ts);
+			return u64(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+		}
+
+		/* sample the cycle counter and both host clocks as close together as possible */
+		static snapshot sample()
+		{
+			snapshot s;
+			u64 c0 = cpu_cycle_clock();
+			s.mono_ns = host_ns(CLOCK_MONOTONIC);
+			s.real_ns = host_ns(CLOCK_REALTIME);
+			s.cycles = c0 + ((cpu_cycle_clock() - c0) >> 1);
+			s.mult = 0;
+			return s;
+		}
+
+		/* calibrate the cycle counter, falls back to host mode without one */
+		void start(proxy_clock_mode m)
+		{
+			mode = m;
+			if (mode != proxy_clock_tsc) return;
+			snapshot s0 = sample();
+			u64 deadline = s0.mono_ns + calibrate_ns;
+			while (host_ns(CLOCK_MONOTONIC) < deadline);
+			snapshot s1 = sample();
+			if (s1.cycles <= s0.cycles) {
+				mode = proxy_clock_host;
+				return;
+			}
+			s1.mult = ((s1.mono_ns - s0.mono_ns) << 32) / (s1.cycles - s0.cycles);
+			start_cycles = s0.cycles;
+			start_mono_ns = s0.mono_ns;
+			snap = s1;
+		}
+
+		snapshot read_snapshot()
+		{
+			snapshot s;
+			u32 begin;
+			do {
+				begin = seq.load(std::memory_order_acquire);
+				s = snap;
+				std::atomic_thread_fence(std::memory_order_acquire);
+			} while ((begin & 1) || begin != seq.load(std::memory_order_relaxed));
+			return s;
+		}
+
+		/* elapsed nanoseconds, split to multiply in 64 bits, zero for cycles before the snapshot */
+		static u64 extrapolate(const snapshot &s, u64 cycles)
+		{
+			if (cycles <= s.cycles) return 0;
+			u64 delta = cycles - s.cycles;
+			return (delta >> 32) * s.mult + (((delta & 0xffffffffULL) * s.mult) >> 32);
+		}
+
+		/* sample the host clocks and refine the scale over the interval since start */
+		void resync(u64 cycles)
+		{
+			std::unique_lock<std::mutex> guard(resync_lock, std::try_to_lock);
+			if (!guard.owns_lock()) return;
+			snapshot old = read_snapshot();
+			if (extrapolate(old, cycles) < resync_ns) return;
+			snapshot s = sample();
+			if (s.cycles <= start_cycles) return;
+			s.mult = ((s.mono_ns - start_mono_ns) << 32) / (s.cycles - start_cycles);
+			s.mono_ns = std::max(s.mono_ns, old.mono_ns + extrapolate(old, s.cycles));
+			seq.fetch_add(1, std::memory_order_acq_rel);
+			std::atomic_thread_fence(std::memory_order_release);
+			snap = s;
+			seq.fetch_add(1, std::memory_order_release);
+			resyncs++;
+		}
+
+		/* monotonic or realtime nanoseconds for a thread that has retired instret instructions */
+		u64 now_ns(bool realtime, u64 instret)
+		{
+			switch (mode) {
+				case proxy_clock_instret:
+					fast_reads++;
+					return instret * ns_per_instret;
+				case proxy_clock_tsc: {
+					/* read the counter after the snapshot so a concurrent resync cannot be newer */
+					snapshot s = read_snapshot();
+					u64 cycles = cpu_cycle_clock();
+					u64 delta = extrapolate(s, cycles);
+					if (delta >= resync_ns) resync(cycles);
+					fast_reads++;
+					return (realtime ? s.real_ns : s.mono_ns) + delta;
+				}
+				default:
+					host_reads++;
+					return host_ns(realtime ? CLOCK_REALTIME : CLOCK_MONOTONIC);
+			}
+		}
+
+		/* value of the time CSR */
+		u64 time_csr(u64 instret)
+		{
+			return now_ns(false, instret) / time_csr_ns;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+//
+//  riscv-abi-fault.h
+//
+
+#ifndef riscv_abi_fault_h
+#define riscv_abi_fault_h
+
+namespace riscv {
+
+	/*
+	 * Host faults on guest memory. In sandbox mode an in-sandbox address
+	 * may still be unmapped or PROT_NONE. Syscall handlers copy guest
+	 * memory with abi_copy_guest, which returns false on a fault, so no
+	 * fault unwinds through a handler holding a lock. A fault in the
+	 * interpreter, outside any syscall, unwinds to the step loop of the
+	 * faulting thread, which ends the process with 128 + signal. Other
+	 * faults are host bugs and take the default action. The handler is
+	 * installed with SA_NODEFER as it may be left with siglongjmp.
+	 */
+
+	struct abi_fault_state
+	{
+		sigjmp_buf *volatile copy_jmp; /* set around a guarded copy */
+		sigjmp_buf *volatile step_jmp; /* set while stepping a guest thread */
+		volatile bool in_syscall;      /* volatile, read by the signal handler */
+	};
+
+	static thread_local abi_fault_state abi_fault;
+
+	inline void abi_fault_handler(int sig, siginfo_t *info, void *context)
+	{
+		if (abi_fault.copy_jmp) siglongjmp(*abi_fault.copy_jmp, sig);
+		if (abi_fault.step_jmp && !abi_fault.in_syscall) siglongjmp(*abi_fault.step_jmp, sig);
+		signal(sig, SIG_DFL);
+	}
+
+	inline void abi_install_fault_handler()
+	{
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = abi_fault_handler;
+		sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+		sigaction(SIGSEGV, &sa, nullptr);
+		sigaction(SIGBUS, &sa, nullptr);
+	}
+
+	/* copy to or from guest memory, false if the copy faulted */
+	inline bool abi_copy_guest(void *dst, const void *src, size_t len)
+	{
+		sigjmp_buf jmp;
+		sigjmp_buf *outer = abi_fault.copy_jmp;
+		if (sigsetjmp(jmp, 0)) {
+			abi_fault.copy_jmp = outer;
+			return false;
+		}
+		abi_fault.copy_jmp = &jmp;
+		memcpy(dst, src, len);
+		abi_fault.copy_jmp = outer;
+		return true;
+	}
+
+}
+
+#endif
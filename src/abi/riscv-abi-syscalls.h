@@ -0,0 +1,988 @@
+//
+//  riscv-abi-syscalls.h
+//
+//  DANGER - This is machine generated code
+//
+
+#ifndef riscv_abi_syscalls_h
+#define riscv_abi_syscalls_h
+
+namespace riscv {
+
+	template <typename P> void abi_sys_dup(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		long ret = dup(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_dup3(P &proc)
+	{
+	#if defined (__linux__)
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		int arg1 = proc.ireg[riscv_ireg_a1].r.x.val;
+		proc.mmu.output->sync(arg1);
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		long ret = dup3(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	#else
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	#endif
+	}
+
+	template <typename P> void abi_sys_mkdirat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		mode_t arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		long ret = mkdirat(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_unlinkat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		long ret = unlinkat(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_linkat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		proc.mmu.output->sync(arg2);
+		const char *arg3 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a3].r.xu.val, 0);
+		int arg4 = proc.ireg[riscv_ireg_a4].r.x.val;
+		long ret = linkat(arg0, arg1, arg2, arg3, arg4);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_renameat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		proc.mmu.output->sync(arg2);
+		const char *arg3 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a3].r.xu.val, 0);
+		long ret = renameat(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_faccessat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		int arg3 = proc.ireg[riscv_ireg_a3].r.x.val;
+		long ret = faccessat(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_chdir(P &proc)
+	{
+		const char *arg0 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a0].r.xu.val, 0);
+		long ret = chdir(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fchdir(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		long ret = fchdir(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fchmod(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		mode_t arg1 = proc.ireg[riscv_ireg_a1].r.xu.val;
+		long ret = fchmod(arg0, arg1);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fchmodat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		mode_t arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		int arg3 = proc.ireg[riscv_ireg_a3].r.x.val;
+		long ret = fchmodat(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fchown(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		unsigned arg1 = proc.ireg[riscv_ireg_a1].r.xu.val;
+		unsigned arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		long ret = fchown(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_openat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		mode_t arg3 = proc.ireg[riscv_ireg_a3].r.xu.val;
+		long ret = openat(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_close(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0, true);
+		long ret = close(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_pipe2(P &proc)
+	{
+	#if defined (__linux__)
+		abi_buffer arg0(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a0].r.xu.val, 0));
+		int arg1 = proc.ireg[riscv_ireg_a1].r.x.val;
+		long ret = pipe2(arg0, arg1);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	#else
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	#endif
+	}
+
+	template <typename P> void abi_sys_getdents64(P &proc)
+	{
+	#if defined (__linux__)
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		abi_buffer arg1(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, proc.ireg[riscv_ireg_a2].r.xu.val));
+		size_t arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		long ret = getdents64(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	#else
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	#endif
+	}
+
+	template <typename P> void abi_sys_lseek(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		off_t arg1 = proc.ireg[riscv_ireg_a1].r.x.val;
+		int arg2 = proc.ireg[riscv_ireg_a2].r.x.val;
+		long ret = lseek(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_read(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->before_read(arg0);
+		abi_buffer arg1(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, proc.ireg[riscv_ireg_a2].r.xu.val));
+		size_t arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		long ret = read(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_pread64(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->before_read(arg0);
+		abi_buffer arg1(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, proc.ireg[riscv_ireg_a2].r.xu.val));
+		size_t arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		off_t arg3 = proc.ireg[riscv_ireg_a3].r.x.val;
+		long ret = pread(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_pwrite64(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		abi_buffer arg1(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, proc.ireg[riscv_ireg_a2].r.xu.val));
+		size_t arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		off_t arg3 = proc.ireg[riscv_ireg_a3].r.x.val;
+		long ret = pwrite(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_readlinkat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		abi_buffer arg2(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a2].r.xu.val, proc.ireg[riscv_ireg_a3].r.xu.val));
+		size_t arg3 = proc.ireg[riscv_ireg_a3].r.xu.val;
+		long ret = readlinkat(arg0, arg1, arg2, arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_newfstatat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		const char *arg1 = (const char*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, 0);
+		if (!proc.mmu.in_sandbox(proc.ireg[riscv_ireg_a2].r.xu.val, sizeof(abi_stat<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		uintptr_t va2 = proc.mmu.host_buffer(proc.ireg[riscv_ireg_a2].r.xu.val, sizeof(abi_stat<P>));
+		struct stat tmp2, *arg2 = abi_stat_out<P>(va2, tmp2);
+		int arg3 = proc.ireg[riscv_ireg_a3].r.x.val;
+		long ret = fstatat(arg0, arg1, arg2, arg3);
+		if (ret >= 0 && !abi_stat_copyout<P>(va2, arg2)) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fstat(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		if (!proc.mmu.in_sandbox(proc.ireg[riscv_ireg_a1].r.xu.val, sizeof(abi_stat<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		uintptr_t va1 = proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, sizeof(abi_stat<P>));
+		struct stat tmp1, *arg1 = abi_stat_out<P>(va1, tmp1);
+		long ret = fstat(arg0, arg1);
+		if (ret >= 0 && !abi_stat_copyout<P>(va1, arg1)) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fsync(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		proc.mmu.output->sync(arg0);
+		long ret = fsync(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_nanosleep(P &proc)
+	{
+		if (!proc.mmu.in_sandbox(proc.ireg[riscv_ireg_a0].r.xu.val, sizeof(abi_timespec<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		uintptr_t va0 = proc.mmu.host_buffer(proc.ireg[riscv_ireg_a0].r.xu.val, sizeof(abi_timespec<P>));
+		struct timespec tmp0, *arg0;
+		if (!abi_timespec_in<P>(va0, tmp0, arg0)) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		if (!proc.mmu.in_sandbox(proc.ireg[riscv_ireg_a1].r.xu.val, sizeof(abi_timespec<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		uintptr_t va1 = proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, sizeof(abi_timespec<P>));
+		struct timespec tmp1, *arg1 = abi_timespec_out<P>(va1, tmp1);
+		long ret = nanosleep(arg0, arg1);
+		if (ret >= 0 && !abi_timespec_copyout<P>(va1, arg1)) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_clock_getres(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		if (!proc.mmu.in_sandbox(proc.ireg[riscv_ireg_a1].r.xu.val, sizeof(abi_timespec<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		uintptr_t va1 = proc.mmu.host_buffer(proc.ireg[riscv_ireg_a1].r.xu.val, sizeof(abi_timespec<P>));
+		struct timespec tmp1, *arg1 = abi_timespec_out<P>(va1, tmp1);
+		long ret = clock_getres(arg0, arg1);
+		if (ret >= 0 && !abi_timespec_copyout<P>(va1, arg1)) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_sched_yield(P &proc)
+	{
+		long ret = sched_yield();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_kill(P &proc)
+	{
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		int arg1 = proc.ireg[riscv_ireg_a1].r.x.val;
+		long ret = kill(arg0, arg1);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_setsid(P &proc)
+	{
+		long ret = setsid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_uname(P &proc)
+	{
+		abi_buffer arg0(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a0].r.xu.val, 0));
+		long ret = uname(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_umask(P &proc)
+	{
+		mode_t arg0 = proc.ireg[riscv_ireg_a0].r.xu.val;
+		long ret = umask(arg0);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_getpid(P &proc)
+	{
+		long ret = getpid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_getppid(P &proc)
+	{
+		long ret = getppid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_getuid(P &proc)
+	{
+		long ret = getuid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_geteuid(P &proc)
+	{
+		long ret = geteuid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_getgid(P &proc)
+	{
+		long ret = getgid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_getegid(P &proc)
+	{
+		long ret = getegid();
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_prlimit64(P &proc)
+	{
+	#if defined (__linux__)
+		int arg0 = proc.ireg[riscv_ireg_a0].r.x.val;
+		int arg1 = proc.ireg[riscv_ireg_a1].r.x.val;
+		abi_buffer arg2(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a2].r.xu.val, 0));
+		abi_buffer arg3(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a3].r.xu.val, 0));
+		long ret = syscall(SYS_prlimit64, arg0, arg1, (void*)arg2, (void*)arg3);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	#else
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	#endif
+	}
+
+	template <typename P> void abi_sys_getrandom(P &proc)
+	{
+	#if defined (__linux__)
+		abi_buffer arg0(proc.mmu.host_buffer(proc.ireg[riscv_ireg_a0].r.xu.val, proc.ireg[riscv_ireg_a1].r.xu.val));
+		size_t arg1 = proc.ireg[riscv_ireg_a1].r.xu.val;
+		unsigned arg2 = proc.ireg[riscv_ireg_a2].r.xu.val;
+		long ret = getrandom(arg0, arg1, arg2);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	#else
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	#endif
+	}
+
+	template <typename P> const typename abi_syscall_table<P>::handler
+	abi_syscall_table<P>::handlers[abi_syscall_limit] = {
+		/*   0 */ abi_sys_unimplemented<P>,
+		/*   1 */ abi_sys_unimplemented<P>,
+		/*   2 */ abi_sys_unimplemented<P>,
+		/*   3 */ abi_sys_unimplemented<P>,
+		/*   4 */ abi_sys_unimplemented<P>,
+		/*   5 */ abi_sys_unimplemented<P>,
+		/*   6 */ abi_sys_unimplemented<P>,
+		/*   7 */ abi_sys_unimplemented<P>,
+		/*   8 */ abi_sys_unimplemented<P>,
+		/*   9 */ abi_sys_unimplemented<P>,
+		/*  10 */ abi_sys_unimplemented<P>,
+		/*  11 */ abi_sys_unimplemented<P>,
+		/*  12 */ abi_sys_unimplemented<P>,
+		/*  13 */ abi_sys_unimplemented<P>,
+		/*  14 */ abi_sys_unimplemented<P>,
+		/*  15 */ abi_sys_unimplemented<P>,
+		/*  16 */ abi_sys_unimplemented<P>,
+		/*  17 */ abi_sys_unimplemented<P>,
+		/*  18 */ abi_sys_unimplemented<P>,
+		/*  19 */ abi_sys_unimplemented<P>,
+		/*  20 */ abi_sys_unimplemented<P>,
+		/*  21 */ abi_sys_unimplemented<P>,
+		/*  22 */ abi_sys_unimplemented<P>,
+		/*  23 */ abi_sys_dup<P>,
+		/*  24 */ abi_sys_dup3<P>,
+		/*  25 */ abi_sys_fcntl<P>,
+		/*  26 */ abi_sys_unimplemented<P>,
+		/*  27 */ abi_sys_unimplemented<P>,
+		/*  28 */ abi_sys_unimplemented<P>,
+		/*  29 */ abi_sys_ioctl<P>,
+		/*  30 */ abi_sys_unimplemented<P>,
+		/*  31 */ abi_sys_unimplemented<P>,
+		/*  32 */ abi_sys_unimplemented<P>,
+		/*  33 */ abi_sys_unimplemented<P>,
+		/*  34 */ abi_sys_mkdirat<P>,
+		/*  35 */ abi_sys_unlinkat<P>,
+		/*  36 */ abi_sys_unimplemented<P>,
+		/*  37 */ abi_sys_linkat<P>,
+		/*  38 */ abi_sys_renameat<P>,
+		/*  39 */ abi_sys_unimplemented<P>,
+		/*  40 */ abi_sys_unimplemented<P>,
+		/*  41 */ abi_sys_unimplemented<P>,
+		/*  42 */ abi_sys_unimplemented<P>,
+		/*  43 */ abi_sys_unimplemented<P>,
+		/*  44 */ abi_sys_unimplemented<P>,
+		/*  45 */ abi_sys_unimplemented<P>,
+		/*  46 */ abi_sys_unimplemented<P>,
+		/*  47 */ abi_sys_unimplemented<P>,
+		/*  48 */ abi_sys_faccessat<P>,
+		/*  49 */ abi_sys_chdir<P>,
+		/*  50 */ abi_sys_fchdir<P>,
+		/*  51 */ abi_sys_unimplemented<P>,
+		/*  52 */ abi_sys_fchmod<P>,
+		/*  53 */ abi_sys_fchmodat<P>,
+		/*  54 */ abi_sys_unimplemented<P>,
+		/*  55 */ abi_sys_fchown<P>,
+		/*  56 */ abi_sys_openat<P>,
+		/*  57 */ abi_sys_close<P>,
+		/*  58 */ abi_sys_unimplemented<P>,
+		/*  59 */ abi_sys_pipe2<P>,
+		/*  60 */ abi_sys_unimplemented<P>,
+		/*  61 */ abi_sys_getdents64<P>,
+		/*  62 */ abi_sys_lseek<P>,
+		/*  63 */ abi_sys_read<P>,
+		/*  64 */ abi_sys_write<P>,
+		/*  65 */ abi_sys_readv<P>,
+		/*  66 */ abi_sys_writev<P>,
+		/*  67 */ abi_sys_pread64<P>,
+		/*  68 */ abi_sys_pwrite64<P>,
+		/*  69 */ abi_sys_unimplemented<P>,
+		/*  70 */ abi_sys_unimplemented<P>,
+		/*  71 */ abi_sys_unimplemented<P>,
+		/*  72 */ abi_sys_unimplemented<P>,
+		/*  73 */ abi_sys_unimplemented<P>,
+		/*  74 */ abi_sys_unimplemented<P>,
+		/*  75 */ abi_sys_unimplemented<P>,
+		/*  76 */ abi_sys_unimplemented<P>,
+		/*  77 */ abi_sys_unimplemented<P>,
+		/*  78 */ abi_sys_readlinkat<P>,
+		/*  79 */ abi_sys_newfstatat<P>,
+		/*  80 */ abi_sys_fstat<P>,
+		/*  81 */ abi_sys_unimplemented<P>,
+		/*  82 */ abi_sys_fsync<P>,
+		/*  83 */ abi_sys_fdatasync<P>,
+		/*  84 */ abi_sys_unimplemented<P>,
+		/*  85 */ abi_sys_unimplemented<P>,
+		/*  86 */ abi_sys_unimplemented<P>,
+		/*  87 */ abi_sys_unimplemented<P>,
+		/*  88 */ abi_sys_unimplemented<P>,
+		/*  89 */ abi_sys_unimplemented<P>,
+		/*  90 */ abi_sys_unimplemented<P>,
+		/*  91 */ abi_sys_unimplemented<P>,
+		/*  92 */ abi_sys_unimplemented<P>,
+		/*  93 */ abi_sys_exit<P>,
+		/*  94 */ abi_sys_exit_group<P>,
+		/*  95 */ abi_sys_unimplemented<P>,
+		/*  96 */ abi_sys_set_tid_address<P>,
+		/*  97 */ abi_sys_unimplemented<P>,
+		/*  98 */ abi_sys_futex<P>,
+		/*  99 */ abi_sys_ignore<P>,
+		/* 100 */ abi_sys_unimplemented<P>,
+		/* 101 */ abi_sys_nanosleep<P>,
+		/* 102 */ abi_sys_unimplemented<P>,
+		/* 103 */ abi_sys_unimplemented<P>,
+		/* 104 */ abi_sys_unimplemented<P>,
+		/* 105 */ abi_sys_unimplemented<P>,
+		/* 106 */ abi_sys_unimplemented<P>,
+		/* 107 */ abi_sys_unimplemented<P>,
+		/* 108 */ abi_sys_unimplemented<P>,
+		/* 109 */ abi_sys_unimplemented<P>,
+		/* 110 */ abi_sys_unimplemented<P>,
+		/* 111 */ abi_sys_unimplemented<P>,
+		/* 112 */ abi_sys_unimplemented<P>,
+		/* 113 */ abi_sys_clock_gettime<P>,
+		/* 114 */ abi_sys_clock_getres<P>,
+		/* 115 */ abi_sys_unimplemented<P>,
+		/* 116 */ abi_sys_unimplemented<P>,
+		/* 117 */ abi_sys_unimplemented<P>,
+		/* 118 */ abi_sys_unimplemented<P>,
+		/* 119 */ abi_sys_unimplemented<P>,
+		/* 120 */ abi_sys_unimplemented<P>,
+		/* 121 */ abi_sys_unimplemented<P>,
+		/* 122 */ abi_sys_unimplemented<P>,
+		/* 123 */ abi_sys_unimplemented<P>,
+		/* 124 */ abi_sys_sched_yield<P>,
+		/* 125 */ abi_sys_unimplemented<P>,
+		/* 126 */ abi_sys_unimplemented<P>,
+		/* 127 */ abi_sys_unimplemented<P>,
+		/* 128 */ abi_sys_unimplemented<P>,
+		/* 129 */ abi_sys_kill<P>,
+		/* 130 */ abi_sys_unimplemented<P>,
+		/* 131 */ abi_sys_unimplemented<P>,
+		/* 132 */ abi_sys_unimplemented<P>,
+		/* 133 */ abi_sys_unimplemented<P>,
+		/* 134 */ abi_sys_ignore<P>,
+		/* 135 */ abi_sys_ignore<P>,
+		/* 136 */ abi_sys_unimplemented<P>,
+		/* 137 */ abi_sys_unimplemented<P>,
+		/* 138 */ abi_sys_unimplemented<P>,
+		/* 139 */ abi_sys_unimplemented<P>,
+		/* 140 */ abi_sys_unimplemented<P>,
+		/* 141 */ abi_sys_unimplemented<P>,
+		/* 142 */ abi_sys_unimplemented<P>,
+		/* 143 */ abi_sys_unimplemented<P>,
+		/* 144 */ abi_sys_unimplemented<P>,
+		/* 145 */ abi_sys_unimplemented<P>,
+		/* 146 */ abi_sys_unimplemented<P>,
+		/* 147 */ abi_sys_unimplemented<P>,
+		/* 148 */ abi_sys_unimplemented<P>,
+		/* 149 */ abi_sys_unimplemented<P>,
+		/* 150 */ abi_sys_unimplemented<P>,
+		/* 151 */ abi_sys_unimplemented<P>,
+		/* 152 */ abi_sys_unimplemented<P>,
+		/* 153 */ abi_sys_unimplemented<P>,
+		/* 154 */ abi_sys_unimplemented<P>,
+		/* 155 */ abi_sys_unimplemented<P>,
+		/* 156 */ abi_sys_unimplemented<P>,
+		/* 157 */ abi_sys_setsid<P>,
+		/* 158 */ abi_sys_unimplemented<P>,
+		/* 159 */ abi_sys_unimplemented<P>,
+		/* 160 */ abi_sys_uname<P>,
+		/* 161 */ abi_sys_unimplemented<P>,
+		/* 162 */ abi_sys_unimplemented<P>,
+		/* 163 */ abi_sys_unimplemented<P>,
+		/* 164 */ abi_sys_unimplemented<P>,
+		/* 165 */ abi_sys_unimplemented<P>,
+		/* 166 */ abi_sys_umask<P>,
+		/* 167 */ abi_sys_unimplemented<P>,
+		/* 168 */ abi_sys_unimplemented<P>,
+		/* 169 */ abi_sys_gettimeofday<P>,
+		/* 170 */ abi_sys_unimplemented<P>,
+		/* 171 */ abi_sys_unimplemented<P>,
+		/* 172 */ abi_sys_getpid<P>,
+		/* 173 */ abi_sys_getppid<P>,
+		/* 174 */ abi_sys_getuid<P>,
+		/* 175 */ abi_sys_geteuid<P>,
+		/* 176 */ abi_sys_getgid<P>,
+		/* 177 */ abi_sys_getegid<P>,
+		/* 178 */ abi_sys_gettid<P>,
+		/* 179 */ abi_sys_unimplemented<P>,
+		/* 180 */ abi_sys_unimplemented<P>,
+		/* 181 */ abi_sys_unimplemented<P>,
+		/* 182 */ abi_sys_unimplemented<P>,
+		/* 183 */ abi_sys_unimplemented<P>,
+		/* 184 */ abi_sys_unimplemented<P>,
+		/* 185 */ abi_sys_unimplemented<P>,
+		/* 186 */ abi_sys_unimplemented<P>,
+		/* 187 */ abi_sys_unimplemented<P>,
+		/* 188 */ abi_sys_unimplemented<P>,
+		/* 189 */ abi_sys_unimplemented<P>,
+		/* 190 */ abi_sys_unimplemented<P>,
+		/* 191 */ abi_sys_unimplemented<P>,
+		/* 192 */ abi_sys_unimplemented<P>,
+		/* 193 */ abi_sys_unimplemented<P>,
+		/* 194 */ abi_sys_unimplemented<P>,
+		/* 195 */ abi_sys_unimplemented<P>,
+		/* 196 */ abi_sys_unimplemented<P>,
+		/* 197 */ abi_sys_unimplemented<P>,
+		/* 198 */ abi_sys_unimplemented<P>,
+		/* 199 */ abi_sys_unimplemented<P>,
+		/* 200 */ abi_sys_unimplemented<P>,
+		/* 201 */ abi_sys_unimplemented<P>,
+		/* 202 */ abi_sys_unimplemented<P>,
+		/* 203 */ abi_sys_unimplemented<P>,
+		/* 204 */ abi_sys_unimplemented<P>,
+		/* 205 */ abi_sys_unimplemented<P>,
+		/* 206 */ abi_sys_unimplemented<P>,
+		/* 207 */ abi_sys_unimplemented<P>,
+		/* 208 */ abi_sys_unimplemented<P>,
+		/* 209 */ abi_sys_unimplemented<P>,
+		/* 210 */ abi_sys_unimplemented<P>,
+		/* 211 */ abi_sys_unimplemented<P>,
+		/* 212 */ abi_sys_unimplemented<P>,
+		/* 213 */ abi_sys_unimplemented<P>,
+		/* 214 */ abi_sys_brk<P>,
+		/* 215 */ abi_sys_munmap<P>,
+		/* 216 */ abi_sys_unimplemented<P>,
+		/* 217 */ abi_sys_unimplemented<P>,
+		/* 218 */ abi_sys_unimplemented<P>,
+		/* 219 */ abi_sys_unimplemented<P>,
+		/* 220 */ abi_sys_clone<P>,
+		/* 221 */ abi_sys_unimplemented<P>,
+		/* 222 */ abi_sys_mmap<P>,
+		/* 223 */ abi_sys_unimplemented<P>,
+		/* 224 */ abi_sys_unimplemented<P>,
+		/* 225 */ abi_sys_unimplemented<P>,
+		/* 226 */ abi_sys_mprotect<P>,
+		/* 227 */ abi_sys_unimplemented<P>,
+		/* 228 */ abi_sys_unimplemented<P>,
+		/* 229 */ abi_sys_unimplemented<P>,
+		/* 230 */ abi_sys_unimplemented<P>,
+		/* 231 */ abi_sys_unimplemented<P>,
+		/* 232 */ abi_sys_unimplemented<P>,
+		/* 233 */ abi_sys_madvise<P>,
+		/* 234 */ abi_sys_unimplemented<P>,
+		/* 235 */ abi_sys_unimplemented<P>,
+		/* 236 */ abi_sys_unimplemented<P>,
+		/* 237 */ abi_sys_unimplemented<P>,
+		/* 238 */ abi_sys_unimplemented<P>,
+		/* 239 */ abi_sys_unimplemented<P>,
+		/* 240 */ abi_sys_unimplemented<P>,
+		/* 241 */ abi_sys_unimplemented<P>,
+		/* 242 */ abi_sys_unimplemented<P>,
+		/* 243 */ abi_sys_unimplemented<P>,
+		/* 244 */ abi_sys_unimplemented<P>,
+		/* 245 */ abi_sys_unimplemented<P>,
+		/* 246 */ abi_sys_unimplemented<P>,
+		/* 247 */ abi_sys_unimplemented<P>,
+		/* 248 */ abi_sys_unimplemented<P>,
+		/* 249 */ abi_sys_unimplemented<P>,
+		/* 250 */ abi_sys_unimplemented<P>,
+		/* 251 */ abi_sys_unimplemented<P>,
+		/* 252 */ abi_sys_unimplemented<P>,
+		/* 253 */ abi_sys_unimplemented<P>,
+		/* 254 */ abi_sys_unimplemented<P>,
+		/* 255 */ abi_sys_unimplemented<P>,
+		/* 256 */ abi_sys_unimplemented<P>,
+		/* 257 */ abi_sys_unimplemented<P>,
+		/* 258 */ abi_sys_unimplemented<P>,
+		/* 259 */ abi_sys_unimplemented<P>,
+		/* 260 */ abi_sys_unimplemented<P>,
+		/* 261 */ abi_sys_prlimit64<P>,
+		/* 262 */ abi_sys_unimplemented<P>,
+		/* 263 */ abi_sys_unimplemented<P>,
+		/* 264 */ abi_sys_unimplemented<P>,
+		/* 265 */ abi_sys_unimplemented<P>,
+		/* 266 */ abi_sys_unimplemented<P>,
+		/* 267 */ abi_sys_unimplemented<P>,
+		/* 268 */ abi_sys_unimplemented<P>,
+		/* 269 */ abi_sys_unimplemented<P>,
+		/* 270 */ abi_sys_unimplemented<P>,
+		/* 271 */ abi_sys_unimplemented<P>,
+		/* 272 */ abi_sys_unimplemented<P>,
+		/* 273 */ abi_sys_unimplemented<P>,
+		/* 274 */ abi_sys_unimplemented<P>,
+		/* 275 */ abi_sys_unimplemented<P>,
+		/* 276 */ abi_sys_unimplemented<P>,
+		/* 277 */ abi_sys_unimplemented<P>,
+		/* 278 */ abi_sys_getrandom<P>,
+	};
+
+	template <typename P> const char* const
+	abi_syscall_table<P>::names[abi_syscall_limit] = {
+		/*   0 */ nullptr,
+		/*   1 */ nullptr,
+		/*   2 */ nullptr,
+		/*   3 */ nullptr,
+		/*   4 */ nullptr,
+		/*   5 */ nullptr,
+		/*   6 */ nullptr,
+		/*   7 */ nullptr,
+		/*   8 */ nullptr,
+		/*   9 */ nullptr,
+		/*  10 */ nullptr,
+		/*  11 */ nullptr,
+		/*  12 */ nullptr,
+		/*  13 */ nullptr,
+		/*  14 */ nullptr,
+		/*  15 */ nullptr,
+		/*  16 */ nullptr,
+		/*  17 */ nullptr,
+		/*  18 */ nullptr,
+		/*  19 */ nullptr,
+		/*  20 */ nullptr,
+		/*  21 */ nullptr,
+		/*  22 */ nullptr,
+		/*  23 */ "dup",
+		/*  24 */ "dup3",
+		/*  25 */ "fcntl",
+		/*  26 */ nullptr,
+		/*  27 */ nullptr,
+		/*  28 */ nullptr,
+		/*  29 */ "ioctl",
+		/*  30 */ nullptr,
+		/*  31 */ nullptr,
+		/*  32 */ nullptr,
+		/*  33 */ nullptr,
+		/*  34 */ "mkdirat",
+		/*  35 */ "unlinkat",
+		/*  36 */ nullptr,
+		/*  37 */ "linkat",
+		/*  38 */ "renameat",
+		/*  39 */ nullptr,
+		/*  40 */ nullptr,
+		/*  41 */ nullptr,
+		/*  42 */ nullptr,
+		/*  43 */ nullptr,
+		/*  44 */ nullptr,
+		/*  45 */ nullptr,
+		/*  46 */ nullptr,
+		/*  47 */ nullptr,
+		/*  48 */ "faccessat",
+		/*  49 */ "chdir",
+		/*  50 */ "fchdir",
+		/*  51 */ nullptr,
+		/*  52 */ "fchmod",
+		/*  53 */ "fchmodat",
+		/*  54 */ nullptr,
+		/*  55 */ "fchown",
+		/*  56 */ "openat",
+		/*  57 */ "close",
+		/*  58 */ nullptr,
+		/*  59 */ "pipe2",
+		/*  60 */ nullptr,
+		/*  61 */ "getdents64",
+		/*  62 */ "lseek",
+		/*  63 */ "read",
+		/*  64 */ "write",
+		/*  65 */ "readv",
+		/*  66 */ "writev",
+		/*  67 */ "pread64",
+		/*  68 */ "pwrite64",
+		/*  69 */ nullptr,
+		/*  70 */ nullptr,
+		/*  71 */ nullptr,
+		/*  72 */ nullptr,
+		/*  73 */ nullptr,
+		/*  74 */ nullptr,
+		/*  75 */ nullptr,
+		/*  76 */ nullptr,
+		/*  77 */ nullptr,
+		/*  78 */ "readlinkat",
+		/*  79 */ "newfstatat",
+		/*  80 */ "fstat",
+		/*  81 */ nullptr,
+		/*  82 */ "fsync",
+		/*  83 */ "fdatasync",
+		/*  84 */ nullptr,
+		/*  85 */ nullptr,
+		/*  86 */ nullptr,
+		/*  87 */ nullptr,
+		/*  88 */ nullptr,
+		/*  89 */ nullptr,
+		/*  90 */ nullptr,
+		/*  91 */ nullptr,
+		/*  92 */ nullptr,
+		/*  93 */ "exit",
+		/*  94 */ "exit_group",
+		/*  95 */ nullptr,
+		/*  96 */ "set_tid_address",
+		/*  97 */ nullptr,
+		/*  98 */ "futex",
+		/*  99 */ "set_robust_list",
+		/* 100 */ nullptr,
+		/* 101 */ "nanosleep",
+		/* 102 */ nullptr,
+		/* 103 */ nullptr,
+		/* 104 */ nullptr,
+		/* 105 */ nullptr,
+		/* 106 */ nullptr,
+		/* 107 */ nullptr,
+		/* 108 */ nullptr,
+		/* 109 */ nullptr,
+		/* 110 */ nullptr,
+		/* 111 */ nullptr,
+		/* 112 */ nullptr,
+		/* 113 */ "clock_gettime",
+		/* 114 */ "clock_getres",
+		/* 115 */ nullptr,
+		/* 116 */ nullptr,
+		/* 117 */ nullptr,
+		/* 118 */ nullptr,
+		/* 119 */ nullptr,
+		/* 120 */ nullptr,
+		/* 121 */ nullptr,
+		/* 122 */ nullptr,
+		/* 123 */ nullptr,
+		/* 124 */ "sched_yield",
+		/* 125 */ nullptr,
+		/* 126 */ nullptr,
+		/* 127 */ nullptr,
+		/* 128 */ nullptr,
+		/* 129 */ "kill",
+		/* 130 */ nullptr,
+		/* 131 */ nullptr,
+		/* 132 */ nullptr,
+		/* 133 */ nullptr,
+		/* 134 */ "rt_sigaction",
+		/* 135 */ "rt_sigprocmask",
+		/* 136 */ nullptr,
+		/* 137 */ nullptr,
+		/* 138 */ nullptr,
+		/* 139 */ nullptr,
+		/* 140 */ nullptr,
+		/* 141 */ nullptr,
+		/* 142 */ nullptr,
+		/* 143 */ nullptr,
+		/* 144 */ nullptr,
+		/* 145 */ nullptr,
+		/* 146 */ nullptr,
+		/* 147 */ nullptr,
+		/* 148 */ nullptr,
+		/* 149 */ nullptr,
+		/* 150 */ nullptr,
+		/* 151 */ nullptr,
+		/* 152 */ nullptr,
+		/* 153 */ nullptr,
+		/* 154 */ nullptr,
+		/* 155 */ nullptr,
+		/* 156 */ nullptr,
+		/* 157 */ "setsid",
+		/* 158 */ nullptr,
+		/* 159 */ nullptr,
+		/* 160 */ "uname",
+		/* 161 */ nullptr,
+		/* 162 */ nullptr,
+		/* 163 */ nullptr,
+		/* 164 */ nullptr,
+		/* 165 */ nullptr,
+		/* 166 */ "umask",
+		/* 167 */ nullptr,
+		/* 168 */ nullptr,
+		/* 169 */ "gettimeofday",
+		/* 170 */ nullptr,
+		/* 171 */ nullptr,
+		/* 172 */ "getpid",
+		/* 173 */ "getppid",
+		/* 174 */ "getuid",
+		/* 175 */ "geteuid",
+		/* 176 */ "getgid",
+		/* 177 */ "getegid",
+		/* 178 */ "gettid",
+		/* 179 */ nullptr,
+		/* 180 */ nullptr,
+		/* 181 */ nullptr,
+		/* 182 */ nullptr,
+		/* 183 */ nullptr,
+		/* 184 */ nullptr,
+		/* 185 */ nullptr,
+		/* 186 */ nullptr,
+		/* 187 */ nullptr,
+		/* 188 */ nullptr,
+		/* 189 */ nullptr,
+		/* 190 */ nullptr,
+		/* 191 */ nullptr,
+		/* 192 */ nullptr,
+		/* 193 */ nullptr,
+		/* 194 */ nullptr,
+		/* 195 */ nullptr,
+		/* 196 */ nullptr,
+		/* 197 */ nullptr,
+		/* 198 */ nullptr,
+		/* 199 */ nullptr,
+		/* 200 */ nullptr,
+		/* 201 */ nullptr,
+		/* 202 */ nullptr,
+		/* 203 */ nullptr,
+		/* 204 */ nullptr,
+		/* 205 */ nullptr,
+		/* 206 */ nullptr,
+		/* 207 */ nullptr,
+		/* 208 */ nullptr,
+		/* 209 */ nullptr,
+		/* 210 */ nullptr,
+		/* 211 */ nullptr,
+		/* 212 */ nullptr,
+		/* 213 */ nullptr,
+		/* 214 */ "brk",
+		/* 215 */ "munmap",
+		/* 216 */ nullptr,
+		/* 217 */ nullptr,
+		/* 218 */ nullptr,
+		/* 219 */ nullptr,
+		/* 220 */ "clone",
+		/* 221 */ nullptr,
+		/* 222 */ "mmap",
+		/* 223 */ nullptr,
+		/* 224 */ nullptr,
+		/* 225 */ nullptr,
+		/* 226 */ "mprotect",
+		/* 227 */ nullptr,
+		/* 228 */ nullptr,
+		/* 229 */ nullptr,
+		/* 230 */ nullptr,
+		/* 231 */ nullptr,
+		/* 232 */ nullptr,
+		/* 233 */ "madvise",
+		/* 234 */ nullptr,
+		/* 235 */ nullptr,
+		/* 236 */ nullptr,
+		/* 237 */ nullptr,
+		/* 238 */ nullptr,
+		/* 239 */ nullptr,
+		/* 240 */ nullptr,
+		/* 241 */ nullptr,
+		/* 242 */ nullptr,
+		/* 243 */ nullptr,
+		/* 244 */ nullptr,
+		/* 245 */ nullptr,
+		/* 246 */ nullptr,
+		/* 247 */ nullptr,
+		/* 248 */ nullptr,
+		/* 249 */ nullptr,
+		/* 250 */ nullptr,
+		/* 251 */ nullptr,
+		/* 252 */ nullptr,
+		/* 253 */ nullptr,
+		/* 254 */ nullptr,
+		/* 255 */ nullptr,
+		/* 256 */ nullptr,
+		/* 257 */ nullptr,
+		/* 258 */ nullptr,
+		/* 259 */ nullptr,
+		/* 260 */ nullptr,
+		/* 261 */ "prlimit64",
+		/* 262 */ nullptr,
+		/* 263 */ nullptr,
+		/* 264 */ nullptr,
+		/* 265 */ nullptr,
+		/* 266 */ nullptr,
+		/* 267 */ nullptr,
+		/* 268 */ nullptr,
+		/* 269 */ nullptr,
+		/* 270 */ nullptr,
+		/* 271 */ nullptr,
+		/* 272 */ nullptr,
+		/* 273 */ nullptr,
+		/* 274 */ nullptr,
+		/* 275 */ nullptr,
+		/* 276 */ nullptr,
+		/* 277 */ nullptr,
+		/* 278 */ "getrandom",
+	};
+
+}
+
+#endif
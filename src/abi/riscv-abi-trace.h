@@ -0,0 +1,202 @@
+//
+//  riscv-abi-trace.h
+//
+
+#ifndef riscv_abi_trace_h
+#define riscv_abi_trace_h
+
+namespace riscv {
+
+	/*
+	 * Proxy syscall trace.
+	 *
+	 * Each guest thread pushes one record per syscall into its own single
+	 * producer ring, so tracing never takes a lock on the guest side. A
+	 * background thread drains the rings every poll interval, appends the
+	 * records to the trace file and adds each duration to a per-syscall
+	 * latency histogram. Records are dropped and counted if a ring is full.
+	 *
+	 * The trace file is an abi_trace_header followed by abi_trace_record
+	 * structs in host byte order, in per-thread order between drains.
+	 * Durations are host cycle counter ticks.
+	 */
+
+	struct abi_trace_header
+	{
+		char magic[8];                /* "RVSCTRC" */
+		u32 version;
+		u32 record_size;
+	};
+
+	struct abi_trace_record
+	{
+		u64 start;                    /* cycle counter at syscall entry */
+		u64 ticks;                    /* cycles spent in the syscall */
+		u32 tid;
+		u32 number;
+		u64 args[6];
+		s64 ret;
+	};
+
+	/* log-linear histogram with 16 sub-buckets per power of two, error under 6.25% */
+	struct abi_trace_histogram
+	{
+		enum : size_t {
+			sub_bits = 4,
+			sub_count = 1 << sub_bits,
+			bucket_count = (64 - sub_bits + 1) << sub_bits
+		};
+
+		std::vector<u64> buckets;
+		u64 count;
+		u64 total;
+		u64 max;
+
+		abi_trace_histogram() : buckets(bucket_count), count(0), total(0), max(0) {}
+
+		static size_t index(u64 val)
+		{
+			if (val < sub_count) return size_t(val);
+			size_t e = 63 - clz(val);
+			return ((e - sub_bits + 1) << sub_bits) + ((val >> (e - sub_bits)) & (sub_count - 1));
+		}
+
+		/* largest value in bucket i */
+		static u64 upper(size_t i)
+		{
+			if (i < sub_count) return i;
+			size_t e = (i >> sub_bits) + sub_bits - 1;
+			u64 lower = (1ULL << e) | (u64(i & (sub_count - 1)) << (e - sub_bits));
+			return lower + ((1ULL << (e - sub_bits)) - 1);
+		}
+
+		void add(u64 val)
+		{
+			buckets[index(val)]++;
+			count++;
+			total += val;
+			max = std::max(max, val);
+		}
+
+		u64 percentile(double p)
+		{
+			u64 rank = u64(p * count + 0.5), seen = 0;
+			for (size_t i = 0; i < bucket_count; i++) {
+				seen += buckets[i];
+				if (seen > 0 && seen >= rank) return std::min(upper(i), max);
+			}
+			return max;
+		}
+	};
+
+	struct proxy_syscall_trace
+	{
+		enum : size_t { ring_size = 16384, batch_size = 256 };
+		enum : u64 { poll_us = 1000 };
+
+		typedef spsc_ring<abi_trace_record, ring_size> ring_type;
+
+		FILE *file;
+		bool summary;                 /* print histograms at exit */
+		std::mutex lock;
+		std::condition_variable cond;
+		bool running;
+		std::vector<std::shared_ptr<ring_type>> rings;
+		std::map<u32, abi_trace_histogram> histograms;
+		std::thread flusher;
+
+		std::atomic<u64> dropped;     /* statistics */
+		u64 records;
+
+		proxy_syscall_trace() : file(nullptr), summary(false), running(false), dropped(0), records(0) {}
+
+		~proxy_syscall_trace() { stop(); }
+
+		/* open the trace file, an empty filename keeps only the histograms */
+		bool open(std::string filename)
+		{
+			if (filename.size() == 0) return true;
+			if (!(file = fopen(filename.c_str(), "wb"))) return false;
+			abi_trace_header hdr = { { 'R', 'V', 'S', 'C', 'T', 'R', 'C', 0 }, 1, sizeof(abi_trace_record) };
+			fwrite(&hdr, sizeof(hdr), 1, file);
+			return true;
+		}
+
+		/* ring for a new guest thread */
+		std::shared_ptr<ring_type> add_ring()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			auto ring = std::make_shared<ring_type>();
+			rings.push_back(ring);
+			return ring;
+		}
+
+		void start()
+		{
+			running = true;
+			flusher = std::thread([this] {
+				std::unique_lock<std::mutex> guard(lock);
+				while (running) {
+					guard.unlock();
+					drain();
+					guard.lock();
+					cond.wait_for(guard, std::chrono::microseconds(poll_us));
+				}
+			});
+		}
+
+		/* called from the flusher thread and once more after it stops */
+		void drain()
+		{
+			std::vector<std::shared_ptr<ring_type>> current;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				current = rings;
+			}
+			abi_trace_record batch[batch_size];
+			for (auto &ring : current) {
+				size_t n;
+				while ((n = ring->pop(batch, batch_size)) > 0) {
+					if (file) fwrite(batch, sizeof(abi_trace_record), n, file);
+					for (size_t i = 0; i < n; i++) {
+						histograms[batch[i].number].add(batch[i].ticks);
+					}
+					records += n;
+				}
+			}
+		}
+
+		void stop()
+		{
+			if (!flusher.joinable()) return;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				running = false;
+			}
+			cond.notify_one();
+			flusher.join();
+			drain();
+			if (file) {
+				fclose(file);
+				file = nullptr;
+			}
+		}
+
+		/* per-syscall count, total ticks and latency percentiles */
+		void print_summary(const char* const *names, size_t limit)
+		{
+			debug("%-16s %10s %14s %10s %10s %10s", "syscall", "calls", "total_ticks", "p50", "p99", "max");
+			for (auto &ent : histograms) {
+				abi_trace_histogram &hist = ent.second;
+				std::string name = ent.first < limit && names[ent.first] ? names[ent.first] :
+					format_string("%u", ent.first);
+				debug("%-16s %10" PRIu64 " %14" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64,
+					name.c_str(), hist.count, hist.total, hist.percentile(0.5), hist.percentile(0.99), hist.max);
+			}
+			debug("trace: records=%" PRIu64 " dropped=%" PRIu64, records, u64(dropped));
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,405 @@
+//
+//  riscv-abi-types.h
+//
+//  DANGER - This is machine generated code
+//
+
+#ifndef riscv_abi_types_h
+#define riscv_abi_types_h
+
+#if defined (__APPLE__)
+#define st_atim st_atimespec
+#define st_mtim st_mtimespec
+#define st_ctim st_ctimespec
+#endif
+
+namespace riscv {
+
+	enum abi_syscall
+	{
+		abi_syscall_dup                         = 23,
+		abi_syscall_dup3                        = 24,
+		abi_syscall_fcntl                       = 25,
+		abi_syscall_ioctl                       = 29,
+		abi_syscall_mkdirat                     = 34,
+		abi_syscall_unlinkat                    = 35,
+		abi_syscall_linkat                      = 37,
+		abi_syscall_renameat                    = 38,
+		abi_syscall_faccessat                   = 48,
+		abi_syscall_chdir                       = 49,
+		abi_syscall_fchdir                      = 50,
+		abi_syscall_fchmod                      = 52,
+		abi_syscall_fchmodat                    = 53,
+		abi_syscall_fchown                      = 55,
+		abi_syscall_openat                      = 56,
+		abi_syscall_close                       = 57,
+		abi_syscall_pipe2                       = 59,
+		abi_syscall_getdents64                  = 61,
+		abi_syscall_lseek                       = 62,
+		abi_syscall_read                        = 63,
+		abi_syscall_write                       = 64,
+		abi_syscall_readv                       = 65,
+		abi_syscall_writev                      = 66,
+		abi_syscall_pread64                     = 67,
+		abi_syscall_pwrite64                    = 68,
+		abi_syscall_readlinkat                  = 78,
+		abi_syscall_newfstatat                  = 79,
+		abi_syscall_fstat                       = 80,
+		abi_syscall_fsync                       = 82,
+		abi_syscall_fdatasync                   = 83,
+		abi_syscall_exit                        = 93,
+		abi_syscall_exit_group                  = 94,
+		abi_syscall_set_tid_address             = 96,
+		abi_syscall_futex                       = 98,
+		abi_syscall_set_robust_list             = 99,
+		abi_syscall_nanosleep                   = 101,
+		abi_syscall_clock_gettime               = 113,
+		abi_syscall_clock_getres                = 114,
+		abi_syscall_sched_yield                 = 124,
+		abi_syscall_kill                        = 129,
+		abi_syscall_rt_sigaction                = 134,
+		abi_syscall_rt_sigprocmask              = 135,
+		abi_syscall_setsid                      = 157,
+		abi_syscall_uname                       = 160,
+		abi_syscall_umask                       = 166,
+		abi_syscall_gettimeofday                = 169,
+		abi_syscall_getpid                      = 172,
+		abi_syscall_getppid                     = 173,
+		abi_syscall_getuid                      = 174,
+		abi_syscall_geteuid                     = 175,
+		abi_syscall_getgid                      = 176,
+		abi_syscall_getegid                     = 177,
+		abi_syscall_gettid                      = 178,
+		abi_syscall_brk                         = 214,
+		abi_syscall_munmap                      = 215,
+		abi_syscall_clone                       = 220,
+		abi_syscall_mmap                        = 222,
+		abi_syscall_mprotect                    = 226,
+		abi_syscall_madvise                     = 233,
+		abi_syscall_prlimit64                   = 261,
+		abi_syscall_getrandom                   = 278,
+	};
+
+	enum : size_t { abi_syscall_limit = 279 };
+
+	template <typename P> struct abi_timeval
+	{
+		typename P::long_t  tv_sec;
+		typename P::long_t  tv_usec;
+	};
+
+	/* true if a guest abi_timeval can be passed to the host as struct timeval */
+	template <typename P> constexpr bool abi_timeval_same_layout()
+	{
+		return sizeof(abi_timeval<P>) == sizeof(struct timeval)
+			&& offsetof(abi_timeval<P>, tv_sec) == offsetof(struct timeval, tv_sec)
+			&& sizeof(((abi_timeval<P>*)0)->tv_sec) == sizeof(((struct timeval*)0)->tv_sec)
+			&& offsetof(abi_timeval<P>, tv_usec) == offsetof(struct timeval, tv_usec)
+			&& sizeof(((abi_timeval<P>*)0)->tv_usec) == sizeof(((struct timeval*)0)->tv_usec);
+	}
+
+	template <typename P> void cvt_abi_timeval_to_host(struct timeval *host, const abi_timeval<P> *guest)
+	{
+		memset(host, 0, sizeof(*host));
+		host->tv_sec = guest->tv_sec;
+		host->tv_usec = guest->tv_usec;
+	}
+
+	template <typename P> void cvt_abi_timeval_to_guest(abi_timeval<P> *guest, const struct timeval *host)
+	{
+		memset(guest, 0, sizeof(*guest));
+		guest->tv_sec = host->tv_sec;
+		guest->tv_usec = host->tv_usec;
+	}
+
+	/* host view of a guest abi_timeval read by the host, copied into tmp unless the layouts match, false on a fault */
+	template <typename P> bool abi_timeval_in(uintptr_t va, struct timeval &tmp, struct timeval *&host)
+	{
+		if (!va || abi_timeval_same_layout<P>()) {
+			host = (struct timeval*)va;
+			return true;
+		}
+		abi_timeval<P> guest;
+		if (!abi_copy_guest(&guest, (const void*)va, sizeof(guest))) return false;
+		cvt_abi_timeval_to_host(&tmp, &guest);
+		host = &tmp;
+		return true;
+	}
+
+	/* host view of a guest abi_timeval written by the host, tmp unless the layouts match */
+	template <typename P> struct timeval* abi_timeval_out(uintptr_t va, struct timeval &tmp)
+	{
+		if (!va || abi_timeval_same_layout<P>()) return (struct timeval*)va;
+		memset(&tmp, 0, sizeof(tmp));
+		return &tmp;
+	}
+
+	/* write back a host struct timeval to the guest unless the host wrote it in place, false on a fault */
+	template <typename P> bool abi_timeval_copyout(uintptr_t va, const struct timeval *host)
+	{
+		if (!va || (uintptr_t)host == va) return true;
+		abi_timeval<P> guest;
+		cvt_abi_timeval_to_guest(&guest, host);
+		return abi_copy_guest((void*)va, &guest, sizeof(guest));
+	}
+
+	template <typename P> struct abi_timespec
+	{
+		typename P::long_t  tv_sec;
+		typename P::long_t  tv_nsec;
+	};
+
+	/* true if a guest abi_timespec can be passed to the host as struct timespec */
+	template <typename P> constexpr bool abi_timespec_same_layout()
+	{
+		return sizeof(abi_timespec<P>) == sizeof(struct timespec)
+			&& offsetof(abi_timespec<P>, tv_sec) == offsetof(struct timespec, tv_sec)
+			&& sizeof(((abi_timespec<P>*)0)->tv_sec) == sizeof(((struct timespec*)0)->tv_sec)
+			&& offsetof(abi_timespec<P>, tv_nsec) == offsetof(struct timespec, tv_nsec)
+			&& sizeof(((abi_timespec<P>*)0)->tv_nsec) == sizeof(((struct timespec*)0)->tv_nsec);
+	}
+
+	template <typename P> void cvt_abi_timespec_to_host(struct timespec *host, const abi_timespec<P> *guest)
+	{
+		memset(host, 0, sizeof(*host));
+		host->tv_sec = guest->tv_sec;
+		host->tv_nsec = guest->tv_nsec;
+	}
+
+	template <typename P> void cvt_abi_timespec_to_guest(abi_timespec<P> *guest, const struct timespec *host)
+	{
+		memset(guest, 0, sizeof(*guest));
+		guest->tv_sec = host->tv_sec;
+		guest->tv_nsec = host->tv_nsec;
+	}
+
+	/* host view of a guest abi_timespec read by the host, copied into tmp unless the layouts match, false on a fault */
+	template <typename P> bool abi_timespec_in(uintptr_t va, struct timespec &tmp, struct timespec *&host)
+	{
+		if (!va || abi_timespec_same_layout<P>()) {
+			host = (struct timespec*)va;
+			return true;
+		}
+		abi_timespec<P> guest;
+		if (!abi_copy_guest(&guest, (const void*)va, sizeof(guest))) return false;
+		cvt_abi_timespec_to_host(&tmp, &guest);
+		host = &tmp;
+		return true;
+	}
+
+	/* host view of a guest abi_timespec written by the host, tmp unless the layouts match */
+	template <typename P> struct timespec* abi_timespec_out(uintptr_t va, struct timespec &tmp)
+	{
+		if (!va || abi_timespec_same_layout<P>()) return (struct timespec*)va;
+		memset(&tmp, 0, sizeof(tmp));
+		return &tmp;
+	}
+
+	/* write back a host struct timespec to the guest unless the host wrote it in place, false on a fault */
+	template <typename P> bool abi_timespec_copyout(uintptr_t va, const struct timespec *host)
+	{
+		if (!va || (uintptr_t)host == va) return true;
+		abi_timespec<P> guest;
+		cvt_abi_timespec_to_guest(&guest, host);
+		return abi_copy_guest((void*)va, &guest, sizeof(guest));
+	}
+
+	template <typename P> struct abi_timezone
+	{
+		typename P::int_t   tz_minuteswest;
+		typename P::int_t   tz_dsttime;
+	};
+
+	/* true if a guest abi_timezone can be passed to the host as struct timezone */
+	template <typename P> constexpr bool abi_timezone_same_layout()
+	{
+		return sizeof(abi_timezone<P>) == sizeof(struct timezone)
+			&& offsetof(abi_timezone<P>, tz_minuteswest) == offsetof(struct timezone, tz_minuteswest)
+			&& sizeof(((abi_timezone<P>*)0)->tz_minuteswest) == sizeof(((struct timezone*)0)->tz_minuteswest)
+			&& offsetof(abi_timezone<P>, tz_dsttime) == offsetof(struct timezone, tz_dsttime)
+			&& sizeof(((abi_timezone<P>*)0)->tz_dsttime) == sizeof(((struct timezone*)0)->tz_dsttime);
+	}
+
+	template <typename P> void cvt_abi_timezone_to_host(struct timezone *host, const abi_timezone<P> *guest)
+	{
+		memset(host, 0, sizeof(*host));
+		host->tz_minuteswest = guest->tz_minuteswest;
+		host->tz_dsttime = guest->tz_dsttime;
+	}
+
+	template <typename P> void cvt_abi_timezone_to_guest(abi_timezone<P> *guest, const struct timezone *host)
+	{
+		memset(guest, 0, sizeof(*guest));
+		guest->tz_minuteswest = host->tz_minuteswest;
+		guest->tz_dsttime = host->tz_dsttime;
+	}
+
+	/* host view of a guest abi_timezone read by the host, copied into tmp unless the layouts match, false on a fault */
+	template <typename P> bool abi_timezone_in(uintptr_t va, struct timezone &tmp, struct timezone *&host)
+	{
+		if (!va || abi_timezone_same_layout<P>()) {
+			host = (struct timezone*)va;
+			return true;
+		}
+		abi_timezone<P> guest;
+		if (!abi_copy_guest(&guest, (const void*)va, sizeof(guest))) return false;
+		cvt_abi_timezone_to_host(&tmp, &guest);
+		host = &tmp;
+		return true;
+	}
+
+	/* host view of a guest abi_timezone written by the host, tmp unless the layouts match */
+	template <typename P> struct timezone* abi_timezone_out(uintptr_t va, struct timezone &tmp)
+	{
+		if (!va || abi_timezone_same_layout<P>()) return (struct timezone*)va;
+		memset(&tmp, 0, sizeof(tmp));
+		return &tmp;
+	}
+
+	/* write back a host struct timezone to the guest unless the host wrote it in place, false on a fault */
+	template <typename P> bool abi_timezone_copyout(uintptr_t va, const struct timezone *host)
+	{
+		if (!va || (uintptr_t)host == va) return true;
+		abi_timezone<P> guest;
+		cvt_abi_timezone_to_guest(&guest, host);
+		return abi_copy_guest((void*)va, &guest, sizeof(guest));
+	}
+
+	template <typename P> struct abi_stat
+	{
+		typename P::ulong_t dev;
+		typename P::ulong_t ino;
+		typename P::uint_t  mode;
+		typename P::uint_t  nlink;
+		typename P::uint_t  uid;
+		typename P::uint_t  gid;
+		typename P::ulong_t rdev;
+		typename P::ulong_t __pad1;
+		typename P::long_t  size;
+		typename P::int_t   blksize;
+		typename P::int_t   __pad2;
+		typename P::long_t  blocks;
+		typename P::long_t  atime;
+		typename P::ulong_t atime_nsec;
+		typename P::long_t  mtime;
+		typename P::ulong_t mtime_nsec;
+		typename P::long_t  ctime;
+		typename P::ulong_t ctime_nsec;
+		typename P::uint_t  __unused4;
+		typename P::uint_t  __unused5;
+	};
+
+	/* true if a guest abi_stat can be passed to the host as struct stat */
+	template <typename P> constexpr bool abi_stat_same_layout()
+	{
+		return sizeof(abi_stat<P>) == sizeof(struct stat)
+			&& offsetof(abi_stat<P>, dev) == offsetof(struct stat, st_dev)
+			&& sizeof(((abi_stat<P>*)0)->dev) == sizeof(((struct stat*)0)->st_dev)
+			&& offsetof(abi_stat<P>, ino) == offsetof(struct stat, st_ino)
+			&& sizeof(((abi_stat<P>*)0)->ino) == sizeof(((struct stat*)0)->st_ino)
+			&& offsetof(abi_stat<P>, mode) == offsetof(struct stat, st_mode)
+			&& sizeof(((abi_stat<P>*)0)->mode) == sizeof(((struct stat*)0)->st_mode)
+			&& offsetof(abi_stat<P>, nlink) == offsetof(struct stat, st_nlink)
+			&& sizeof(((abi_stat<P>*)0)->nlink) == sizeof(((struct stat*)0)->st_nlink)
+			&& offsetof(abi_stat<P>, uid) == offsetof(struct stat, st_uid)
+			&& sizeof(((abi_stat<P>*)0)->uid) == sizeof(((struct stat*)0)->st_uid)
+			&& offsetof(abi_stat<P>, gid) == offsetof(struct stat, st_gid)
+			&& sizeof(((abi_stat<P>*)0)->gid) == sizeof(((struct stat*)0)->st_gid)
+			&& offsetof(abi_stat<P>, rdev) == offsetof(struct stat, st_rdev)
+			&& sizeof(((abi_stat<P>*)0)->rdev) == sizeof(((struct stat*)0)->st_rdev)
+			&& offsetof(abi_stat<P>, size) == offsetof(struct stat, st_size)
+			&& sizeof(((abi_stat<P>*)0)->size) == sizeof(((struct stat*)0)->st_size)
+			&& offsetof(abi_stat<P>, blksize) == offsetof(struct stat, st_blksize)
+			&& sizeof(((abi_stat<P>*)0)->blksize) == sizeof(((struct stat*)0)->st_blksize)
+			&& offsetof(abi_stat<P>, blocks) == offsetof(struct stat, st_blocks)
+			&& sizeof(((abi_stat<P>*)0)->blocks) == sizeof(((struct stat*)0)->st_blocks)
+			&& offsetof(abi_stat<P>, atime) == offsetof(struct stat, st_atim.tv_sec)
+			&& sizeof(((abi_stat<P>*)0)->atime) == sizeof(((struct stat*)0)->st_atim.tv_sec)
+			&& offsetof(abi_stat<P>, atime_nsec) == offsetof(struct stat, st_atim.tv_nsec)
+			&& sizeof(((abi_stat<P>*)0)->atime_nsec) == sizeof(((struct stat*)0)->st_atim.tv_nsec)
+			&& offsetof(abi_stat<P>, mtime) == offsetof(struct stat, st_mtim.tv_sec)
+			&& sizeof(((abi_stat<P>*)0)->mtime) == sizeof(((struct stat*)0)->st_mtim.tv_sec)
+			&& offsetof(abi_stat<P>, mtime_nsec) == offsetof(struct stat, st_mtim.tv_nsec)
+			&& sizeof(((abi_stat<P>*)0)->mtime_nsec) == sizeof(((struct stat*)0)->st_mtim.tv_nsec)
+			&& offsetof(abi_stat<P>, ctime) == offsetof(struct stat, st_ctim.tv_sec)
+			&& sizeof(((abi_stat<P>*)0)->ctime) == sizeof(((struct stat*)0)->st_ctim.tv_sec)
+			&& offsetof(abi_stat<P>, ctime_nsec) == offsetof(struct stat, st_ctim.tv_nsec)
+			&& sizeof(((abi_stat<P>*)0)->ctime_nsec) == sizeof(((struct stat*)0)->st_ctim.tv_nsec);
+	}
+
+	template <typename P> void cvt_abi_stat_to_host(struct stat *host, const abi_stat<P> *guest)
+	{
+		memset(host, 0, sizeof(*host));
+		host->st_dev = guest->dev;
+		host->st_ino = guest->ino;
+		host->st_mode = guest->mode;
+		host->st_nlink = guest->nlink;
+		host->st_uid = guest->uid;
+		host->st_gid = guest->gid;
+		host->st_rdev = guest->rdev;
+		host->st_size = guest->size;
+		host->st_blksize = guest->blksize;
+		host->st_blocks = guest->blocks;
+		host->st_atim.tv_sec = guest->atime;
+		host->st_atim.tv_nsec = guest->atime_nsec;
+		host->st_mtim.tv_sec = guest->mtime;
+		host->st_mtim.tv_nsec = guest->mtime_nsec;
+		host->st_ctim.tv_sec = guest->ctime;
+		host->st_ctim.tv_nsec = guest->ctime_nsec;
+	}
+
+	template <typename P> void cvt_abi_stat_to_guest(abi_stat<P> *guest, const struct stat *host)
+	{
+		memset(guest, 0, sizeof(*guest));
+		guest->dev = host->st_dev;
+		guest->ino = host->st_ino;
+		guest->mode = host->st_mode;
+		guest->nlink = host->st_nlink;
+		guest->uid = host->st_uid;
+		guest->gid = host->st_gid;
+		guest->rdev = host->st_rdev;
+		guest->size = host->st_size;
+		guest->blksize = host->st_blksize;
+		guest->blocks = host->st_blocks;
+		guest->atime = host->st_atim.tv_sec;
+		guest->atime_nsec = host->st_atim.tv_nsec;
+		guest->mtime = host->st_mtim.tv_sec;
+		guest->mtime_nsec = host->st_mtim.tv_nsec;
+		guest->ctime = host->st_ctim.tv_sec;
+		guest->ctime_nsec = host->st_ctim.tv_nsec;
+	}
+
+	/* host view of a guest abi_stat read by the host, copied into tmp unless the layouts match, false on a fault */
+	template <typename P> bool abi_stat_in(uintptr_t va, struct stat &tmp, struct stat *&host)
+	{
+		if (!va || abi_stat_same_layout<P>()) {
+			host = (struct stat*)va;
+			return true;
+		}
+		abi_stat<P> guest;
+		if (!abi_copy_guest(&guest, (const void*)va, sizeof(guest))) return false;
+		cvt_abi_stat_to_host(&tmp, &guest);
+		host = &tmp;
+		return true;
+	}
+
+	/* host view of a guest abi_stat written by the host, tmp unless the layouts match */
+	template <typename P> struct stat* abi_stat_out(uintptr_t va, struct stat &tmp)
+	{
+		if (!va || abi_stat_same_layout<P>()) return (struct stat*)va;
+		memset(&tmp, 0, sizeof(tmp));
+		return &tmp;
+	}
+
+	/* write back a host struct stat to the guest unless the host wrote it in place, false on a fault */
+	template <typename P> bool abi_stat_copyout(uintptr_t va, const struct stat *host)
+	{
+		if (!va || (uintptr_t)host == va) return true;
+		abi_stat<P> guest;
+		cvt_abi_stat_to_guest(&guest, host);
+		return abi_copy_guest((void*)va, &guest, sizeof(guest));
+	}
+
+}
+
+#endif
@@ -0,0 +1,386 @@
+//
+//  riscv-proxy-process.h
+//
+
+#ifndef riscv_proxy_process_h
+#define riscv_proxy_process_h
+
+namespace riscv {
+
+	static inline int elf_p_flags_mmap(int v)
+	{
+		int prot = 0;
+		if (v & PF_X) prot |= PROT_EXEC;
+		if (v & PF_W) prot |= PROT_WRITE;
+		if (v & PF_R) prot |= PROT_READ;
+		return prot;
+	}
+
+	/* the same for every guest process, the sandbox mmap area starts at the stack top */
+	enum : uintptr_t {
+		proxy_stack_top = 0x78000000,     /* 1920 MiB */
+		proxy_stack_size = 0x01000000     /*   16 MiB */
+	};
+
+	/*
+	 * Initial guest stack: argc, argv, envp and auxv followed by the
+	 * strings, laid out below the stack top as described in riscv-elf.h,
+	 * with the 16 AT_RANDOM bytes at the very top. The environment, auxv
+	 * and AT_RANDOM address do not depend on the arguments, so init()
+	 * encodes them once per executable. build() adds the argument
+	 * pointers and strings in a caller-owned buffer that is reused
+	 * between runs, and the image is written to the stack with one memcpy.
+	 */
+
+	struct proxy_stack_image
+	{
+		enum : size_t { random_size = 16, page_size = 4096 };
+
+		size_t word_size;
+		uintptr_t top;
+		std::vector<u8> tail_words;   /* envp, null, auxv and AT_NULL */
+		std::vector<u8> tail_strings; /* environment strings, then the AT_RANDOM bytes */
+
+		proxy_stack_image() : word_size(8), top(0) {}
+
+		void put_word(u8 *p, u64 val) const
+		{
+			if (word_size == 4) {
+				u32 w = u32(val);
+				memcpy(p, &w, sizeof(w));
+			} else {
+				memcpy(p, &val, sizeof(val));
+			}
+		}
+
+		void push_word(std::vector<u8> &vec, u64 val)
+		{
+			vec.resize(vec.size() + word_size);
+			put_word(vec.data() + vec.size() - word_size, val);
+		}
+
+		/* guest address of the program headers, from PT_PHDR or the load segment containing them */
+		static u64 phdr_addr(elf_file &elf)
+		{
+			for (auto &phdr : elf.phdrs) {
+				if (phdr.p_type == PT_PHDR) return phdr.p_vaddr;
+			}
+			for (auto &phdr : elf.phdrs) {
+				if (phdr.p_type == PT_LOAD && elf.ehdr.e_phoff >= phdr.p_offset &&
+					elf.ehdr.e_phoff < phdr.p_offset + phdr.p_filesz) {
+					return phdr.p_vaddr + (elf.ehdr.e_phoff - phdr.p_offset);
+				}
+			}
+			return 0;
+		}
+
+		void init(elf_file &elf, uintptr_t stack_top, char **envp)
+		{
+			word_size = elf.ei_class == ELFCLASS32 ? 4 : 8;
+			top = stack_top;
+
+			std::vector<size_t> env_offsets;
+			tail_strings.clear();
+			for (char **ep = envp; ep && *ep; ep++) {
+				env_offsets.push_back(tail_strings.size());
+				tail_strings.insert(tail_strings.end(), *ep, *ep + strlen(*ep) + 1);
+			}
+			tail_strings.resize(tail_strings.size() + random_size);
+
+			uintptr_t strings = top - tail_strings.size();
+			tail_words.clear();
+			for (size_t offset : env_offsets) push_word(tail_words, strings + offset);
+			push_word(tail_words, 0);
+
+			size_t phent = elf.ei_class == ELFCLASS32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr);
+			u64 auxv[][2] = {
+				{ AT_PHDR, phdr_addr(elf) },
+				{ AT_PHENT, phent },
+				{ AT_PHNUM, elf.phdrs.size() },
+				{ AT_PAGESZ, page_size },
+				{ AT_ENTRY, elf.ehdr.e_entry },
+				{ AT_RANDOM, top - random_size },
+				{ AT_NULL, 0 }
+			};
+			for (auto &ent : auxv) {
+				push_word(tail_words, ent[0]);
+				push_word(tail_words, ent[1]);
+			}
+		}
+
+		/* lay out the stack image for args in buf, returns the guest stack pointer */
+		uintptr_t build(std::vector<u8> &buf, const std::vector<std::string> &args, const u8 *random) const
+		{
+			size_t arg_bytes = 0;
+			for (auto &arg : args) arg_bytes += arg.size() + 1;
+			size_t strings = arg_bytes + tail_strings.size();
+			size_t words = (args.size() + 2) * word_size + tail_words.size();
+			size_t size = (words + strings + 15) & ~size_t(15);
+			buf.resize(size);
+
+			/* argc, argv, then the precomputed envp and auxv */
+			u8 *p = buf.data();
+			uintptr_t str = top - strings;
+			put_word(p, args.size());
+			p += word_size;
+			for (auto &arg : args) {
+				put_word(p, str);
+				p += word_size;
+				str += arg.size() + 1;
+			}
+			put_word(p, 0);
+			p += word_size;
+			memcpy(p, tail_words.data(), tail_words.size());
+			p += tail_words.size();
+
+			/* padding, argument strings, environment strings and AT_RANDOM */
+			u8 *s = buf.data() + size - strings;
+			memset(p, 0, s - p);
+			for (auto &arg : args) {
+				memcpy(s, arg.c_str(), arg.size() + 1);
+				s += arg.size() + 1;
+			}
+			memcpy(s, tail_strings.data(), tail_strings.size() - random_size);
+			memcpy(buf.data() + size - random_size, random, random_size);
+			return top - size;
+		}
+	};
+
+	/*
+	 * Guest process in proxy mode. The ELF load segments, the brk heap and
+	 * the stack are mapped at their guest addresses, either directly in the
+	 * host address space or inside a sandbox, which lets any number of
+	 * processes share one host process. Guest threads created by clone run
+	 * on their own host threads.
+	 */
+
+	template <typename P>
+	struct proxy_process
+	{
+		enum : uintptr_t {
+			stack_top = proxy_stack_top,
+			stack_size = proxy_stack_size,
+			mmap_base_rv32 = 0x40000000,
+			page_size = 0x1000
+		};
+
+		enum : size_t { sandbox_bits_rv64 = 38 };  /* 256 GiB */
+
+		P proc;
+
+		bool debug_enabled() { return proc.flags & processor_flag_emulator_debug; }
+
+		/* Map a single stack segment into user address space */
+		void map_stack()
+		{
+			void *addr = mmap((void*)proc.mmu.host_addr(stack_top - stack_size), stack_size,
+				PROT_READ | PROT_WRITE, MAP_FIXED | MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+			if (addr == MAP_FAILED) {
+				panic("map_stack: error: mmap: %s", strerror(errno));
+			}
+
+			/* keep track of the mapped segment and set the stack_top */
+			proc.mmu.add_segment(addr, stack_size);
+			proc.ireg[riscv_ireg_sp] = stack_top - 0x8;
+
+			if (debug_enabled()) {
+				debug("sp : mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " +R+W",
+					uintptr_t(stack_top - stack_size), uintptr_t(stack_top));
+			}
+		}
+
+		/* Map ELF load segments into user address space */
+		void map_load_segment(const char* filename, Elf64_Phdr &phdr)
+		{
+			int fd = open(filename, O_RDONLY);
+			if (fd < 0) {
+				panic("map_executable: error: open: %s: %s", filename, strerror(errno));
+			}
+			if (!proc.mmu.in_sandbox(phdr.p_vaddr, phdr.p_memsz)) {
+				panic("map_executable: error: segment outside the sandbox: %s", filename);
+			}
+			void *addr = mmap((void*)proc.mmu.host_addr(phdr.p_vaddr), phdr.p_memsz,
+				elf_p_flags_mmap(phdr.p_flags), MAP_FIXED | MAP_PRIVATE, fd, phdr.p_offset);
+			close(fd);
+			if (addr == MAP_FAILED) {
+				panic("map_executable: error: mmap: %s: %s", filename, strerror(errno));
+			}
+
+			/* keep track of the mapped segment and set the heap_end */
+			proc.mmu.add_segment(addr, phdr.p_memsz);
+			uintptr_t seg_end = uintptr_t(phdr.p_vaddr + phdr.p_memsz);
+			if (proc.mmu.heap_begin < seg_end) proc.mmu.heap_begin = proc.mmu.heap_end = seg_end;
+
+			if (debug_enabled()) {
+				debug("elf: mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " %s",
+					uintptr_t(phdr.p_vaddr), uintptr_t(phdr.p_vaddr + phdr.p_memsz),
+					elf_p_flags_name(phdr.p_flags).c_str());
+			}
+		}
+
+		/* Map the executable, heap and stack and set the program counter to the entry address */
+		void load(elf_file &elf, const char *filename, bool sandbox)
+		{
+			/* Guest addresses are offsets into a 4GiB (RV32) or masked 2^38 byte (RV64) reservation */
+			if (sandbox) {
+				if (!proc.mmu.reserve_sandbox(P::xlen == 32 ? 32 : sandbox_bits_rv64, stack_top)) {
+					panic("sandbox: mmap: %s", strerror(errno));
+				}
+				if (debug_enabled()) {
+					debug("sandbox: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " mask=0x%016" PRIxPTR,
+						proc.mmu.base, proc.mmu.base + proc.mmu.sandbox_size, proc.mmu.mask);
+				}
+			}
+
+			/* Find the ELF executable PT_LOAD segments and mmap them into user memory */
+			for (size_t i = 0; i < elf.phdrs.size(); i++) {
+				Elf64_Phdr &phdr = elf.phdrs[i];
+				if (phdr.p_flags & PT_LOAD) {
+					map_load_segment(filename, phdr);
+				}
+			}
+
+			/* 32-bit guests mmap below 4GiB on either side of the stack */
+			if (!sandbox && P::xlen == 32) {
+				proc.mmu.add_mmap_area(mmap_base_rv32, stack_top - stack_size);
+				proc.mmu.add_mmap_area(stack_top, uintptr_t(1ULL << 32));
+			}
+
+			/* Reserve the brk heap after the highest load segment, below the stack in a sandbox */
+			size_t heap_size = proc.mmu.reserve_heap(sandbox ? stack_top - stack_size :
+				P::xlen == 32 ? uintptr_t(mmap_base_rv32) : ~uintptr_t(0));
+			if (debug_enabled()) {
+				debug("brk: reserve: 0x%016" PRIxPTR " - 0x%016" PRIxPTR,
+					proc.mmu.heap_reserve_end - heap_size, proc.mmu.heap_reserve_end);
+			}
+
+			/* Map a stack and set the stack pointer */
+			map_stack();
+			proc.pc = elf.ehdr.e_entry;
+		}
+
+		/* Step a guest thread until it stops, a memory fault in the interpreter ends the process */
+		static void step_thread(P &thread)
+		{
+			sigjmp_buf jmp;
+			int sig = sigsetjmp(jmp, 0);
+			if (sig) {
+				abi_fault.step_jmp = nullptr;
+				thread.mmu.threads->fault(sig);
+				return;
+			}
+			abi_fault.step_jmp = &jmp;
+			while (thread.step(1024));
+			abi_fault.step_jmp = nullptr;
+		}
+
+		/* Guest threads created by clone run on their own host threads */
+		void start_threads()
+		{
+			proxy_thread_group *threads = proc.mmu.threads.get();
+			threads->spawn = [threads](void *parent_proc, uintptr_t stack, uintptr_t tls,
+				long tid, uintptr_t clear_child_tid) -> long
+			{
+				P &parent = *static_cast<P*>(static_cast<typename P::proxy_type*>(parent_proc));
+				P *child = new P();
+				child->flags = parent.flags;
+				child->log_flags = parent.log_flags;
+				child->hart_id = threads->threads;
+				for (size_t i = 0; i < P::ireg_count; i++) child->ireg[i] = parent.ireg[i];
+				for (size_t i = 0; i < P::freg_count; i++) child->freg[i] = parent.freg[i];
+				child->fcsr = parent.fcsr;
+				child->pc = parent.pc + 4; /* resume after the ecall */
+				child->ireg[riscv_ireg_a0] = 0;
+				if (stack) child->ireg[riscv_ireg_sp] = stack;
+				if (tls) child->ireg[riscv_ireg_tp] = tls;
+				child->tid = tid;
+				child->clear_child_tid = clear_child_tid;
+				child->mmu.attach_thread(parent.mmu);
+				threads->threads++;
+				std::thread([child] {
+					std::shared_ptr<proxy_thread_group> group = child->mmu.threads;
+					group->host_thread_start();
+					step_thread(*child);
+					group->host_thread_stop();
+					int code = child->exit_code;
+					group->instret += child->instret;
+					delete child;
+					group->thread_exited(code);
+				}).detach();
+				return tid;
+			};
+		}
+
+		/* Step the main thread until it halts, the process exits or all threads exit */
+		int run()
+		{
+			proxy_thread_group &group = *proc.mmu.threads;
+			group.host_thread_start();
+			step_thread(proc);
+			group.host_thread_stop();
+
+			/* The main thread exited before other guest threads */
+			if (proc.thread_exit && !group.exiting) {
+				group.thread_exited(proc.exit_code);
+				group.wait_threads();
+			}
+			return group.exit_code;
+		}
+
+		/* Copy the initial stack image and point sp at argc */
+		void setup_stack(const proxy_stack_image &image, std::vector<u8> &buf,
+			const std::vector<std::string> &args, const u8 *random)
+		{
+			uintptr_t sp = image.build(buf, args, random);
+			if (buf.size() > stack_size - page_size) {
+				panic("setup_stack: %zu byte stack image exceeds the stack", buf.size());
+			}
+			memcpy((void*)proc.mmu.host_addr(sp), buf.data(), buf.size());
+			proc.ireg[riscv_ireg_sp] = sp;
+		}
+
+		/* Stop before the first read from stdin, after a snapshot ecall or on a jump to pc */
+		void set_snapshot(abi_snapshot_marker marker, uintptr_t pc = ~uintptr_t(0))
+		{
+			proc.snapshot_marker = marker;
+			proc.snapshot_pc = pc;
+		}
+
+		/* Step the main thread to the snapshot marker, false if the guest stopped first */
+		bool run_to_snapshot()
+		{
+			while (proc.step(1024));
+			if (proc.thread_exit || uintptr_t(proc.pc) != proc.snapshot_pc) return false;
+
+			/* the read has not been executed yet, each fork repeats it */
+			if (proc.snapshot_marker == abi_snapshot_stdin) proc.pc -= 4;
+			set_snapshot(abi_snapshot_none);
+			return true;
+		}
+
+		/* Wait for the other guest threads to stop after exit_group */
+		void join_threads()
+		{
+			proxy_thread_group &group = *proc.mmu.threads;
+			if (group.exiting) group.wait_threads(1);
+		}
+
+		/* instructions retired by the main thread and all exited threads */
+		u64 instret()
+		{
+			return proc.instret + proc.mmu.threads->instret;
+		}
+
+		/* Unmap memory segments */
+		void unmap()
+		{
+			for (auto &seg: proc.mmu.segments) {
+				munmap(seg.first, seg.second);
+			}
+			proc.mmu.segments.clear();
+		}
+	};
+
+}
+
+#endif
@@ -7,211 +7,1246 @@
 
 namespace riscv {
 
+	/*
+	 * Guest threads created by clone share the host address space. Each
+	 * guest thread is a processor stepped on its own host thread, created
+	 * by the spawn callback installed by the emulator, which knows the
+	 * concrete processor type. Futexes on guest memory are host futexes.
+	 *
+	 * exit_group sets exiting, which each thread sees at its next event
+	 * check. Threads blocked in a host syscall are woken with SIGURG, whose
+	 * empty handler makes the syscall fail with EINTR, and the ecall then
+	 * returns to the step loop, which stops. The signal is repeated while
+	 * waiting in case it arrived just before a thread blocked.
+	 */
+
+	struct proxy_thread_group
+	{
+		typedef std::function<long(void *parent, uintptr_t stack, uintptr_t tls,
+			long tid, uintptr_t clear_child_tid)> spawn_fn;
+
+		std::mutex lock;              /* guards brk and the memory map */
+		std::mutex exit_lock;
+		std::condition_variable exit_cond;
+		std::atomic<size_t> threads;  /* live guest threads */
+		std::atomic<long> next_tid;
+		std::atomic<int> exit_code;   /* exit_group code, or of the last thread to exit */
+		std::atomic<bool> exiting;    /* exit_group was called, all threads stop */
+		std::atomic<u64> instret;     /* instructions retired by exited threads */
+		std::atomic<int> fault_signal; /* signal of a guest memory fault that ended the process */
+		std::vector<pthread_t> host_threads; /* stepping guest threads, guarded by exit_lock */
+		spawn_fn spawn;
+
+		enum : int { interrupt_signal = SIGURG };
+		enum : u64 { interrupt_retry_ms = 10 };
+
+		proxy_thread_group() : threads(1), next_tid(getpid() + 1), exit_code(0), exiting(false), instret(0), fault_signal(0)
+		{
+			static std::once_flag once;
+			std::call_once(once, [] {
+				struct sigaction sa;
+				memset(&sa, 0, sizeof(sa));
+				sa.sa_handler = [](int) {};   /* no SA_RESTART, blocked syscalls fail with EINTR */
+				sigaction(interrupt_signal, &sa, nullptr);
+			});
+		}
+
+		/* called by each host thread before and after it steps a guest thread */
+		void host_thread_start()
+		{
+			std::unique_lock<std::mutex> guard(exit_lock);
+			host_threads.push_back(pthread_self());
+		}
+
+		void host_thread_stop()
+		{
+			std::unique_lock<std::mutex> guard(exit_lock);
+			pthread_t self = pthread_self();
+			for (auto hi = host_threads.begin(); hi != host_threads.end(); hi++) {
+				if (pthread_equal(*hi, self)) {
+					host_threads.erase(hi);
+					break;
+				}
+			}
+		}
+
+		/* wake other host threads blocked in syscalls, called with exit_lock held */
+		void interrupt_threads()
+		{
+			pthread_t self = pthread_self();
+			for (auto &thread : host_threads) {
+				if (!pthread_equal(thread, self)) pthread_kill(thread, interrupt_signal);
+			}
+		}
+
+		/* called by a guest thread that has exited */
+		void thread_exited(int code)
+		{
+			std::unique_lock<std::mutex> guard(exit_lock);
+			if (!exiting) exit_code = code;
+			threads--;
+			exit_cond.notify_all();
+		}
+
+		/* called by exit_group, threads see exiting at their next event check */
+		void exit_group(int code)
+		{
+			std::unique_lock<std::mutex> guard(exit_lock);
+			if (!exiting) exit_code = code;
+			exiting = true;
+			interrupt_threads();
+		}
+
+		/* called by a guest thread whose step loop took a memory fault */
+		void fault(int sig)
+		{
+			int expected = 0;
+			fault_signal.compare_exchange_strong(expected, sig);
+			exit_group(128 + sig);
+		}
+
+		/* called by the main thread to wait until at most remaining threads are left */
+		void wait_threads(size_t remaining = 0)
+		{
+			std::unique_lock<std::mutex> guard(exit_lock);
+			while (!exit_cond.wait_for(guard, std::chrono::milliseconds(interrupt_retry_ms),
+				[&]{ return threads <= remaining; }))
+			{
+				if (exiting) interrupt_threads();
+			}
+		}
+	};
+
+	/*
+	 * Coalescing output buffer for guest writes to stdout, stderr and
+	 * regular files. Consecutive writes to the same fd are appended to one
+	 * pending buffer. It is flushed when it exceeds flush_threshold, on a
+	 * write to a different fd (so stdout and stderr sharing a terminal keep
+	 * their interleaving), before any other syscall on the same fd, on
+	 * fsync, close and exit, and before every read from a tty. A host
+	 * write error on a delayed flush cannot be returned to the guest.
+	 */
+
+	struct proxy_output
+	{
+		enum : size_t { flush_threshold = 65536 };
+
+		struct fd_info
+		{
+			bool buffered;
+			bool tty;
+		};
+
+		std::mutex lock;
+		bool enabled;
+		std::map<int,fd_info> fds;
+		int pending_fd;
+		std::vector<char> pending;
+
+		u64 guest_writes;             /* statistics */
+		u64 host_writes;
+		u64 bytes;
+
+		proxy_output() : enabled(false), pending_fd(-1), guest_writes(0), host_writes(0), bytes(0) {}
+
+		fd_info& info(int fd)
+		{
+			auto fi = fds.find(fd);
+			if (fi != fds.end()) return fi->second;
+			fd_info &fdi = fds[fd];
+			struct stat st;
+			bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+			fdi.tty = isatty(fd);
+			fdi.buffered = fd == 1 || fd == 2 || regular;
+			return fdi;
+		}
+
+		void flush()
+		{
+			for (size_t off = 0; off < pending.size(); ) {
+				ssize_t ret = ::write(pending_fd, pending.data() + off, pending.size() - off);
+				host_writes++;
+				if (ret <= 0) break;
+				off += ret;
+			}
+			pending.clear();
+		}
+
+		ssize_t write(int fd, const void *data, size_t len)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			guest_writes++;
+			bytes += len;
+			if (fd != pending_fd) flush();
+			if (!enabled || !info(fd).buffered) {
+				host_writes++;
+				return ::write(fd, data, len);
+			}
+			size_t off = pending.size();
+			pending.resize(off + len);
+			if (!abi_copy_guest(pending.data() + off, data, len)) {
+				pending.resize(off);
+				errno = EFAULT;
+				return -1;
+			}
+			pending_fd = fd;
+			if (pending.size() >= flush_threshold) flush();
+			return len;
+		}
+
+		/* called before any other syscall on fd, close forgets the fd */
+		void sync(int fd, bool close = false)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (fd == pending_fd) flush();
+			if (close) {
+				fds.erase(fd);
+				if (fd == pending_fd) pending_fd = -1;
+			}
+		}
+
+		/* called before a read, reads from a tty may be prompted by output on any fd */
+		void before_read(int fd)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (pending.size() > 0 && (fd == pending_fd || info(fd).tty)) flush();
+		}
+
+		void flush_all()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			flush();
+		}
+	};
+
+	/*
+	 * Per-syscall call counts and host cycles, shared by all guest threads.
+	 * Syscalls are dispatched through abi_syscall_table, generated from
+	 * meta/syscalls together with the argument marshalling stubs.
+	 */
+
+	struct proxy_syscall_stats
+	{
+		std::atomic<u64> calls[abi_syscall_limit];
+		std::atomic<u64> cycles[abi_syscall_limit];
+
+		proxy_syscall_stats() : calls(), cycles() {}
+
+		void record(size_t n, u64 elapsed)
+		{
+			calls[n].fetch_add(1, std::memory_order_relaxed);
+			cycles[n].fetch_add(elapsed, std::memory_order_relaxed);
+		}
+	};
+
+	template <typename P> struct abi_syscall_table
+	{
+		typedef void (*handler)(P &proc);
+		static const handler handlers[abi_syscall_limit];
+		static const char* const names[abi_syscall_limit];
+	};
+
+	/* guest buffer passed through to the host, converts to any host pointer type */
+	struct abi_buffer
+	{
+		uintptr_t va;
+		abi_buffer(uintptr_t va) : va(va) {}
+		template <typename T> operator T*() const { return (T*)va; }
+	};
+
+	/*
+	 * The brk heap is a PROT_NONE reservation placed after the highest load
+	 * segment. Growing the heap makes whole commit_size chunks read-write,
+	 * so most brk calls only move heap_end. Shrinking releases the pages
+	 * above the new break with MADV_DONTNEED so they read as zero if the
+	 * heap grows again, as they would on Linux.
+	 *
+	 * Without a sandbox guest addresses are host addresses. With a sandbox
+	 * the guest address space is a PROT_NONE reservation of 2^bits bytes
+	 * followed by a guard region, and guest address va is host address
+	 * base + (va & mask), so no access can reach emulator memory and
+	 * loads and stores need no bounds checks. Mappings are made inside the
+	 * reservation with MAP_FIXED and unmapping restores PROT_NONE. Buffers
+	 * passed to the host are checked against the end of the sandbox.
+	 *
+	 * In a sandbox and in 32-bit guests, mmap without a usable hint picks
+	 * the lowest free range of the mmap areas, which lie above the stack in
+	 * a sandbox and on either side of the stack in a 32-bit guest. Every
+	 * mapping is removed from the free ranges and munmap returns its pages,
+	 * so freed holes are reused.
+	 */
+
 	struct mmu_proxy
 	{
+		enum : size_t {
+			heap_reserve_size = 1ULL << 30, /* address space reserved for brk */
+			heap_commit_size = 1 << 20,     /* granularity of heap commits */
+			sandbox_guard_size = 1 << 16    /* guard region after the sandbox */
+		};
+
 		std::vector<std::pair<void*,size_t>> segments;
 		uintptr_t heap_begin;
 		uintptr_t heap_end;
+		uintptr_t heap_commit_end;    /* end of the read-write part of the heap reservation */
+		uintptr_t heap_reserve_end;   /* end of the heap reservation */
+		std::vector<std::pair<uintptr_t,uintptr_t>> mmap_areas; /* [begin, end) ranges mmap allocates from */
+		std::map<uintptr_t,uintptr_t> mmap_free; /* free ranges in the mmap areas, begin to end */
+		uintptr_t base;               /* host address of guest address zero */
+		uintptr_t mask;               /* guest address mask, all ones without a sandbox */
+		size_t sandbox_size;          /* size of the sandbox, zero without a sandbox */
+		mmu_proxy *process;           /* mmu of the main thread, which owns the memory map */
+		std::shared_ptr<proxy_thread_group> threads;
+		std::shared_ptr<proxy_output> output;
+		std::shared_ptr<proxy_clock> clock;
+		std::shared_ptr<proxy_syscall_stats> syscalls;
+		std::shared_ptr<proxy_syscall_trace> trace;
+		std::shared_ptr<proxy_syscall_trace::ring_type> trace_ring; /* this thread's records, null if not tracing */
+
+		mmu_proxy() : segments(), heap_begin(0), heap_end(0), heap_commit_end(0), heap_reserve_end(0),
+			base(0), mask(~uintptr_t(0)), sandbox_size(0),
+			process(nullptr), threads(std::make_shared<proxy_thread_group>()),
+			output(std::make_shared<proxy_output>()), clock(std::make_shared<proxy_clock>()),
+			syscalls(std::make_shared<proxy_syscall_stats>()) {}
+
+		/* join the process of the parent thread */
+		void attach_thread(mmu_proxy &parent)
+		{
+			process = &parent.process_mmu();
+			base = parent.base;
+			mask = parent.mask;
+			sandbox_size = parent.sandbox_size;
+			threads = parent.threads;
+			output = parent.output;
+			clock = parent.clock;
+			syscalls = parent.syscalls;
+			trace = parent.trace;
+			if (trace) trace_ring = trace->add_ring();
+		}
+
+		mmu_proxy& process_mmu() { return process ? *process : *this; }
+
+		/* reserve 2^bits bytes of guest address space and a guard region, mmap allocates from mmap_begin */
+		bool reserve_sandbox(size_t bits, uintptr_t mmap_begin)
+		{
+			size_t size = size_t(1) << bits;
+			void *addr = mmap(nullptr, size + sandbox_guard_size, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (addr == MAP_FAILED) return false;
+			segments.push_back(std::pair<void*,size_t>(addr, size + sandbox_guard_size));
+			base = uintptr_t(addr);
+			mask = size - 1;
+			sandbox_size = size;
+			add_mmap_area(mmap_begin, size);
+			return true;
+		}
+
+		/* add [begin, end) to the address space used by mmap without a hint */
+		void add_mmap_area(uintptr_t begin, uintptr_t end)
+		{
+			if (begin >= end) return;
+			mmap_areas.push_back(std::pair<uintptr_t,uintptr_t>(begin, end));
+			mmap_release(begin, end);
+		}
+
+		/* lowest free address with len bytes free, zero if none */
+		uintptr_t mmap_alloc(size_t len)
+		{
+			for (auto &range : mmap_free) {
+				if (range.second - range.first >= len) return range.first;
+			}
+			return 0;
+		}
 
-		mmu_proxy() : segments(), heap_begin(0), heap_end(0) {}
-	};
-
-	enum abi_syscall
-	{
-		abi_syscall_close = 57,
-		abi_syscall_lseek = 62,
-		abi_syscall_read = 63,
-		abi_syscall_write = 64,
-		abi_syscall_pread = 67,
-		abi_syscall_pwrite = 68,
-		abi_syscall_fstat = 80,
-		abi_syscall_exit = 93,
-		abi_syscall_gettimeofday = 169,
-		abi_syscall_brk = 214,
-	};
-
-	template <typename P> struct abi_timeval {
-		typename P::long_t tv_sec;
-		typename P::long_t tv_usec;
-	};
-
-	template <typename P> struct abi_timezone {
-		typename P::int_t tz_minuteswest;
-		typename P::int_t tz_dsttime;
-	};
-
-	template <typename P> struct abi_stat
-	{
-		typename P::ulong_t dev;
-		typename P::ulong_t ino;
-		typename P::uint_t  mode;
-		typename P::uint_t  nlink;
-		typename P::uint_t  uid;
-		typename P::uint_t  gid;
-		typename P::ulong_t rdev;
-		typename P::ulong_t __pad1;
-		typename P::long_t  size;
-		typename P::int_t   blksize;
-		typename P::int_t   __pad2;
-		typename P::long_t  blocks;
-		typename P::long_t  atime;
-		typename P::ulong_t atime_nsec;
-		typename P::long_t  mtime;
-		typename P::ulong_t mtime_nsec;
-		typename P::long_t  ctime;
-		typename P::ulong_t ctime_nsec;
-		typename P::uint_t  __unused4;
-		typename P::uint_t  __unused5;
-	};
-
-	template <typename P>
-	void cvt_abi_stat(abi_stat<P> *guest_stat, struct stat *host_stat)
-	{
-		guest_stat->dev        = host_stat->st_dev;
-		guest_stat->ino        = host_stat->st_ino;
-		guest_stat->mode       = host_stat->st_mode;
-		guest_stat->nlink      = host_stat->st_nlink;
-		guest_stat->uid        = host_stat->st_uid;
-		guest_stat->gid        = host_stat->st_gid;
-		guest_stat->rdev       = host_stat->st_rdev;
-		guest_stat->size       = host_stat->st_size;
-		guest_stat->blocks     = host_stat->st_blocks;
-		guest_stat->blksize    = host_stat->st_blksize;
+		/* remove [begin, end) from the free ranges, splitting ranges that partially overlap */
+		void mmap_reserve(uintptr_t begin, uintptr_t end)
+		{
+			auto fi = mmap_free.upper_bound(begin);
+			if (fi != mmap_free.begin()) fi--;
+			while (fi != mmap_free.end() && fi->first < end) {
+				uintptr_t free_begin = fi->first, free_end = fi->second;
+				if (free_end <= begin) {
+					fi++;
+					continue;
+				}
+				fi = mmap_free.erase(fi);
+				if (free_begin < begin) mmap_free[free_begin] = begin;
+				if (free_end > end) mmap_free[end] = free_end;
+			}
+		}
+
+		/* return the parts of [begin, end) inside the mmap areas to the free ranges */
+		void mmap_release(uintptr_t begin, uintptr_t end)
+		{
+			for (auto &area : mmap_areas) {
+				uintptr_t b = std::max(begin, area.first), e = std::min(end, area.second);
+				if (b >= e) continue;
+				mmap_reserve(b, e);
+				auto next = mmap_free.find(e);
+				if (next != mmap_free.end()) {
+					e = next->second;
+					mmap_free.erase(next);
+				}
+				auto prev = mmap_free.lower_bound(b);
+				if (prev != mmap_free.begin() && (--prev)->second == b) {
+					prev->second = e;
+				} else {
+					mmap_free[b] = e;
+				}
+			}
+		}
+
+		/* host address of a guest address */
+		uintptr_t host_addr(uintptr_t va) { return base + (va & mask); }
+
+		/* guest address of a host address inside the sandbox */
+		uintptr_t guest_addr(uintptr_t addr) { return addr - base; }
+
+		/* true if len bytes from guest address va stay inside the sandbox */
+		bool in_sandbox(uintptr_t va, size_t len)
+		{
+			return !sandbox_size || (va <= mask && len <= sandbox_size - va);
+		}
+
+		/* host address of a guest buffer passed to the host, one leaving the sandbox points at the guard */
+		uintptr_t host_buffer(uintptr_t va, size_t len)
+		{
+			if (!va || !sandbox_size) return va;
+			return in_sandbox(va, len) ? base + va : base + sandbox_size;
+		}
+
+		/* track a host mapping to unmap at exit, the sandbox reservation covers its own mappings */
+		void add_segment(void *addr, size_t len)
+		{
+			if (!sandbox_size) segments.push_back(std::pair<void*,size_t>(addr, len));
+		}
+
+		/* reserve heap address space at heap_begin below limit, halving the size until it fits */
+		size_t reserve_heap(uintptr_t limit)
+		{
+			uintptr_t begin = round_up(heap_begin, page_size);
+			heap_commit_end = heap_reserve_end = begin;
+			if (limit <= begin) return 0;
+			if (sandbox_size) {
+				heap_reserve_end = begin + std::min(size_t(heap_reserve_size), size_t(limit - begin));
+				return heap_reserve_end - begin;
+			}
+			for (size_t size = std::min(size_t(heap_reserve_size), size_t(limit - begin));
+				size >= heap_commit_size; size >>= 1)
+			{
+				void *addr = mmap((void*)begin, size, PROT_NONE,
+					MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if (addr == MAP_FAILED) continue;
+				if (uintptr_t(addr) != begin) {
+					munmap(addr, size);
+					continue;
+				}
+				segments.push_back(std::pair<void*,size_t>(addr, size));
+				heap_reserve_end = begin + size;
+				return size;
+			}
+			return 0;
+		}
+
+		/* stop tracking [addr, addr + len), splitting segments that partially overlap */
+		void remove_segments(uintptr_t addr, size_t len)
+		{
+			uintptr_t end = addr + len;
+			std::vector<std::pair<void*,size_t>> remaining;
+			for (auto &seg : segments) {
+				uintptr_t seg_begin = uintptr_t(seg.first), seg_end = seg_begin + seg.second;
+				if (seg_end <= addr || seg_begin >= end) {
+					remaining.push_back(seg);
+					continue;
+				}
+				if (seg_begin < addr) {
+					remaining.push_back(std::pair<void*,size_t>(seg.first, addr - seg_begin));
+				}
+				if (seg_end > end) {
+					remaining.push_back(std::pair<void*,size_t>((void*)end, seg_end - end));
+				}
+			}
+			segments.swap(remaining);
+		}
+
+		/* accesses are relative to base, which is zero and mask all ones without a sandbox */
+
+		template <typename P> u64 fetch_inst(P &proc, uintptr_t pc, intptr_t &pc_offset)
+		{
+			return inst_fetch(host_addr(pc), &pc_offset);
+		}
+
+		template <typename P, typename T> bool load(P &proc, uintptr_t va, T &val)
+		{
+			val = *(T*)host_addr(va);
+			return true;
+		}
+
+		template <typename P, typename T> bool store(P &proc, uintptr_t va, T val)
+		{
+			T *ptr = (T*)host_addr(va);
+			*ptr = val;
+			reservation_invalidate(ptr);
+			return true;
+		}
+
+		/* host pointer for an atomic access, null if misaligned */
+		template <typename T, typename P> T* atomic_ref(P &proc, uintptr_t va)
+		{
+			return (va & (sizeof(T) - 1)) ? nullptr : (T*)host_addr(va);
+		}
+	};
+
+	enum abi_prot
+	{
+		abi_prot_read = 0x1,
+		abi_prot_write = 0x2,
+		abi_prot_exec = 0x4,
+	};
+
+	enum abi_map_flag
+	{
+		abi_map_shared = 0x01,
+		abi_map_private = 0x02,
+		abi_map_fixed = 0x10,
+		abi_map_anonymous = 0x20,
+		abi_map_noreserve = 0x4000,
+		abi_map_populate = 0x8000,
+	};
+
+	enum abi_madvise
+	{
+		abi_madv_normal = 0,
+		abi_madv_random = 1,
+		abi_madv_sequential = 2,
+		abi_madv_willneed = 3,
+		abi_madv_dontneed = 4,
+	};
+
+	enum abi_clock_id
+	{
+		abi_clock_realtime = 0,
+		abi_clock_monotonic = 1,
+		abi_clock_monotonic_raw = 4,
+		abi_clock_realtime_coarse = 5,
+		abi_clock_monotonic_coarse = 6,
+		abi_clock_boottime = 7,
+	};
+
+	enum abi_clone_flag
+	{
+		abi_clone_vm = 0x00000100,
+		abi_clone_thread = 0x00010000,
+		abi_clone_settls = 0x00080000,
+		abi_clone_parent_settid = 0x00100000,
+		abi_clone_child_cleartid = 0x00200000,
+		abi_clone_child_settid = 0x01000000,
+	};
+
+	/* fcntl commands whose argument is a guest pointer, F_*LK64 are the RV32 fcntl64 commands */
+	enum abi_fcntl_cmd
+	{
+		abi_f_getlk = 5,
+		abi_f_setlk = 6,
+		abi_f_setlkw = 7,
+		abi_f_getlk64 = 12,
+		abi_f_setlk64 = 13,
+		abi_f_setlkw64 = 14,
+		abi_f_setown_ex = 15,
+		abi_f_getown_ex = 16,
+		abi_f_ofd_getlk = 36,
+		abi_f_ofd_setlk = 37,
+		abi_f_ofd_setlkw = 38,
+	};
+
+	enum : size_t {
+		abi_flock_size = 32,          /* struct flock (RV64) and struct flock64 (RV32) */
+		abi_f_owner_ex_size = 8
+	};
+
+	/* terminal ioctls without a size in the command, all other commands encode their size */
+	enum abi_ioctl_cmd
+	{
+		abi_tcgets = 0x5401,
+		abi_tcsets = 0x5402,
+		abi_tcsetsw = 0x5403,
+		abi_tcsetsf = 0x5404,
+		abi_tcsbrk = 0x5409,
+		abi_tcxonc = 0x540a,
+		abi_tcflsh = 0x540b,
+		abi_tiocsctty = 0x540e,
+		abi_tiocgpgrp = 0x540f,
+		abi_tiocspgrp = 0x5410,
+		abi_tiocgwinsz = 0x5413,
+		abi_tiocswinsz = 0x5414,
+		abi_fionread = 0x541b,
+		abi_fionbio = 0x5421,
+		abi_fionclex = 0x5450,
+		abi_fioclex = 0x5451,
+	};
+
+	enum : size_t {
+		abi_termios_size = 36,        /* kernel struct termios */
+		abi_winsize_size = 8
+	};
+
+	enum abi_futex_op
+	{
+		abi_futex_wait = 0,
+		abi_futex_wake = 1,
+		abi_futex_wait_bitset = 9,
+		abi_futex_private_flag = 128,
+		abi_futex_clock_realtime = 256,
+		abi_futex_cmd_mask = ~(abi_futex_private_flag | abi_futex_clock_realtime)
+	};
+
+	/* fork server snapshot markers, the guest is stepped to the marker once and forked per request */
+	enum abi_snapshot_marker
+	{
+		abi_snapshot_none,
+		abi_snapshot_stdin,           /* before the first read from fd 0 */
+		abi_snapshot_ecall,           /* after an ecall with a7 = abi_syscall_snapshot */
+		abi_snapshot_symbol,          /* on a jump to a symbol address */
+	};
+
+	enum : size_t { abi_syscall_snapshot = 0x5f00 };
+
+	template <typename P> struct abi_iovec
+	{
+		typename P::ulong_t iov_base;
+		typename P::ulong_t iov_len;
+	};
+
+	enum : int { abi_iov_max = 1024 };
+
+	template <typename P> void abi_sys_write(P &proc)
+	{
+		uintptr_t buf = proc.ireg[riscv_ireg_a1];
+		size_t len = proc.ireg[riscv_ireg_a2];
+		if (!proc.mmu.in_sandbox(buf, len)) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		ssize_t ret = proc.mmu.output->write(proc.ireg[riscv_ireg_a0],
+			(void*)proc.mmu.host_buffer(buf, len), len);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	/* gather writes go through the output buffer one element at a time */
+	template <typename P> void abi_sys_writev(P &proc)
+	{
+		int fd = proc.ireg[riscv_ireg_a0];
+		uintptr_t iov_va = proc.ireg[riscv_ireg_a1];
+		int iovcnt = proc.ireg[riscv_ireg_a2];
+		if (iovcnt < 0 || iovcnt > abi_iov_max) {
+			proc.ireg[riscv_ireg_a0] = -EINVAL;
+			return;
+		}
+		if (!proc.mmu.in_sandbox(iov_va, iovcnt * sizeof(abi_iovec<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		abi_iovec<P> iov[abi_iov_max];
+		if (!abi_copy_guest(iov, (void*)proc.mmu.host_buffer(iov_va, iovcnt * sizeof(abi_iovec<P>)),
+			iovcnt * sizeof(abi_iovec<P>)))
+		{
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		ssize_t total = 0;
+		for (int i = 0; i < iovcnt; i++) {
+			if (iov[i].iov_len == 0) continue;
+			if (!proc.mmu.in_sandbox(iov[i].iov_base, iov[i].iov_len)) {
+				proc.ireg[riscv_ireg_a0] = total > 0 ? total : -EFAULT;
+				return;
+			}
+			ssize_t ret = proc.mmu.output->write(fd,
+				(void*)proc.mmu.host_buffer(iov[i].iov_base, iov[i].iov_len), iov[i].iov_len);
+			if (ret < 0) {
+				proc.ireg[riscv_ireg_a0] = total > 0 ? total : -errno;
+				return;
+			}
+			total += ret;
+			if (size_t(ret) < iov[i].iov_len) break;
+		}
+		proc.ireg[riscv_ireg_a0] = total;
+	}
+
+	template <typename P> void abi_sys_readv(P &proc)
+	{
+		int fd = proc.ireg[riscv_ireg_a0];
+		uintptr_t iov_va = proc.ireg[riscv_ireg_a1];
+		int iovcnt = proc.ireg[riscv_ireg_a2];
+		if (iovcnt < 0 || iovcnt > abi_iov_max) {
+			proc.ireg[riscv_ireg_a0] = -EINVAL;
+			return;
+		}
+		if (!proc.mmu.in_sandbox(iov_va, iovcnt * sizeof(abi_iovec<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		abi_iovec<P> iov[abi_iov_max];
+		if (!abi_copy_guest(iov, (void*)proc.mmu.host_buffer(iov_va, iovcnt * sizeof(abi_iovec<P>)),
+			iovcnt * sizeof(abi_iovec<P>)))
+		{
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		struct iovec host_iov[abi_iov_max];
+		for (int i = 0; i < iovcnt; i++) {
+			host_iov[i].iov_base = (void*)proc.mmu.host_buffer(iov[i].iov_base, iov[i].iov_len);
+			host_iov[i].iov_len = iov[i].iov_len;
+		}
+		proc.mmu.output->before_read(fd);
+		ssize_t ret = readv(fd, host_iov, iovcnt);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	/* translate the struct argument of lock and owner commands, other commands take scalars */
+	template <typename P> void abi_sys_fcntl(P &proc)
+	{
+		int fd = proc.ireg[riscv_ireg_a0].r.x.val;
+		int cmd = proc.ireg[riscv_ireg_a1].r.x.val;
+		uintptr_t arg = proc.ireg[riscv_ireg_a2].r.xu.val;
+		proc.mmu.output->sync(fd);
+		size_t size = 0;
+		switch (cmd) {
+			case abi_f_getlk64:   cmd = F_GETLK;  size = abi_flock_size; break;
+			case abi_f_setlk64:   cmd = F_SETLK;  size = abi_flock_size; break;
+			case abi_f_setlkw64:  cmd = F_SETLKW; size = abi_flock_size; break;
+			case abi_f_getlk:
+			case abi_f_setlk:
+			case abi_f_setlkw:
+			case abi_f_ofd_getlk:
+			case abi_f_ofd_setlk:
+			case abi_f_ofd_setlkw: size = abi_flock_size; break;
+			case abi_f_setown_ex:
+			case abi_f_getown_ex:  size = abi_f_owner_ex_size; break;
+			default: break;
+		}
+		if (size) arg = proc.mmu.host_buffer(arg, size);
+		long ret = fcntl(fd, cmd, arg);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	/* size of the guest buffer an ioctl command points to, 0 for scalar arguments, -1 if unknown */
+	static inline ssize_t abi_ioctl_arg_size(unsigned long cmd)
+	{
+		switch (cmd) {
+			case abi_tcgets:
+			case abi_tcsets:
+			case abi_tcsetsw:
+			case abi_tcsetsf:     return abi_termios_size;
+			case abi_tiocgwinsz:
+			case abi_tiocswinsz:  return abi_winsize_size;
+			case abi_tiocgpgrp:
+			case abi_tiocspgrp:
+			case abi_fionread:
+			case abi_fionbio:     return sizeof(s32);
+			case abi_tcsbrk:
+			case abi_tcxonc:
+			case abi_tcflsh:
+			case abi_tiocsctty:
+			case abi_fionclex:
+			case abi_fioclex:     return 0;
+			default: break;
+		}
+		/* _IOC encoding: dir in bits 30-31, size in bits 16-29 */
+		return (cmd >> 30) & 3 ? ssize_t((cmd >> 16) & 0x3fff) : -1;
+	}
+
+	/* translate pointer arguments of known and size encoded ioctls, unknown ones fail in a sandbox */
+	template <typename P> void abi_sys_ioctl(P &proc)
+	{
+		int fd = proc.ireg[riscv_ireg_a0].r.x.val;
+		unsigned long cmd = u32(proc.ireg[riscv_ireg_a1].r.xu.val);
+		uintptr_t arg = proc.ireg[riscv_ireg_a2].r.xu.val;
+		proc.mmu.output->sync(fd);
+		ssize_t size = abi_ioctl_arg_size(cmd);
+		if (size > 0) {
+			arg = proc.mmu.host_buffer(arg, size);
+		} else if (size < 0 && proc.mmu.sandbox_size) {
+			proc.ireg[riscv_ireg_a0] = -ENOTTY;
+			return;
+		}
+		long ret = ioctl(fd, cmd, arg);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	template <typename P> void abi_sys_fdatasync(P &proc)
+	{
+		proc.mmu.output->sync(proc.ireg[riscv_ireg_a0]);
 	#if defined (__APPLE__)
-		guest_stat->atime      = host_stat->st_atimespec.tv_sec;
-		guest_stat->atime_nsec = host_stat->st_atimespec.tv_nsec;
-		guest_stat->mtime      = host_stat->st_mtimespec.tv_sec;
-		guest_stat->mtime_nsec = host_stat->st_mtimespec.tv_nsec;
-		guest_stat->ctime      = host_stat->st_ctimespec.tv_sec;
-		guest_stat->ctime_nsec = host_stat->st_ctimespec.tv_nsec;
+		int ret = fsync(proc.ireg[riscv_ireg_a0]);
 	#else
-		guest_stat->atime      = host_stat->st_atim.tv_sec;
-		guest_stat->atime_nsec = host_stat->st_atim.tv_nsec;
-		guest_stat->mtime      = host_stat->st_mtim.tv_sec;
-		guest_stat->mtime_nsec = host_stat->st_mtim.tv_nsec;
-		guest_stat->ctime      = host_stat->st_ctim.tv_sec;
-		guest_stat->ctime_nsec = host_stat->st_ctim.tv_nsec;
+		int ret = fdatasync(proc.ireg[riscv_ireg_a0]);
 	#endif
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	}
+
+	/* flush buffered output and report write syscall counts */
+	template <typename P> void abi_flush_output(P &proc)
+	{
+		proxy_output &output = *proc.mmu.output;
+		output.flush_all();
+		if ((proc.flags & processor_flag_emulator_debug) && output.enabled) {
+			debug("output: guest_writes=%" PRIu64 " host_writes=%" PRIu64 " bytes=%" PRIu64,
+				output.guest_writes, output.host_writes, output.bytes);
+		}
+		proxy_clock &clock = *proc.mmu.clock;
+		if (proc.flags & processor_flag_emulator_debug) {
+			debug("clock: fast_reads=%" PRIu64 " host_reads=%" PRIu64 " resyncs=%" PRIu64,
+				u64(clock.fast_reads), u64(clock.host_reads), u64(clock.resyncs));
+		}
+		if (proc.mmu.trace) {
+			proc.mmu.trace->stop();
+			if (proc.mmu.trace->summary) {
+				proc.mmu.trace->print_summary(abi_syscall_table<P>::names, abi_syscall_limit);
+			}
+		}
+		proxy_syscall_stats &stats = *proc.mmu.syscalls;
+		if (proc.flags & processor_flag_emulator_debug) {
+			for (size_t n = 0; n < abi_syscall_limit; n++) {
+				u64 calls = stats.calls[n], cycles = stats.cycles[n];
+				if (calls == 0) continue;
+				const char *name = abi_syscall_table<P>::names[n];
+				debug("syscall: %-16s calls=%-10" PRIu64 " cycles/call=%" PRIu64,
+					name ? name : "unimplemented", calls, cycles / calls);
+			}
+		}
 	}
 
-	template <typename P> void abi_sys_close(P &proc)
+	/* stop every guest thread, the emulator flushes output and exits with code once they stop */
+	template <typename P> void abi_exit(P &proc, int code)
 	{
-		proc.ireg[riscv_ireg_a0] = close(proc.ireg[riscv_ireg_a0]);
+		proc.mmu.threads->exit_group(code);
+		proc.thread_exit = true;
+		proc.exit_code = code;
 	}
 
-	template <typename P> void abi_sys_lseek(P &proc)
+	/* clear the guest clear_child_tid word and wake one waiter, as the kernel does on thread exit */
+	template <typename P> void abi_clear_child_tid(P &proc)
 	{
-		proc.ireg[riscv_ireg_a0] = lseek(proc.ireg[riscv_ireg_a0],
-			proc.ireg[riscv_ireg_a1], proc.ireg[riscv_ireg_a2]);
+		if (!proc.clear_child_tid || !proc.mmu.in_sandbox(proc.clear_child_tid, sizeof(s32))) return;
+		s32 *tidptr = (s32*)proc.mmu.host_buffer(proc.clear_child_tid, sizeof(s32));
+		s32 zero = 0;
+		if (!abi_copy_guest(tidptr, &zero, sizeof(s32))) return;
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		reservation_invalidate(tidptr);
+	#if defined (__linux__)
+		syscall(SYS_futex, tidptr, abi_futex_wake, 1, nullptr, nullptr, 0);
+	#endif
 	}
 
-	template <typename P> void abi_sys_read(P &proc)
+	/* exit the calling thread, and the process if it is the last thread */
+	template <typename P> void abi_sys_exit(P &proc)
 	{
-		proc.ireg[riscv_ireg_a0] = read(proc.ireg[riscv_ireg_a0],
-			(void*)(uintptr_t)proc.ireg[riscv_ireg_a1], proc.ireg[riscv_ireg_a2]);
+		if (proc.mmu.threads->threads == 1) {
+			abi_exit(proc, proc.ireg[riscv_ireg_a0]);
+			return;
+		}
+		abi_clear_child_tid(proc);
+		proc.thread_exit = true;
+		proc.exit_code = int(proc.ireg[riscv_ireg_a0]);
 	}
 
-	template <typename P> void abi_sys_write(P &proc)
+	template <typename P> void abi_sys_exit_group(P &proc)
 	{
-		proc.ireg[riscv_ireg_a0] = write(proc.ireg[riscv_ireg_a0],
-			(void*)(uintptr_t)proc.ireg[riscv_ireg_a1], proc.ireg[riscv_ireg_a2]);
+		abi_exit(proc, proc.ireg[riscv_ireg_a0]);
 	}
 
-	template <typename P> void abi_sys_pread(P &proc)
+	template <typename P> void abi_sys_set_tid_address(P &proc)
 	{
-		proc.ireg[riscv_ireg_a0] = pread(proc.ireg[riscv_ireg_a0],
-			(void*)(uintptr_t)proc.ireg[riscv_ireg_a1], proc.ireg[riscv_ireg_a2],
-			proc.ireg[riscv_ireg_a3]);
+		proc.clear_child_tid = proc.ireg[riscv_ireg_a0];
+		proc.ireg[riscv_ireg_a0] = proc.tid;
 	}
 
-	template <typename P> void abi_sys_pwrite(P &proc)
+	template <typename P> void abi_sys_gettid(P &proc)
 	{
-		proc.ireg[riscv_ireg_a0] = pwrite(proc.ireg[riscv_ireg_a0],
-			(void*)(uintptr_t)proc.ireg[riscv_ireg_a1], proc.ireg[riscv_ireg_a2],
-			proc.ireg[riscv_ireg_a3]);
+		proc.ireg[riscv_ireg_a0] = proc.tid;
 	}
 
-	template <typename P> void abi_sys_fstat(P &proc)
+	template <typename P> void abi_sys_futex(P &proc)
 	{
-		struct stat host_stat;
-		memset(&host_stat, 0, sizeof(host_stat));
-		if ((proc.ireg[riscv_ireg_a0] = fstat(proc.ireg[riscv_ireg_a0], &host_stat)) == 0) {
-			abi_stat<P> *guest_stat = (abi_stat<P>*)(uintptr_t)proc.ireg[riscv_ireg_a1].r.xu.val;
-			cvt_abi_stat(guest_stat, &host_stat);
+	#if defined (__linux__)
+		int op = int(proc.ireg[riscv_ireg_a1]);
+		int cmd = op & abi_futex_cmd_mask;
+		uintptr_t arg = proc.ireg[riscv_ireg_a3];
+		struct timespec host_timeout, *timeout = (struct timespec*)arg;
+		if (cmd == abi_futex_wait || cmd == abi_futex_wait_bitset) {
+			if (!proc.mmu.in_sandbox(arg, sizeof(abi_timespec<P>)) ||
+				!abi_timespec_in<P>(proc.mmu.host_buffer(arg, sizeof(abi_timespec<P>)), host_timeout, timeout))
+			{
+				proc.ireg[riscv_ireg_a0] = -EFAULT;
+				return;
+			}
 		}
+		long ret = syscall(SYS_futex, (void*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a0], sizeof(s32)), op,
+			int(proc.ireg[riscv_ireg_a2]), timeout,
+			(void*)proc.mmu.host_buffer(proc.ireg[riscv_ireg_a4], sizeof(s32)), int(proc.ireg[riscv_ireg_a5]));
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;
+	#else
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	#endif
 	}
 
-	template <typename P> void abi_sys_exit(P &proc)
+	/* clone(flags, stack, parent_tid, tls, child_tid), only the thread flavour is supported */
+	template <typename P> void abi_sys_clone(P &proc)
 	{
-		exit(proc.ireg[riscv_ireg_a0]);
+		uintptr_t flags = proc.ireg[riscv_ireg_a0];
+		uintptr_t stack = proc.ireg[riscv_ireg_a1];
+		uintptr_t parent_tid = proc.ireg[riscv_ireg_a2];
+		uintptr_t tls = proc.ireg[riscv_ireg_a3];
+		uintptr_t child_tid = proc.ireg[riscv_ireg_a4];
+		proxy_thread_group &group = *proc.mmu.threads;
+		if ((flags & (abi_clone_vm | abi_clone_thread)) != (abi_clone_vm | abi_clone_thread) || !group.spawn) {
+			proc.ireg[riscv_ireg_a0] = -ENOSYS;
+			return;
+		}
+		if (((flags & abi_clone_parent_settid) && !proc.mmu.in_sandbox(parent_tid, sizeof(s32))) ||
+			((flags & abi_clone_child_settid) && !proc.mmu.in_sandbox(child_tid, sizeof(s32))))
+		{
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		long tid = group.next_tid++;
+		s32 guest_tid = s32(tid);
+		if (((flags & abi_clone_parent_settid) &&
+				!abi_copy_guest((void*)proc.mmu.host_buffer(parent_tid, sizeof(s32)), &guest_tid, sizeof(s32))) ||
+			((flags & abi_clone_child_settid) &&
+				!abi_copy_guest((void*)proc.mmu.host_buffer(child_tid, sizeof(s32)), &guest_tid, sizeof(s32))))
+		{
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = group.spawn(&proc, stack,
+			(flags & abi_clone_settls) ? tls : 0, tid,
+			(flags & abi_clone_child_cleartid) ? child_tid : 0);
+		if (proc.flags & processor_flag_emulator_debug) {
+			debug("clone: tid=%ld stack=0x%016" PRIxPTR " tls=0x%016" PRIxPTR, tid, stack, tls);
+		}
 	}
 
 	template <typename P> void abi_sys_gettimeofday(P &proc)
 	{
-		struct timeval host_tp;
-		struct timezone host_tzp;
-		memset(&host_tp, 0, sizeof(host_tp));
-		memset(&host_tzp, 0, sizeof(host_tzp));
-		if ((proc.ireg[riscv_ireg_a0] = gettimeofday(&host_tp, &host_tzp)) == 0) {
-			if (proc.ireg[riscv_ireg_a0].r.xu.val != 0) {
-				abi_timeval<P> *guest_tp = (abi_timeval<P>*)(uintptr_t)proc.ireg[riscv_ireg_a0].r.xu.val;
-				guest_tp->tv_sec = host_tp.tv_sec;
-				guest_tp->tv_usec = host_tp.tv_usec;
-			}
-			if (proc.ireg[riscv_ireg_a1].r.xu.val != 0) {
-				abi_timezone<P> *guest_tzp = (abi_timezone<P>*)(uintptr_t)proc.ireg[riscv_ireg_a1].r.xu.val;
-				guest_tzp->tz_minuteswest = host_tzp.tz_minuteswest;
-				guest_tzp->tz_dsttime = host_tzp.tz_dsttime;
+		uintptr_t tp = proc.ireg[riscv_ireg_a0], tzp = proc.ireg[riscv_ireg_a1];
+		if (!proc.mmu.in_sandbox(tp, sizeof(abi_timeval<P>)) || !proc.mmu.in_sandbox(tzp, sizeof(abi_timezone<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		u64 ns = proc.mmu.clock->now_ns(true, proc.instret);
+		abi_timeval<P> guest_tv;
+		guest_tv.tv_sec = ns / 1000000000ULL;
+		guest_tv.tv_usec = (ns % 1000000000ULL) / 1000;
+		abi_timezone<P> guest_tz;
+		guest_tz.tz_minuteswest = 0;
+		guest_tz.tz_dsttime = 0;
+		if ((tp != 0 && !abi_copy_guest((void*)proc.mmu.host_buffer(tp, sizeof(guest_tv)), &guest_tv, sizeof(guest_tv))) ||
+			(tzp != 0 && !abi_copy_guest((void*)proc.mmu.host_buffer(tzp, sizeof(guest_tz)), &guest_tz, sizeof(guest_tz))))
+		{
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = 0;
+	}
+
+	/* realtime and monotonic clocks come from the time service, others from the host */
+	template <typename P> void abi_sys_clock_gettime(P &proc)
+	{
+		uintptr_t ts = proc.ireg[riscv_ireg_a1];
+		if (!proc.mmu.in_sandbox(ts, sizeof(abi_timespec<P>))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		abi_timespec<P> *guest_ts = (abi_timespec<P>*)proc.mmu.host_buffer(ts, sizeof(abi_timespec<P>));
+		u64 ns;
+		switch (proc.ireg[riscv_ireg_a0]) {
+			case abi_clock_realtime:
+			case abi_clock_realtime_coarse:
+				ns = proc.mmu.clock->now_ns(true, proc.instret);
+				break;
+			case abi_clock_monotonic:
+			case abi_clock_monotonic_raw:
+			case abi_clock_monotonic_coarse:
+			case abi_clock_boottime:
+				ns = proc.mmu.clock->now_ns(false, proc.instret);
+				break;
+			default: {
+				struct timespec host_ts;
+				if (clock_gettime(clockid_t(proc.ireg[riscv_ireg_a0]), &host_ts) < 0) {
+					proc.ireg[riscv_ireg_a0] = -errno;
+					return;
+				}
+				ns = u64(host_ts.tv_sec) * 1000000000ULL + host_ts.tv_nsec;
+				break;
 			}
 		}
+		abi_timespec<P> ts_val;
+		ts_val.tv_sec = ns / 1000000000ULL;
+		ts_val.tv_nsec = ns % 1000000000ULL;
+		if (guest_ts && !abi_copy_guest(guest_ts, &ts_val, sizeof(ts_val))) {
+			proc.ireg[riscv_ireg_a0] = -EFAULT;
+			return;
+		}
+		proc.ireg[riscv_ireg_a0] = 0;
 	}
 
 	template <typename P> void abi_sys_brk(P &proc)
 	{
-		// calculate the new heap address rounded up to the nearest page
+		// the heap belongs to the main thread's mmu
+		mmu_proxy &mmu = proc.mmu.process_mmu();
+		std::lock_guard<std::mutex> guard(mmu.threads->lock);
+
+		// as on Linux, a query or a failed request returns the current break
 		uintptr_t new_addr = proc.ireg[riscv_ireg_a0];
-		uintptr_t curr_heap_end = round_up(proc.mmu.heap_end, page_size);
-		uintptr_t new_heap_end = round_up(new_addr, page_size);
+		if (new_addr < mmu.heap_begin || new_addr > mmu.heap_reserve_end) {
+			proc.ireg[riscv_ireg_a0] = mmu.heap_end;
+			return;
+		}
+
+		uintptr_t new_page_end = round_up(new_addr, page_size);
+		uintptr_t curr_page_end = round_up(mmu.heap_end, page_size);
+		if (new_page_end > mmu.heap_commit_end) {
+			// commit whole chunks of the reservation
+			uintptr_t commit_end = std::min(uintptr_t(round_up(new_page_end, mmu_proxy::heap_commit_size)),
+				mmu.heap_reserve_end);
+			if (mprotect((void*)mmu.host_addr(mmu.heap_commit_end), commit_end - mmu.heap_commit_end,
+				PROT_READ | PROT_WRITE) < 0)
+			{
+				debug("brk: error: mprotect: %s", strerror(errno));
+				proc.ireg[riscv_ireg_a0] = mmu.heap_end;
+				return;
+			}
+			if (proc.flags & processor_flag_emulator_debug) {
+				debug("brk: commit: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " +R+W",
+					mmu.heap_commit_end, commit_end);
+			}
+			mmu.heap_commit_end = commit_end;
+		} else if (new_page_end < curr_page_end) {
+			// released pages read as zero if the heap grows again
+			madvise((void*)mmu.host_addr(new_page_end), curr_page_end - new_page_end, MADV_DONTNEED);
+		}
+		mmu.heap_end = new_addr;
+		proc.ireg[riscv_ireg_a0] = new_addr;
+	}
+
+	static inline int abi_host_prot(uintptr_t prot)
+	{
+		return ((prot & abi_prot_read) ? PROT_READ : 0) |
+			((prot & abi_prot_write) ? PROT_WRITE : 0) |
+			((prot & abi_prot_exec) ? PROT_EXEC : 0);
+	}
 
-		// return if the heap is already big enough
-		if (proc.mmu.heap_end >= new_heap_end || new_heap_end == curr_heap_end) {
-			proc.ireg[riscv_ireg_a0] = new_addr;
+	static inline int abi_host_map_flags(uintptr_t flags)
+	{
+		return ((flags & abi_map_shared) ? MAP_SHARED : 0) |
+			((flags & abi_map_private) ? MAP_PRIVATE : 0) |
+			((flags & abi_map_fixed) ? MAP_FIXED : 0) |
+			((flags & abi_map_anonymous) ? MAP_ANONYMOUS : 0) |
+		#if defined (MAP_POPULATE)
+			((flags & abi_map_populate) ? MAP_POPULATE : 0) |
+		#endif
+			((flags & abi_map_noreserve) ? MAP_NORESERVE : 0);
+	}
+
+	/*
+	 * mmap(addr, len, prot, flags, fd, offset). File-backed mappings map the
+	 * host file directly into the guest range and loads from it are page
+	 * faults rather than copies. In a sandbox every mapping is MAP_FIXED
+	 * inside the reservation and mappings without MAP_FIXED are placed in
+	 * the lowest free range of the mmap area. On RV32 the syscall is mmap2,
+	 * with the file offset in 4096 byte units.
+	 */
+	template <typename P> void abi_sys_mmap(P &proc)
+	{
+		uintptr_t addr = proc.ireg[riscv_ireg_a0];
+		size_t len = proc.ireg[riscv_ireg_a1];
+		uintptr_t flags = proc.ireg[riscv_ireg_a3];
+		int fd = (flags & abi_map_anonymous) ? -1 : int(proc.ireg[riscv_ireg_a4]);
+		off_t offset = P::xlen == 32 ? off_t(u32(proc.ireg[riscv_ireg_a5])) * 4096 :
+			off_t(proc.ireg[riscv_ireg_a5]);
+		if (len == 0 || (addr & (page_size - 1)) || (offset & (page_size - 1)) ||
+			!(flags & (abi_map_shared | abi_map_private))) {
+			proc.ireg[riscv_ireg_a0] = -EINVAL;
 			return;
 		}
 
-		// map a new heap segment
-		void *addr = mmap((void*)curr_heap_end, new_heap_end - curr_heap_end,
-			PROT_READ | PROT_WRITE, MAP_FIXED | MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-		if (addr == MAP_FAILED) {
-			debug("brk: error: mmap: %s", strerror(errno));
+		mmu_proxy &mmu = proc.mmu.process_mmu();
+		std::lock_guard<std::mutex> guard(mmu.threads->lock);
+
+		int host_flags = abi_host_map_flags(flags);
+		size_t map_len = round_up(len, page_size);
+		// 32-bit guests need mappings below 4GiB so take hints from the free ranges
+		if ((mmu.sandbox_size && !(flags & abi_map_fixed)) || (P::xlen == 32 && !addr)) {
+			addr = mmu.mmap_alloc(map_len);
+			if (!addr) {
+				proc.ireg[riscv_ireg_a0] = -ENOMEM;
+				return;
+			}
+		}
+		if (mmu.sandbox_size) {
+			if (!mmu.in_sandbox(addr, map_len)) {
+				proc.ireg[riscv_ireg_a0] = -ENOMEM;
+				return;
+			}
+			host_flags |= MAP_FIXED;
+		}
+		void *host_addr = mmap((void*)mmu.host_addr(addr), len, abi_host_prot(proc.ireg[riscv_ireg_a2]),
+			host_flags, fd, offset);
+		if (host_addr == MAP_FAILED) {
+			proc.ireg[riscv_ireg_a0] = -errno;
+			return;
+		}
+		uintptr_t map_addr = mmu.guest_addr(uintptr_t(host_addr)), map_end = map_addr + map_len;
+		if (P::xlen == 32 && map_end > 0x100000000ULL) {
+			munmap(host_addr, len);
 			proc.ireg[riscv_ireg_a0] = -ENOMEM;
-		} else {
-			// keep track of the mapped segment and set the new heap_end
-			proc.mmu.segments.push_back(std::pair<void*,size_t>((void*)curr_heap_end, new_heap_end - curr_heap_end));
-			proc.mmu.heap_end = new_heap_end;
-			if (proc.flags & processor_flag_emulator_debug) {
-				debug("brk: mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " +R+W",
-					curr_heap_end, new_heap_end);
+			return;
+		}
+		mmu.mmap_reserve(map_addr, map_end);
+
+		// a fixed mapping replaces whatever was tracked in its range
+		if (!mmu.sandbox_size) mmu.remove_segments(map_addr, map_len);
+		mmu.add_segment(host_addr, map_len);
+		if (proc.flags & processor_flag_emulator_debug) {
+			debug("mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " fd=%d offset=0x%llx",
+				map_addr, map_end, fd, (unsigned long long)offset);
+		}
+		proc.ireg[riscv_ireg_a0] = map_addr;
+	}
+
+	template <typename P> void abi_sys_munmap(P &proc)
+	{
+		uintptr_t addr = proc.ireg[riscv_ireg_a0];
+		size_t len = proc.ireg[riscv_ireg_a1];
+		mmu_proxy &mmu = proc.mmu.process_mmu();
+		std::lock_guard<std::mutex> guard(mmu.threads->lock);
+		if ((addr & (page_size - 1)) || !mmu.in_sandbox(addr, round_up(len, page_size))) {
+			proc.ireg[riscv_ireg_a0] = -EINVAL;
+			return;
+		}
+
+		// unmapped sandbox pages go back to the PROT_NONE reservation
+		if (mmu.sandbox_size) {
+			void *host_addr = mmap((void*)mmu.host_addr(addr), len, PROT_NONE,
+				MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (host_addr == MAP_FAILED) {
+				proc.ireg[riscv_ireg_a0] = -errno;
+				return;
 			}
-			proc.ireg[riscv_ireg_a0] = new_addr;
+			mmu.mmap_release(addr, addr + round_up(len, page_size));
+			proc.ireg[riscv_ireg_a0] = 0;
+			return;
+		}
+		if (munmap((void*)addr, len) < 0) {
+			proc.ireg[riscv_ireg_a0] = -errno;
+			return;
 		}
+		mmu.remove_segments(addr, round_up(len, page_size));
+		mmu.mmap_release(addr, addr + round_up(len, page_size));
+		proc.ireg[riscv_ireg_a0] = 0;
 	}
 
-	template <typename P> void proxy_syscall(P &proc)
+	template <typename P> void abi_sys_mprotect(P &proc)
 	{
-		switch (proc.ireg[riscv_ireg_a7]) {
-			case abi_syscall_close:         abi_sys_close(proc); break;
-			case abi_syscall_lseek:         abi_sys_lseek(proc); break;
-			case abi_syscall_read:          abi_sys_read(proc);  break;
-			case abi_syscall_write:         abi_sys_write(proc); break;
-			case abi_syscall_pread:         abi_sys_pread(proc); break;
-			case abi_syscall_pwrite:        abi_sys_pwrite(proc); break;
-			case abi_syscall_fstat:         abi_sys_fstat(proc); break;
-			case abi_syscall_exit:          abi_sys_exit(proc); break;
-			case abi_syscall_gettimeofday:  abi_sys_gettimeofday(proc);break;
-			case abi_syscall_brk:           abi_sys_brk(proc); break;
-			default: panic("unknown syscall: %d", proc.ireg[riscv_ireg_a7]);
+		uintptr_t addr = proc.ireg[riscv_ireg_a0];
+		size_t len = proc.ireg[riscv_ireg_a1];
+		if (!proc.mmu.in_sandbox(addr, len)) {
+			proc.ireg[riscv_ireg_a0] = -ENOMEM;
+			return;
+		}
+		int ret = mprotect((void*)proc.mmu.host_addr(addr), len,
+			abi_host_prot(proc.ireg[riscv_ireg_a2]));
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : 0;
+	}
+
+	template <typename P> void abi_sys_madvise(P &proc)
+	{
+		int advice;
+		switch (proc.ireg[riscv_ireg_a2]) {
+			case abi_madv_normal:     advice = MADV_NORMAL; break;
+			case abi_madv_random:     advice = MADV_RANDOM; break;
+			case abi_madv_sequential: advice = MADV_SEQUENTIAL; break;
+			case abi_madv_willneed:   advice = MADV_WILLNEED; break;
+			case abi_madv_dontneed:   advice = MADV_DONTNEED; break;
+			default: proc.ireg[riscv_ireg_a0] = -EINVAL; return;
 		}
+		uintptr_t addr = proc.ireg[riscv_ireg_a0];
+		size_t len = proc.ireg[riscv_ireg_a1];
+		if (!proc.mmu.in_sandbox(addr, len)) {
+			proc.ireg[riscv_ireg_a0] = -ENOMEM;
+			return;
+		}
+		int ret = madvise((void*)proc.mmu.host_addr(addr), len, advice);
+		proc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : 0;
+	}
+
+	template <typename P> void abi_sys_unimplemented(P &proc)
+	{
+		if (proc.flags & processor_flag_emulator_debug) {
+			debug("unimplemented syscall: %d", int(proc.ireg[riscv_ireg_a7]));
+		}
+		proc.ireg[riscv_ireg_a0] = -ENOSYS;
+	}
+
+	template <typename P> void abi_sys_ignore(P &proc)
+	{
+		proc.ireg[riscv_ireg_a0] = 0;
+	}
+
+	/* dispatch a syscall and push its arguments, result and duration to the thread's trace ring */
+	template <typename P> void abi_trace_syscall(P &proc, size_t n)
+	{
+		abi_trace_record rec;
+		rec.tid = u32(proc.tid);
+		rec.number = u32(n);
+		for (size_t i = 0; i < 6; i++) rec.args[i] = proc.ireg[riscv_ireg_a0 + i].r.xu.val;
+		rec.start = cpu_cycle_clock();
+		if (n < abi_syscall_limit) {
+			abi_syscall_table<P>::handlers[n](proc);
+		} else {
+			abi_sys_unimplemented(proc);
+		}
+		rec.ticks = cpu_cycle_clock() - rec.start;
+		rec.ret = proc.ireg[riscv_ireg_a0].r.x.val;
+		if (n < abi_syscall_limit) proc.mmu.syscalls->record(n, rec.ticks);
+		if (!proc.mmu.trace_ring->push(rec)) proc.mmu.trace->dropped++;
+	}
+
+	/* stop check_events after an ecall marker, stdin markers are rewound to repeat the read */
+	template <typename P> bool abi_snapshot_syscall(P &proc, size_t n)
+	{
+		bool hit = proc.snapshot_marker == abi_snapshot_stdin ?
+			n == abi_syscall_read && proc.ireg[riscv_ireg_a0].r.xu.val == 0 :
+			proc.snapshot_marker == abi_snapshot_ecall && n == abi_syscall_snapshot;
+		if (hit) proc.snapshot_pc = uintptr_t(proc.pc + 4);
+		return hit;
+	}
+
+	template <typename P> void proxy_syscall_dispatch(P &proc)
+	{
+		size_t n = proc.ireg[riscv_ireg_a7].r.xu.val;
+		if (proc.snapshot_marker != abi_snapshot_none && abi_snapshot_syscall(proc, n)) {
+			return;
+		}
+		if (proc.mmu.trace_ring) {
+			abi_trace_syscall(proc, n);
+			return;
+		}
+		if (n >= abi_syscall_limit) {
+			abi_sys_unimplemented(proc);
+			return;
+		}
+		u64 start = cpu_cycle_clock();
+		abi_syscall_table<P>::handlers[n](proc);
+		proc.mmu.syscalls->record(n, cpu_cycle_clock() - start);
+	}
+
+	/* faults in handlers are not unwound to the step loop, see abi_fault_handler */
+	template <typename P> void proxy_syscall(P &proc)
+	{
+		abi_fault.in_syscall = true;
+		proxy_syscall_dispatch(proc);
+		abi_fault.in_syscall = false;
 	}
 
 }
@@ -0,0 +1,440 @@
+//
+//  riscv-batch-emulate.cc
+//
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cinttypes>
+#include <cstdarg>
+#include <cerrno>
+#include <cmath>
+#include <cfenv>
+#include <csetjmp>
+#include <csignal>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+
+#include "riscv-endian.h"
+#include "riscv-types.h"
+#include "riscv-bits.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-util.h"
+#include "riscv-host.h"
+#include "riscv-cmdline.h"
+#include "riscv-codec.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-elf-format.h"
+#include "riscv-strings.h"
+#include "riscv-disasm.h"
+#include "riscv-processor.h"
+#include "riscv-alu.h"
+#include "riscv-fpu.h"
+#include "riscv-pte.h"
+#include "riscv-pma.h"
+#include "riscv-atomic.h"
+#include "riscv-reservation.h"
+#include "riscv-memory.h"
+#include "riscv-cache.h"
+#include "riscv-coherence.h"
+#include "riscv-mmu.h"
+#include "riscv-interp.h"
+#include "riscv-ring.h"
+#include "riscv-abi-fault.h"
+#include "riscv-abi-types.h"
+#include "riscv-abi-clock.h"
+#include "riscv-abi-trace.h"
+#include "riscv-unknown-abi.h"
+#include "riscv-abi-syscalls.h"
+#include "riscv-proxy-process.h"
+#include "riscv-processor-model.h"
+
+using namespace riscv;
+
+/*
+ * Work stealing job pool. Jobs are dealt round-robin to per-worker
+ * queues. A worker takes jobs from the front of its own queue and, once
+ * it is empty, steals from the back of the other queues, so a worker
+ * held up by a long job does not hold up the jobs queued behind it.
+ */
+
+struct batch_pool
+{
+	struct worker_queue
+	{
+		std::mutex lock;
+		std::deque<size_t> jobs;
+	};
+
+	std::vector<std::unique_ptr<worker_queue>> queues;
+	std::atomic<u64> steals;
+
+	batch_pool(size_t workers, size_t jobs) : steals(0)
+	{
+		for (size_t w = 0; w < workers; w++) queues.emplace_back(new worker_queue());
+		for (size_t j = 0; j < jobs; j++) queues[j % workers]->jobs.push_back(j);
+	}
+
+	bool pop(size_t w, size_t &job)
+	{
+		worker_queue &q = *queues[w];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.jobs.empty()) return false;
+		job = q.jobs.front();
+		q.jobs.pop_front();
+		return true;
+	}
+
+	bool steal(size_t w, size_t &job)
+	{
+		for (size_t i = 1; i < queues.size(); i++) {
+			worker_queue &q = *queues[(w + i) % queues.size()];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if (q.jobs.empty()) continue;
+			job = q.jobs.back();
+			q.jobs.pop_back();
+			steals++;
+			return true;
+		}
+		return false;
+	}
+
+	/* no jobs are added once the workers start, so a worker finding every queue empty is done */
+	void run(std::function<void(size_t worker, size_t job)> fn)
+	{
+		std::vector<std::thread> workers;
+		for (size_t w = 0; w < queues.size(); w++) {
+			workers.emplace_back([this, w, fn] {
+				size_t job;
+				while (pop(w, job) || steal(w, job)) fn(w, job);
+			});
+		}
+		for (auto &worker : workers) worker.join();
+	}
+};
+
+static std::string json_string(std::string s)
+{
+	std::string out = "\"";
+	for (char c : s) {
+		switch (c) {
+			case '"':  out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if (u8(c) < 0x20) out += format_string("\\u%04x", u8(c));
+				else out += c;
+		}
+	}
+	return out + "\"";
+}
+
+
+/* RISC-V Batch Emulator */
+
+struct riscv_batch_emulator
+{
+	/*
+		Runs a list of proxy mode jobs concurrently on a pool of host
+		threads. Each job is a guest process in its own sandbox with its
+		own processor state and its own host fd table, with stdin from
+		/dev/null and stdout and stderr to files in the output directory.
+		One JSON line per job reports its exit status, retired
+		instructions and wall time.
+
+		Job files have one job per line, an ELF file followed by its
+		arguments. Blank lines and lines starting with # are ignored.
+	*/
+
+	struct batch_job
+	{
+		std::string filename;
+		std::vector<std::string> args;
+	};
+
+	/* ELF headers and the stack image template, shared by all jobs running the file */
+	struct batch_image
+	{
+		elf_file elf;
+		proxy_stack_image stack;
+	};
+
+	struct batch_result
+	{
+		const char *status;           /* exited, halted, fault or error */
+		int exit_code;
+		uint64_t instret;
+		uint64_t wall_ns;
+	};
+
+	std::vector<batch_job> jobs;
+	std::string jobs_filename;
+	std::string output_dir;
+	std::vector<uint32_t> entropy;
+	std::shared_ptr<proxy_clock> clock;
+	std::mutex image_lock;
+	std::map<std::string,std::shared_ptr<batch_image>> images;
+	std::vector<std::vector<u8>> stack_bufs;  /* per worker, reused by its jobs */
+	std::mutex output_lock;
+
+	bool emulator_debug = false;
+	bool buffer_output = false;
+	bool help_or_error = false;
+	size_t workers = std::max(1U, std::thread::hardware_concurrency());
+	proxy_clock_mode clock_mode = proxy_clock_tsc;
+
+	static bool decode_clock_mode(std::string mode, proxy_clock_mode &clock_mode)
+	{
+		if (strcasecmp(mode.c_str(), "host") == 0) clock_mode = proxy_clock_host;
+		else if (strcasecmp(mode.c_str(), "tsc") == 0) clock_mode = proxy_clock_tsc;
+		else if (strcasecmp(mode.c_str(), "instret") == 0) clock_mode = proxy_clock_instret;
+		else return false;
+		return true;
+	}
+
+	void parse_commandline(int argc, const char *argv[])
+	{
+		cmdline_option options[] =
+		{
+			{ "-j", "--threads", cmdline_arg_type_string,
+				"Number of host worker threads (default one per host cpu)",
+				[&](std::string s) { return (workers = strtoull(s.c_str(), nullptr, 10)) > 0; } },
+			{ "-o", "--output-dir", cmdline_arg_type_string,
+				"Write job stdout and stderr to <dir>/<job>.out and <dir>/<job>.err (default discard)",
+				[&](std::string s) { output_dir = s; return true; } },
+			{ "-b", "--buffer-output", cmdline_arg_type_none,
+				"Coalesce guest writes to stdout, stderr and regular files",
+				[&](std::string s) { return (buffer_output = true); } },
+			{ "-C", "--clock", cmdline_arg_type_string,
+				"Guest time source (HOST, TSC, INSTRET) (default TSC)",
+				[&](std::string s) { return decode_clock_mode(s, clock_mode); } },
+			{ "-s", "--seed", cmdline_arg_type_string,
+				"Random seed, combined with the job number",
+				[&](std::string s) { entropy.push_back(strtoull(s.c_str(), nullptr, 10)); return true; } },
+			{ "-d", "--emulator-debug", cmdline_arg_type_none,
+				"Emulator debug messages",
+				[&](std::string s) { return (emulator_debug = true); } },
+			{ "-h", "--help", cmdline_arg_type_none,
+				"Show help",
+				[&](std::string s) { return (help_or_error = true); } },
+			{ nullptr, nullptr, cmdline_arg_type_none,   nullptr, nullptr }
+		};
+
+		auto result = cmdline_option::process_options(options, argc, argv);
+		if (!result.second) {
+			help_or_error = true;
+		} else if (result.first.size() != 1) {
+			printf("%s: wrong number of arguments\n", argv[0]);
+			help_or_error = true;
+		}
+
+		if (help_or_error) {
+			printf("usage: %s [<options>] <job_file>\n", argv[0]);
+			cmdline_option::print_options(options);
+			exit(9);
+		}
+
+		jobs_filename = result.first[0];
+		read_jobs();
+	}
+
+	/* one job per line: <elf_file> [<arg> ...], "-" reads the list from stdin */
+	void read_jobs()
+	{
+		FILE *file = jobs_filename == "-" ? stdin : fopen(jobs_filename.c_str(), "r");
+		if (!file) {
+			panic("jobs: fopen: %s: %s", jobs_filename.c_str(), strerror(errno));
+		}
+		char buf[4096];
+		while (fgets(buf, sizeof(buf), file)) {
+			std::string line = replace(rtrim(buf), "\t", " ");
+			std::vector<std::string> comps = split(line, " ", false, false);
+			if (comps.size() == 0 || comps[0][0] == '#') continue;
+			jobs.push_back(batch_job{ comps[0], std::vector<std::string>(comps.begin() + 1, comps.end()) });
+		}
+		if (file != stdin) fclose(file);
+	}
+
+	/* ELF headers and the stack template are loaded once per distinct file and shared by its jobs */
+	std::shared_ptr<batch_image> load_image(std::string filename)
+	{
+		std::lock_guard<std::mutex> guard(image_lock);
+		auto ii = images.find(filename);
+		if (ii != images.end()) return ii->second;
+		std::shared_ptr<batch_image> image;
+		if (access(filename.c_str(), R_OK) == 0) {
+			image = std::make_shared<batch_image>();
+			image->elf.load(filename, true);
+			image->stack.init(image->elf, proxy_stack_top, environ);
+		}
+		return images[filename] = image;
+	}
+
+	/* give the calling thread its own fd table with the job's stdin, stdout and stderr */
+	bool redirect_stdio(size_t job)
+	{
+	#if defined (__linux__)
+		if (unshare(CLONE_FILES) < 0) return false;
+	#else
+		return false;
+	#endif
+		std::string out = output_dir.size() ? format_string("%s/%zu.out", output_dir.c_str(), job) : "/dev/null";
+		std::string err = output_dir.size() ? format_string("%s/%zu.err", output_dir.c_str(), job) : "/dev/null";
+		int fds[3] = {
+			open("/dev/null", O_RDONLY),
+			open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644),
+			open(err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)
+		};
+		bool ok = true;
+		for (int fd = 0; fd < 3; fd++) {
+			if (fds[fd] < 0 || dup2(fds[fd], fd) < 0) ok = false;
+			if (fds[fd] > 2) close(fds[fd]);
+		}
+		return ok;
+	}
+
+	/* seed integer registers and AT_RANDOM from the batch seed and the job number */
+	template <typename P>
+	void seed_registers(P &proc, size_t job, u8 *random)
+	{
+		std::vector<uint32_t> seed(entropy);
+		seed.push_back(uint32_t(job));
+		std::seed_seq seq(seed.begin(), seed.end());
+		std::mt19937 twister(seq);
+		std::uniform_int_distribution<typename P::ux> distribution(0, std::numeric_limits<typename P::ux>::max());
+		for (size_t i = riscv_ireg_x1; i < P::ireg_count; i++) {
+			proc.ireg[i].r.xu.val = distribution(twister);
+		}
+		for (size_t i = 0; i < proxy_stack_image::random_size; i++) {
+			random[i] = u8(twister());
+		}
+	}
+
+	/* Run one job in the calling thread with the given proxy processor template */
+	template <typename P>
+	void run_process(size_t job, batch_image &image, std::vector<u8> &stack_buf, batch_result &result)
+	{
+		feclearexcept(FE_ALL_EXCEPT);
+
+		std::unique_ptr<proxy_process<P>> process(new proxy_process<P>());
+		P &proc = process->proc;
+		proc.flags = emulator_debug ? processor_flag_emulator_debug : 0;
+		proc.mmu.output->enabled = buffer_output;
+		proc.mmu.clock = clock;
+		u8 random[proxy_stack_image::random_size];
+		seed_registers(proc, job, random);
+		process->load(image.elf, jobs[job].filename.c_str(), true);
+
+		/* the ELF file is argv[0], followed by the job arguments */
+		std::vector<std::string> args(1, jobs[job].filename);
+		args.insert(args.end(), jobs[job].args.begin(), jobs[job].args.end());
+		process->setup_stack(image.stack, stack_buf, args, random);
+		process->start_threads();
+
+		/* a guest memory fault on any thread of the job ends only the job */
+		result.exit_code = process->run() & 0xff; /* as seen by a host parent */
+		process->join_threads();
+		result.status = proc.mmu.threads->fault_signal ? "fault" :
+			proc.thread_exit ? "exited" : "halted";
+		abi_flush_output(proc);
+		result.instret = process->instret();
+		process->unmap();
+	}
+
+	void run_job(size_t job, size_t worker, batch_result &result)
+	{
+		std::shared_ptr<batch_image> image = load_image(jobs[job].filename);
+		if (!image || !redirect_stdio(job)) {
+			result.status = "error";
+			return;
+		}
+		switch (image->elf.ei_class) {
+			case ELFCLASS32: run_process<proxy_emulator_rv32imafdc>(job, *image, stack_bufs[worker], result); break;
+			case ELFCLASS64: run_process<proxy_emulator_rv64imafdc>(job, *image, stack_bufs[worker], result); break;
+			default: result.status = "error"; break;
+		}
+	}
+
+	void print_result(size_t job, size_t worker, batch_result &result)
+	{
+		std::string args;
+		for (auto &arg : jobs[job].args) {
+			args += (args.size() ? "," : "") + json_string(arg);
+		}
+		std::lock_guard<std::mutex> guard(output_lock);
+		printf("{\"job\":%zu,\"elf\":%s,\"args\":[%s],\"status\":\"%s\",\"exit_code\":%d,"
+			"\"instret\":%" PRIu64 ",\"wall_ms\":%.3f,\"worker\":%zu}\n",
+			job, json_string(jobs[job].filename).c_str(), args.c_str(), result.status,
+			result.exit_code, result.instret, result.wall_ns / 1e6, worker);
+		fflush(stdout);
+	}
+
+	void exec()
+	{
+		abi_install_fault_handler();
+
+		/* calibrate the guest time source once for all jobs */
+		clock = std::make_shared<proxy_clock>();
+		clock->start(clock_mode);
+
+		auto start = std::chrono::steady_clock::now();
+		batch_pool pool(std::min(workers, std::max(jobs.size(), size_t(1))), jobs.size());
+		stack_bufs.resize(pool.queues.size());
+		pool.run([&](size_t worker, size_t job) {
+			/* each job runs on a fresh thread so its fd table dies with it */
+			batch_result result = { "error", 0, 0, 0 };
+			auto job_start = std::chrono::steady_clock::now();
+			std::thread([&] { run_job(job, worker, result); }).join();
+			result.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - job_start).count();
+			print_result(job, worker, result);
+		});
+		if (emulator_debug) {
+			double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			debug("batch: jobs=%zu workers=%zu steals=%" PRIu64 " wall=%.3fs",
+				jobs.size(), pool.queues.size(), u64(pool.steals), secs);
+		}
+	}
+};
+
+
+/* program main */
+
+int main(int argc, const char *argv[])
+{
+	riscv_batch_emulator emulator;
+	emulator.parse_commandline(argc, argv);
+	emulator.exec();
+	return 0;
+}
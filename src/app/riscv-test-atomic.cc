@@ -0,0 +1,161 @@
+//
+//  riscv-test-atomic.cc
+//
+
+#undef NDEBUG
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cinttypes>
+#include <cassert>
+#include <cmath>
+#include <cfenv>
+#include <limits>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "riscv-endian.h"
+#include "riscv-types.h"
+#include "riscv-meta.h"
+#include "riscv-codec.h"
+#include "riscv-processor.h"
+#include "riscv-alu.h"
+#include "riscv-fpu.h"
+#include "riscv-atomic.h"
+#include "riscv-reservation.h"
+#include "riscv-interp.h"
+
+using namespace riscv;
+
+/* guest addresses are host addresses, as in proxy mode */
+struct test_mmu
+{
+	template <typename P, typename T> bool load(P &proc, uintptr_t va, T &val)
+	{
+		val = *(T*)va;
+		return true;
+	}
+
+	template <typename P, typename T> bool store(P &proc, uintptr_t va, T val)
+	{
+		*(T*)va = val;
+		reservation_invalidate((void*)va);
+		return true;
+	}
+
+	template <typename T, typename P> T* atomic_ref(P &proc, uintptr_t va)
+	{
+		return (va & (sizeof(T) - 1)) ? nullptr : (T*)va;
+	}
+};
+
+struct test_hart : processor_rv64imafd
+{
+	test_mmu mmu;
+};
+
+/* shared words, each on its own cache line */
+struct alignas(64) test_word { s64 val; char pad[56]; };
+
+enum { word_add_w, word_add_d, word_max_d, word_minu_w, word_or_d, word_xor_w, word_swap_d, word_lrsc_d, word_count };
+
+static test_word words[word_count];
+static std::atomic<s64> swapped_out;
+
+static const int num_threads = 8;
+static const int iterations = 100000;
+
+/* execute one AMO with rs1 = address, rs2 = value, returns rd */
+static s64 amo(test_hart &hart, int op, void *addr, s64 val, bool aq, bool rl)
+{
+	decode dec;
+	dec.op = op;
+	dec.rd = 10;
+	dec.rs1 = 11;
+	dec.rs2 = 12;
+	dec.aq = aq;
+	dec.rl = rl;
+	hart.ireg[11].r.x.val = uintptr_t(addr);
+	hart.ireg[12].r.x.val = val;
+	intptr_t pc_offset = exec_inst_rv64<true,true,true,true,false,false,false>(dec, hart, 4);
+	assert(pc_offset == 4);
+	return hart.ireg[10].r.x.val;
+}
+
+static void stress(int thread)
+{
+	test_hart hart;
+	s64 sum = 0;
+	for (int i = 0; i < iterations; i++) {
+		bool aq = i & 1, rl = (i >> 1) & 1;
+		amo(hart, riscv_op_amoadd_w, &words[word_add_w].val, 1, aq, rl);
+		amo(hart, riscv_op_amoadd_d, &words[word_add_d].val, 3, aq, rl);
+		amo(hart, riscv_op_amomax_d, &words[word_max_d].val, s64(thread) * iterations + i, aq, rl);
+		amo(hart, riscv_op_amominu_w, &words[word_minu_w].val, 1000000 + thread * iterations + i, aq, rl);
+		amo(hart, riscv_op_amoor_d, &words[word_or_d].val, 1LL << (thread * 4 + (i & 3)), aq, rl);
+		amo(hart, riscv_op_amoxor_w, &words[word_xor_w].val, 1 << thread, aq, rl);
+		sum += amo(hart, riscv_op_amoswap_d, &words[word_swap_d].val, s64(thread) * iterations + i + 1, aq, rl);
+		s64 val;
+		do {
+			val = amo(hart, riscv_op_lr_d, &words[word_lrsc_d].val, 0, aq, rl);
+		} while (amo(hart, riscv_op_sc_d, &words[word_lrsc_d].val, val + 1, aq, rl) != 0);
+	}
+	swapped_out += sum;
+}
+
+int main()
+{
+	/* single hart semantics */
+	test_hart hart;
+	s64 word = -5;
+	assert(amo(hart, riscv_op_amomin_d, &word, -7, false, false) == -5 && word == -7);
+	assert(amo(hart, riscv_op_amomaxu_d, &word, 1, false, false) == -7 && word == -7);
+	assert(amo(hart, riscv_op_amoand_d, &word, 0xff, true, true) == -7 && word == 0xf9);
+	s32 word32 = 0x7fffffff;
+	assert(amo(hart, riscv_op_amoadd_w, &word32, 1, false, true) == 0x7fffffff);
+	assert(word32 == std::numeric_limits<s32>::min());
+
+	/* SC succeeds once after LR, and fails after any store to the line, even of the same value */
+	alignas(64) s64 line[8] = { 0 };
+	assert(amo(hart, riscv_op_lr_d, &line[0], 0, false, false) == 0);
+	assert(amo(hart, riscv_op_sc_d, &line[0], 1, false, false) == 0 && line[0] == 1);
+	assert(amo(hart, riscv_op_sc_d, &line[0], 2, false, false) == 1 && line[0] == 1);
+	test_hart other;
+	assert(amo(hart, riscv_op_lr_d, &line[0], 0, false, false) == 1);
+	other.mmu.store(other, uintptr_t(&line[7]), s64(0));
+	assert(amo(hart, riscv_op_sc_d, &line[0], 2, false, false) == 1 && line[0] == 1);
+	assert(amo(hart, riscv_op_lr_d, &line[0], 0, false, false) == 1);
+	amo(other, riscv_op_amoor_d, &line[0], 1, false, false);
+	assert(amo(hart, riscv_op_sc_d, &line[0], 2, false, false) == 1 && line[0] == 1);
+
+	/* misaligned AMOs are not executed */
+	decode dec;
+	dec.op = riscv_op_amoadd_w;
+	dec.rs1 = 11;
+	hart.ireg[11].r.x.val = uintptr_t(&word32) + 1;
+	assert((exec_inst_rv64<true,true,true,true,false,false,false>(dec, hart, 4)) == 0);
+
+	/* concurrent AMOs from host threads */
+	memset(words, 0, sizeof(words));
+	words[word_minu_w].val = -1;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < num_threads; t++) threads.push_back(std::thread(stress, t));
+	for (auto &t : threads) t.join();
+
+	assert(s32(words[word_add_w].val) == num_threads * iterations);
+	assert(words[word_add_d].val == 3LL * num_threads * iterations);
+	assert(words[word_max_d].val == s64(num_threads - 1) * iterations + iterations - 1);
+	assert(u32(words[word_minu_w].val) == 1000000);
+	assert(words[word_or_d].val == (1LL << (num_threads * 4)) - 1);
+	assert(s32(words[word_xor_w].val) == ((iterations & 1) ? (1 << num_threads) - 1 : 0));
+
+	/* every value swapped in is swapped out exactly once, the last one remains */
+	s64 n = s64(num_threads) * iterations;
+	assert(words[word_lrsc_d].val == n);
+	assert(swapped_out + words[word_swap_d].val == n * (n + 1) / 2);
+
+	printf("atomic: %d threads x %d iterations: OK\n", num_threads, iterations);
+	return 0;
+}
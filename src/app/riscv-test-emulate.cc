@@ -10,20 +10,38 @@
 #include <cerrno>
 #include <cmath>
 #include <cfenv>
+#include <csetjmp>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <thread>
 #include <random>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <deque>
+#include <mutex>
+#include <condition_variable>
 #include <map>
+#include <chrono>
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <dirent.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
 
 #include "riscv-endian.h"
 #include "riscv-types.h"
@@ -33,6 +51,8 @@
 #include "riscv-util.h"
 #include "riscv-host.h"
 #include "riscv-cmdline.h"
+#include "riscv-config-parser.h"
+#include "riscv-config.h"
 #include "riscv-codec.h"
 #include "riscv-elf.h"
 #include "riscv-elf-file.h"
@@ -44,12 +64,27 @@
 #include "riscv-fpu.h"
 #include "riscv-pte.h"
 #include "riscv-pma.h"
+#include "riscv-atomic.h"
+#include "riscv-reservation.h"
 #include "riscv-memory.h"
 #include "riscv-cache.h"
+#include "riscv-coherence.h"
 #include "riscv-mmu.h"
 #include "riscv-interp.h"
 #include "riscv-machine.h"
+#include "riscv-clint.h"
+#include "riscv-ring.h"
+#include "riscv-uart.h"
+#include "riscv-virtio.h"
+#include "riscv-scheduler.h"
+#include "riscv-abi-fault.h"
+#include "riscv-abi-types.h"
+#include "riscv-abi-clock.h"
+#include "riscv-abi-trace.h"
 #include "riscv-unknown-abi.h"
+#include "riscv-abi-syscalls.h"
+#include "riscv-proxy-process.h"
+#include "riscv-processor-model.h"
 
 #if defined (ENABLE_GPERFTOOL)
 #include "gperftools/profiler.h"
@@ -57,304 +92,59 @@
 
 using namespace riscv;
 
-enum {
-	reg_log_int = 1,
-	reg_log_f32 = 2,
-	reg_log_f64 = 4,
-	reg_log_inst = 8,
-	reg_log_operands = 16,
-	reg_log_no_pseudo = 32,
-};
-
 /*
- * Processor base template
+ * Platform device without an emulation model. Reads return zero and writes
+ * are ignored so that probing guests do not fault.
  */
 
-template<typename T, typename P, typename M>
-struct processor_base : P
-{
-	typedef T decode_type;
-	typedef P processor_type;
-	typedef M mmu_type;
-
-	int log_flags;
-	mmu_type mmu;
-
-	processor_base() :
-		P(),
-		log_flags(0)
-	{}
-
-	std::string format_inst(uintptr_t pc)
-	{
-		char buf[20];
-		intptr_t pc_offset;
-		uint64_t inst = inst_fetch(pc, &pc_offset);
-		switch (pc_offset) {
-			case 2:  snprintf(buf, sizeof(buf), "    0x%04tx", inst); break;
-			case 4:  snprintf(buf, sizeof(buf), "0x%08tx", inst); break;
-			case 6:  snprintf(buf, sizeof(buf), "0x%012tx", inst); break;
-			case 8:  snprintf(buf, sizeof(buf), "0x%016tx", inst); break;
-			default: snprintf(buf, sizeof(buf), "(invalid)"); break;
-		}
-		return buf;
-	}
-
-	size_t regnum(T &dec, riscv_operand_name operand_name)
-	{
-		switch (operand_name) {
-			case riscv_operand_name_rd: return dec.rd;
-			case riscv_operand_name_rs1: return dec.rs1;
-			case riscv_operand_name_rs2: return dec.rs2;
-			case riscv_operand_name_frd: return dec.rd;
-			case riscv_operand_name_frs1: return dec.rs1;
-			case riscv_operand_name_frs2: return dec.rs2;
-			case riscv_operand_name_frs3: return dec.rs3;
-			default: return 0;
-		}
-	}
-
-	std::string format_operands(T &dec)
-	{
-		size_t reg;
-		char buf[256];
-		std::vector<std::string> ops;
-		const riscv_operand_data *operand_data = riscv_inst_operand_data[dec.op];
-		while (operand_data->type != riscv_type_none) {
-			std::string op;
-			switch (operand_data->type) {
-				case riscv_type_ireg:
-					reg = regnum(dec, operand_data->operand_name);
-					op += riscv_ireg_name_sym[reg];
-					op += "=";
-					snprintf(buf, sizeof(buf), riscv_type_primitives[operand_data->primitive].format,
-						P::ireg[reg].r.xu.val);
-					op += buf;
-					ops.push_back(op);
-					break;
-				case riscv_type_freg:
-					reg = regnum(dec, operand_data->operand_name);
-					op += riscv_freg_name_sym[reg];
-					op += "=";
-					// show hex value for +/-{inf|subnorm|nan}
-					if (operand_data->primitive == riscv_primitive_f64 ?
-						(f64_classify(P::freg[reg].r.d.val) & 0b1110100101) :
-						(f32_classify(P::freg[reg].r.s.val) & 0b1110100101))
-					{
-						snprintf(buf, sizeof(buf),
-							operand_data->primitive == riscv_primitive_f64 ?
-							"%.17g[0x%016llx]" : "%.9g[0x%08llx]",
-							operand_data->primitive == riscv_primitive_f64 ?
-							P::freg[reg].r.d.val : P::freg[reg].r.s.val,
-							operand_data->primitive == riscv_primitive_f64 ?
-							P::freg[reg].r.lu.val : P::freg[reg].r.wu.val);
-					} else {
-						snprintf(buf, sizeof(buf),
-							operand_data->primitive == riscv_primitive_f64 ?
-							"%.17g" : "%.9g",
-							operand_data->primitive == riscv_primitive_f64 ?
-							P::freg[reg].r.d.val : P::freg[reg].r.s.val);
-					}
-					op += buf;
-					ops.push_back(op);
-					break;
-				default: break;
-			}
-			operand_data++;
-		}
-
-        std::stringstream ss;
-        ss << "(";
-        for (auto i = ops.begin(); i != ops.end(); i++) {
-                ss << (i != ops.begin() ? ", " : "") << *i;
-        }
-        ss << ")";
-        return ss.str();
-	}
-
-	void print_log(T &dec)
-	{
-		static const char *fmt_32 = "core %3zu: 0x%08tx (%s) %-30s %s\n";
-		static const char *fmt_64 = "core %3zu: 0x%016tx (%s) %-30s %s\n";
-		static const char *fmt_128 = "core %3zu: 0x%032tx (%s) %-30s %s\n";
-		if (log_flags & reg_log_inst) {
-			std::string op_args;
-			if (!(log_flags & reg_log_no_pseudo)) decode_pseudo_inst(dec);
-			std::string args = disasm_inst_simple(dec);
-			if (log_flags & reg_log_operands) {
-				op_args = format_operands(dec);
-			}
-			printf(P::xlen == 32 ? fmt_32 : P::xlen == 64 ? fmt_64 : fmt_128,
-				P::hart_id, uintptr_t(P::pc), format_inst(P::pc).c_str(), args.c_str(), op_args.c_str());
-		}
-		if (log_flags & reg_log_int) print_int_registers();
-		if (log_flags & reg_log_f32) print_f32_registers();
-		if (log_flags & reg_log_f64) print_f64_registers();
-	}
-
-	void print_int_registers()
-	{
-		for (size_t i = riscv_ireg_x0; i < P::ireg_count; i++) {
-			char fmt[32];
-			snprintf(fmt, sizeof(fmt), "%%-4s: 0x%%0%u%sx%%s",
-				(P::xlen >> 2), P::xlen == 64 ? "ll" : "");
-			printf(fmt, riscv_ireg_name_sym[i],
-				P::ireg[i].r.xu.val, (i + 1) % 4 == 0 ? "\n" : " ");
-		}
-	}
-
-	void print_f32_registers()
-	{
-		for (size_t i = riscv_freg_f0; i < P::freg_count; i++) {
-			printf("%-4s: s %16.5f%s", riscv_freg_name_sym[i],
-				P::freg[i].r.s.val, (i + 1) % 4 == 0 ? "\n" : " ");
-		}
-	}
-
-	void print_f64_registers()
-	{
-		for (size_t i = riscv_freg_f0; i < P::freg_count; i++) {
-			printf("%-4s: d %16.5f%s", riscv_freg_name_sym[i],
-				P::freg[i].r.d.val, (i + 1) % 4 == 0 ? "\n" : " ");
-		}
-	}
-};
-
-
-/* Decode and Exec template parameters */
-
-#define RV_32  /*rv32*/true,  /*rv64*/false
-#define RV_64  /*rv32*/false, /*rv64*/true
-
-#define RV_IMA    /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/false,/*D*/false,/*C*/false
-#define RV_IMAC   /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/false,/*D*/false,/*C*/true
-#define RV_IMAFD  /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/true, /*D*/true, /*C*/false
-#define RV_IMAFDC /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/true, /*D*/true, /*C*/true
-
-
-/* RV32 Partial processor specialization templates (RV32IMA, RV32IMAC, RV32IMAFD, RV32IMAFDC) */
-
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv32ima_unit : B
-{
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_32,RV_IMA>(dec, inst);
-	}
-
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv32<RV_IMA>(dec, *this, pc_offset);
-	}
-};
-
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv32imac_unit : B
+template <typename UX>
+struct platform_stub_device : user_memory_device<UX>
 {
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_32,RV_IMAC>(dec, inst);
-		decompress_inst_rv32<T>(dec);
-	}
+	std::string name;
 
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv32<RV_IMAC>(dec, *this, pc_offset);
-	}
-};
-
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv32imafd_unit : B
-{
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_32,RV_IMAFD>(dec, inst);
-	}
+	platform_stub_device(std::string name) : name(name) {}
 
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv32<RV_IMAFD>(dec, *this, pc_offset);
-	}
+	bool load(UX offset, u64 &val, size_t size) { val = 0; return true; }
+	bool store(UX offset, u64 val, size_t size) { return true; }
 };
 
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv32imafdc_unit : B
-{
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_32,RV_IMAFDC>(dec, inst);
-		decompress_inst_rv32<T>(dec);
-	}
 
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv32<RV_IMAFDC>(dec, *this, pc_offset);
-	}
-};
-
-
-/* RV64 Partial processor specialization templates (RV64IMA, RV64IMAC, RV64IMAFD, RV64IMAFDC) */
-
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv64ima_unit : B
-{
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_64,RV_IMA>(dec, inst);
-	}
-
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv64<RV_IMA>(dec, *this, pc_offset);
-	}
-};
+/* Processor privileged ISA emulator with soft-mmu */
 
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv64imac_unit : B
+template <typename P>
+struct processor_privileged : P
 {
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_64,RV_IMAC>(dec, inst);
-		decompress_inst_rv64<T>(dec);
-	}
-
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv64<RV_IMAC>(dec, *this, pc_offset);
-	}
-};
+	typedef clint<typename P::ux, typename P::processor_type> clint_type;
 
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv64imafd_unit : B
-{
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_64,RV_IMAFD>(dec, inst);
-	}
+	enum csr_op { csr_rw, csr_rs, csr_rc };
 
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv64<RV_IMAFD>(dec, *this, pc_offset);
-	}
-};
+	clint_type *timer = nullptr;
 
-template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
-struct processor_rv64imafdc_unit : B
-{
-	void inst_decode(T &dec, uint64_t inst) {
-		decode_inst<T,RV_64,RV_IMAFDC>(dec, inst);
-		decompress_inst_rv64<T>(dec);
-	}
+	/* machine mode interrupts in priority order */
+	static const int intr_priority[];
 
-	intptr_t inst_exec(T &dec, intptr_t pc_offset) {
-		return exec_inst_rv64<RV_IMAFDC>(dec, *this, pc_offset);
+	void reset()
+	{
+		P::misa = 0;
+		P::mvendorid = P::marchid = P::mimpid = 0;
+		P::mhartid = P::hart_id;
+		P::mstatus.xu.val = 0;
+		P::mstatus.status.mpp = 3;
+		P::mtvec = P::medeleg = P::mideleg = 0;
+		P::mip.xu.val = P::mie.xu.val = 0;
+		P::mtimecmp = ~0ULL;
+		P::mscratch = P::mepc = P::mcause = P::mbadaddr = 0;
 	}
-};
-
-
-/* Processor ABI/AEE proxy emulator that delegates ecall to an abi proxy */
-
-template <typename P>
-struct processor_proxy : P
-{
-	enum csr_op { csr_rw, csr_rs, csr_rc };
 
 	template <typename T>
 	void update_csr(typename P::decode_type &dec, csr_op op, T &csr, typename P::ux value,
-		size_t msb, size_t lsb)
+		typename P::ux mask = ~typename P::ux(0))
 	{
-		const size_t shift = lsb, mask = (1 << (msb - lsb + 1)) - 1;
-		if (dec.rd != riscv_ireg_x0) P::ireg[dec.rd] = (csr >> shift) & mask;
+		if (dec.rd != riscv_ireg_x0) P::ireg[dec.rd] = csr;
 		switch (op) {
-			case csr_rw: csr = value; break;
-			case csr_rs: if (value) csr |= ((value & mask) << shift); break;
-			case csr_rc: if (value) csr &= ~((value & mask) << shift); break;
+			case csr_rw: csr = (csr & ~mask) | (value & mask); break;
+			case csr_rs: csr |= (value & mask); break;
+			case csr_rc: csr &= ~(value & mask); break;
 		}
 	}
 
@@ -373,133 +163,169 @@ struct processor_proxy : P
 	intptr_t inst_csr(typename P::decode_type &dec, csr_op op, int csr, typename P::ux value, intptr_t pc_offset)
 	{
 		switch (csr) {
-			case riscv_csr_fflags:   fenv_getflags(P::fcsr);
-			                         update_csr(dec, op, P::fcsr, value, 4, 0);
-			                         fenv_clearflags(P::fcsr);                  break;
-			case riscv_csr_frm:      update_csr(dec, op, P::fcsr, value, 7, 5);
-			                         fenv_setrm((P::fcsr >> 5) & 0x7);          break;
-			case riscv_csr_fcsr:     fenv_getflags(P::fcsr);
-			                         update_csr(dec, op, P::fcsr, value, 7, 0);
-			                         fenv_clearflags(P::fcsr);
-			                         fenv_setrm((P::fcsr >> 5) & 0x7);          break;
-			case riscv_csr_cycle:    P::cycle = cpu_cycle_clock();
-			                         read_csr(dec, op, P::cycle, value);     	break;
-			case riscv_csr_time:     read_csr(dec, op, P::time, value);         break;
-			case riscv_csr_instret:  read_csr(dec, op, P::instret, value);      break;
-			case riscv_csr_cycleh:   read_csr_hi(dec, op, P::cycle, value);     break;
-			case riscv_csr_timeh:    read_csr_hi(dec, op, P::time, value);      break;
-			case riscv_csr_instreth: read_csr_hi(dec, op, P::instret, value);   break;
+			case riscv_csr_fflags:    fenv_getflags(P::fcsr);
+			                          update_csr(dec, op, P::fcsr, value, 0x1f);
+			                          fenv_clearflags(P::fcsr);                       break;
+			case riscv_csr_frm:       update_csr(dec, op, P::fcsr, value << 5, 0xe0);
+			                          fenv_setrm((P::fcsr >> 5) & 0x7);               break;
+			case riscv_csr_fcsr:      fenv_getflags(P::fcsr);
+			                          update_csr(dec, op, P::fcsr, value, 0xff);
+			                          fenv_clearflags(P::fcsr);
+			                          fenv_setrm((P::fcsr >> 5) & 0x7);               break;
+			case riscv_csr_cycle:
+			case riscv_csr_mcycle:    read_csr(dec, op, P::cycle, value);             break;
+			case riscv_csr_time:
+			case riscv_csr_mtime:     update_time();
+			                          read_csr(dec, op, P::time, value);              break;
+			case riscv_csr_instret:
+			case riscv_csr_minstret:  read_csr(dec, op, P::instret, value);           break;
+			case riscv_csr_cycleh:
+			case riscv_csr_mcycleh:   read_csr_hi(dec, op, P::cycle, value);          break;
+			case riscv_csr_timeh:
+			case riscv_csr_mtimeh:    update_time();
+			                          read_csr_hi(dec, op, P::time, value);           break;
+			case riscv_csr_instreth:
+			case riscv_csr_minstreth: read_csr_hi(dec, op, P::instret, value);        break;
+			case riscv_csr_mvendorid: read_csr(dec, op, P::mvendorid, value);         break;
+			case riscv_csr_marchid:   read_csr(dec, op, P::marchid, value);           break;
+			case riscv_csr_mimpid:    read_csr(dec, op, P::mimpid, value);            break;
+			case riscv_csr_mhartid:   read_csr(dec, op, P::mhartid, value);           break;
+			case riscv_csr_misa:      read_csr(dec, op, P::misa, value);              break;
+			case riscv_csr_mstatus:   update_csr(dec, op, P::mstatus.xu.val, value);
+			                          P::raise_event(processor_event_interrupt);      break;
+			case riscv_csr_mie:       update_csr(dec, op, P::mie.xu.val, value, 0xfff);
+			                          P::raise_event(processor_event_interrupt);      break;
+			case riscv_csr_mip:       update_csr(dec, op, P::mip.xu.val, value, 0x777);
+			                          P::raise_event(processor_event_interrupt);      break;
+			case riscv_csr_medeleg:   update_csr(dec, op, P::medeleg, value);         break;
+			case riscv_csr_mideleg:   update_csr(dec, op, P::mideleg, value);         break;
+			case riscv_csr_mtvec:     update_csr(dec, op, P::mtvec, value, ~typename P::ux(3)); break;
+			case riscv_csr_mscratch:  update_csr(dec, op, P::mscratch, value);        break;
+			case riscv_csr_mepc:      update_csr(dec, op, P::mepc, value, ~typename P::ux(1)); break;
+			case riscv_csr_mcause:    update_csr(dec, op, P::mcause, value);          break;
+			case riscv_csr_mbadaddr:  update_csr(dec, op, P::mbadaddr, value);        break;
 			default: return 0; /* illegal instruction */
 		}
 		return pc_offset;
 	}
 
-	intptr_t inst_priv(typename P::decode_type &dec, intptr_t pc_offset) {
-		switch (dec.op) {
-			case riscv_op_ecall:  proxy_syscall(*this); return pc_offset;
-			case riscv_op_csrrw:  return inst_csr(dec, csr_rw, dec.imm, P::ireg[dec.rs1], pc_offset);
-			case riscv_op_csrrs:  return inst_csr(dec, csr_rs, dec.imm, P::ireg[dec.rs1], pc_offset);
-			case riscv_op_csrrc:  return inst_csr(dec, csr_rc, dec.imm, P::ireg[dec.rs1], pc_offset);
-			case riscv_op_csrrwi: return inst_csr(dec, csr_rw, dec.imm, dec.rs1, pc_offset);
-			case riscv_op_csrrsi: return inst_csr(dec, csr_rs, dec.imm, dec.rs1, pc_offset);
-			case riscv_op_csrrci: return inst_csr(dec, csr_rc, dec.imm, dec.rs1, pc_offset);
-			default: break;
+	void update_time()
+	{
+		P::time = timer ? timer->mtime(*this) : P::instret;
+	}
+
+	/* wait for interrupt, fast-forwarding time to the next timer deadline */
+	intptr_t wfi(intptr_t pc_offset)
+	{
+		if ((P::mip.xu.val & P::mie.xu.val) || !timer) return pc_offset;
+		if (P::pending_events.load(std::memory_order_acquire)) return pc_offset;
+		if (!timer->wfi(*this)) {
+			debug("wfi: no timer deadline or device interrupt: halting");
+			P::raise_event(processor_event_halt);
 		}
-		return 0; /* illegal instruction */
+		return pc_offset;
 	}
-};
 
+	/* enter the machine mode trap vector, returns the offset to apply to pc */
+	intptr_t trap(typename P::ux cause, intptr_t pc_offset)
+	{
+		P::mepc = P::pc;
+		P::mcause = cause;
+		P::mstatus.status.mpie = P::mstatus.status.mie;
+		P::mstatus.status.mie = 0;
+		P::mstatus.status.mpp = 3;
+		P::pc = P::mtvec - pc_offset;
+		return pc_offset;
+	}
 
-/* Processor privileged ISA emulator with soft-mmu */
+	intptr_t mret(intptr_t pc_offset)
+	{
+		P::mstatus.status.mie = P::mstatus.status.mpie;
+		P::mstatus.status.mpie = 1;
+		P::pc = P::mepc - pc_offset;
+		P::raise_event(processor_event_interrupt);
+		return pc_offset;
+	}
+
+	/* take the highest priority pending and enabled interrupt */
+	void take_interrupt()
+	{
+		typename P::ux pending = P::mip.xu.val & P::mie.xu.val;
+		if (!pending || !P::mstatus.status.mie) return;
+		for (const int *intr = intr_priority; *intr >= 0; intr++) {
+			if (!(pending & (typename P::ux(1) << *intr))) continue;
+			u64 latency = P::instret - P::event_instret;
+			P::intr_delivered++;
+			P::intr_latency += latency;
+			if (P::intr_latency_max < latency) P::intr_latency_max = latency;
+			P::mepc = P::pc;
+			P::mcause = (typename P::ux(1) << (P::xlen - 1)) | *intr;
+			P::mstatus.status.mpie = P::mstatus.status.mie;
+			P::mstatus.status.mie = 0;
+			P::mstatus.status.mpp = 3;
+			P::pc = P::mtvec;
+			return;
+		}
+	}
+
+	/* poll the pending event word, returns false if the hart should stop or is parked in wfi */
+	bool check_events()
+	{
+		if (P::wfi_waiting) return false;
+		if (P::instret >= P::timer_instret) {
+			if (timer) timer->check_timer(*this);
+			else P::timer_instret = clint_type::no_deadline;
+		}
+		if (P::pending_events.load(std::memory_order_relaxed) == 0) return true;
+		u32 events = P::pending_events.exchange(0, std::memory_order_acquire);
+		if (events & processor_event_halt) return false;
+
+		/* interrupts that are pending but masked keep the event stamp */
+		bool was_pending = P::mip.xu.val & P::mie.xu.val;
+		if (events & processor_event_timer) P::mip.ip.mtip = 1;
+		if (events & processor_event_timecmp) {
+			/* after timer, a deadline that is still due is raised again at the next check */
+			P::mip.ip.mtip = 0;
+			P::timer_instret = 0;
+		}
+		if (events & processor_event_software) P::mip.ip.msip = 1;
+		if (events & processor_event_software_clear) P::mip.ip.msip = 0;
+		if (events & processor_event_external) P::mip.ip.meip = 1;
+		if (events & processor_event_external_clear) P::mip.ip.meip = 0;
+		if (!was_pending) P::event_instret = P::instret;
+		take_interrupt();
+		return true;
+	}
 
-template <typename P>
-struct processor_privileged : P
-{
 	intptr_t inst_priv(typename P::decode_type &dec, intptr_t pc_offset) {
-		// TODO - emulate privileged instructions
+		// TODO - supervisor, hypervisor and user modes
 		switch (dec.op) {
-			case riscv_op_ecall:     /* TODO */ return 0; break;
-			case riscv_op_ebreak:    /* TODO */ return 0; break;
+			case riscv_op_ecall:     return trap(riscv_cause_machine_ecall, pc_offset);
+			case riscv_op_ebreak:    return trap(riscv_cause_breakpoint, pc_offset);
 			case riscv_op_uret:      /* TODO */ return 0; break;
 			case riscv_op_sret:      /* TODO */ return 0; break;
 			case riscv_op_hret:      /* TODO */ return 0; break;
-			case riscv_op_mret:      /* TODO */ return 0; break;
+			case riscv_op_mret:      return mret(pc_offset);
 			case riscv_op_sfence_vm: /* TODO */ return 0; break;
-			case riscv_op_wfi:       /* TODO */ return 0; break;
-			case riscv_op_csrrw:     /* TODO */ return 0; break;
-			case riscv_op_csrrs:     /* TODO */ return 0; break;
-			case riscv_op_csrrc:     /* TODO */ return 0; break;
-			case riscv_op_csrrwi:    /* TODO */ return 0; break;
-			case riscv_op_csrrsi:    /* TODO */ return 0; break;
-			case riscv_op_csrrci:    /* TODO */ return 0; break;
+			case riscv_op_wfi:       return wfi(pc_offset);
+			case riscv_op_csrrw:     return inst_csr(dec, csr_rw, dec.imm & 0xfff, P::ireg[dec.rs1], pc_offset);
+			case riscv_op_csrrs:     return inst_csr(dec, csr_rs, dec.imm & 0xfff, P::ireg[dec.rs1], pc_offset);
+			case riscv_op_csrrc:     return inst_csr(dec, csr_rc, dec.imm & 0xfff, P::ireg[dec.rs1], pc_offset);
+			case riscv_op_csrrwi:    return inst_csr(dec, csr_rw, dec.imm & 0xfff, dec.rs1, pc_offset);
+			case riscv_op_csrrsi:    return inst_csr(dec, csr_rs, dec.imm & 0xfff, dec.rs1, pc_offset);
+			case riscv_op_csrrci:    return inst_csr(dec, csr_rc, dec.imm & 0xfff, dec.rs1, pc_offset);
 			default: break;
 		}
 		return 0;
 	}
 };
 
-
-/* Simple processor stepper with instruction cache */
-
 template <typename P>
-struct processor_stepper : P
-{
-	static const size_t inst_cache_size = 8191;
-
-	struct riscv_inst_cache_ent
-	{
-		uint64_t inst;
-		typename P::decode_type dec;
-	};
-
-	riscv_inst_cache_ent inst_cache[inst_cache_size];
-
-	bool step(size_t count)
-	{
-		typename P::decode_type dec;
-		size_t i = 0;
-		uint64_t inst;
-		intptr_t pc_offset, new_offset;
-		while (i < count) {
-			inst = inst_fetch(P::pc, &pc_offset); // TODO - MMU
-			uint64_t inst_cache_key = inst % inst_cache_size;
-			if (inst_cache[inst_cache_key].inst == inst) {
-				dec = inst_cache[inst_cache_key].dec;
-			} else {
-				P::inst_decode(dec, inst);
-				inst_cache[inst_cache_key].inst = inst;
-				inst_cache[inst_cache_key].dec = dec;
-			}
-			if ((new_offset = P::inst_exec(dec, pc_offset)) ||
-				(new_offset = P::inst_priv(dec, pc_offset)))
-			{
-				P::pc += new_offset;
-				P::cycle++;
-				P::instret++;
-				if (P::log_flags) P::print_log(dec);
-				continue;
-			}
-			debug("illegal instruciton: pc=0x%tx inst=%s",
-				uintptr_t(P::pc), P::format_inst(P::pc).c_str());
-			return false;
-		}
-		return true;
-	}
+const int processor_privileged<P>::intr_priority[] = {
+	riscv_intr_m_external, riscv_intr_m_software, riscv_intr_m_timer, -1
 };
 
 
-/* Parameterized ABI proxy processor models */
-
-using proxy_emulator_rv32ima = processor_stepper<processor_proxy<processor_rv32ima_unit<decode,processor_rv32imafd,mmu_proxy>>>;
-using proxy_emulator_rv32imac = processor_stepper<processor_proxy<processor_rv32imac_unit<decode,processor_rv32imafd,mmu_proxy>>>;
-using proxy_emulator_rv32imafd = processor_stepper<processor_proxy<processor_rv32imafd_unit<decode,processor_rv32imafd,mmu_proxy>>>;
-using proxy_emulator_rv32imafdc = processor_stepper<processor_proxy<processor_rv32imafdc_unit<decode,processor_rv32imafd,mmu_proxy>>>;
-using proxy_emulator_rv64ima = processor_stepper<processor_proxy<processor_rv64ima_unit<decode,processor_rv64imafd,mmu_proxy>>>;
-using proxy_emulator_rv64imac = processor_stepper<processor_proxy<processor_rv64imac_unit<decode,processor_rv64imafd,mmu_proxy>>>;
-using proxy_emulator_rv64imafd = processor_stepper<processor_proxy<processor_rv64imafd_unit<decode,processor_rv64imafd,mmu_proxy>>>;
-using proxy_emulator_rv64imafdc = processor_stepper<processor_proxy<processor_rv64imafdc_unit<decode,processor_rv64imafd,mmu_proxy>>>;
-
-
 /* Parameterized privileged soft-mmu processor models */
 
 using priv_emulator_rv32ima = processor_stepper<processor_privileged<processor_rv32ima_unit<decode,processor_priv_rv32imafd,mmu_rv32>>>;
@@ -528,18 +354,44 @@ struct riscv_emulator
 		(AEE) application execution environment
 	*/
 
-	static const size_t stack_top =  0x78000000; // 1920 MiB
-	static const size_t stack_size = 0x01000000; //   16 MiB
+	static const size_t virtio_block_addr = 0x10001000;
+	static const size_t virtio_block_size = 0x1000;
 
 	elf_file elf;
 	std::string filename;
+	std::vector<std::string> guest_args;
+	std::string platform_filename;
+	std::string uart_out_filename;
+	std::string uart_in_filename;
+	std::string block_filename;
+	riscv_config_ptr platform;
 	std::vector<uint32_t> entropy;
 
 	int log_flags = 0;
 	bool priv_mode = false;
 	bool memory_debug = false;
 	bool emulator_debug = false;
+	bool cache_sim = false;
+	bool cache_l2 = false;
 	bool help_or_error = false;
+	size_t event_interval = 1024;
+	clint_time_mode time_mode = clint_time_instret;
+	int ram_backing = memory_backing_noreserve;
+	int numa_node = -1;
+	size_t hart_count = 1;
+	size_t quantum = 0;
+	size_t block_workers = 0;
+	bool block_readonly = false;
+	bool buffer_output = false;
+	proxy_clock_mode clock_mode = proxy_clock_tsc;
+	std::string trace_filename;
+	bool trace_syscalls = false;
+	bool trace_summary = false;
+	bool sandbox = false;
+	std::string fork_marker;
+	std::string fork_inputs = "-";
+
+	cache_replace cache_policy = cache_replace_lru;
 
 	enum rv_isa {
 		rv_isa_none,
@@ -558,44 +410,110 @@ struct riscv_emulator
 		else return rv_isa_none;
 	}
 
-	static const int elf_p_flags_mmap(int v)
+	static bool decode_cache_replace(std::string policy, cache_replace &replace)
 	{
-		int prot = 0;
-		if (v & PF_X) prot |= PROT_EXEC;
-		if (v & PF_W) prot |= PROT_WRITE;
-		if (v & PF_R) prot |= PROT_READ;
-		return prot;
+		if (strcasecmp(policy.c_str(), "lru") == 0) replace = cache_replace_lru;
+		else if (strcasecmp(policy.c_str(), "plru") == 0) replace = cache_replace_plru;
+		else if (strcasecmp(policy.c_str(), "random") == 0) replace = cache_replace_random;
+		else return false;
+		return true;
 	}
 
-	static const int elf_pma_flags(int v)
+	static bool decode_time_mode(std::string mode, clint_time_mode &time_mode)
 	{
-		int prot = 0;
-		if (v & PF_X) prot |= pma_prot_execute;
-		if (v & PF_W) prot |= pma_prot_write;
-		if (v & PF_R) prot |= pma_prot_read;
-		return prot;
+		if (strcasecmp(mode.c_str(), "instret") == 0) time_mode = clint_time_instret;
+		else if (strcasecmp(mode.c_str(), "wallclock") == 0) time_mode = clint_time_wallclock;
+		else return false;
+		return true;
 	}
 
-	/* Map a single stack segment into user address space */
-	template <typename P>
-	void map_stack(P &proc, uintptr_t stack_top, uintptr_t stack_size)
+	static bool decode_clock_mode(std::string mode, proxy_clock_mode &clock_mode)
 	{
-		void *addr = mmap((void*)(stack_top - stack_size), stack_size,
-			PROT_READ | PROT_WRITE, MAP_FIXED | MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-		if (addr == MAP_FAILED) {
-			panic("map_stack: error: mmap: %s", strerror(errno));
+		if (strcasecmp(mode.c_str(), "host") == 0) clock_mode = proxy_clock_host;
+		else if (strcasecmp(mode.c_str(), "tsc") == 0) clock_mode = proxy_clock_tsc;
+		else if (strcasecmp(mode.c_str(), "instret") == 0) clock_mode = proxy_clock_instret;
+		else return false;
+		return true;
+	}
+
+	static bool decode_ram_backing(std::string list, int &backing)
+	{
+		backing = 0;
+		for (auto name : split(list, ",")) {
+			if (strcasecmp(name.c_str(), "noreserve") == 0) backing |= memory_backing_noreserve;
+			else if (strcasecmp(name.c_str(), "thp") == 0) backing |= memory_backing_thp;
+			else if (strcasecmp(name.c_str(), "hugetlb") == 0) backing |= memory_backing_hugetlb;
+			else if (strcasecmp(name.c_str(), "none") != 0) return false;
 		}
+		return true;
+	}
 
-		/* keep track of the mapped segment and set the stack_top */
-		proc.mmu.segments.push_back(std::pair<void*,size_t>((void*)(stack_top - stack_size), stack_size));
-		proc.ireg[riscv_ireg_sp] = stack_top - 0x8;
+	template <typename M>
+	void print_memory_usage(M &mem)
+	{
+		auto usage = mem.resident_size();
+		debug("memory: reserved=%zu KiB resident=%zu KiB (%.2f%%)",
+			usage.first >> 10, usage.second >> 10,
+			usage.first ? 100.0 * usage.second / usage.first : 0.0);
+
+		/* report the written working set from the dirty page bitmap */
+		size_t dirty_bytes = 0, dirty_ranges = 0;
+		mem.for_each_dirty_range([&](u64 mpa, size_t len) {
+			dirty_bytes += len;
+			dirty_ranges++;
+		});
+		debug("memory: dirty=%zu KiB in %zu ranges", dirty_bytes >> 10, dirty_ranges);
+	}
 
-		if (emulator_debug) {
-			debug("sp : mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " +R+W",
-				(stack_top - stack_size), stack_top);
+	static void print_cache_stats(const char *name, cache_stats &stats)
+	{
+		debug("%s: accesses=%" PRIu64 " read_hits=%" PRIu64 " read_misses=%" PRIu64
+			" write_hits=%" PRIu64 " write_misses=%" PRIu64 " evictions=%" PRIu64
+			" writebacks=%" PRIu64 " miss_rate=%.2f%%", name, stats.accesses(),
+			stats.read_hits, stats.read_misses, stats.write_hits, stats.write_misses,
+			stats.evictions, stats.writebacks,
+			stats.accesses() ? 100.0 * stats.misses() / stats.accesses() : 0.0);
+	}
+
+	template <typename H>
+	void print_cache_hierarchy_stats(H &hier)
+	{
+		for (size_t i = 0; i < hier.harts.size(); i++) {
+			auto &h = hier.harts[i];
+			print_cache_stats(format_string("hart %zu l1_icache", i).c_str(), h.l1_icache->stats);
+			print_cache_stats(format_string("hart %zu l1_dcache", i).c_str(), h.l1_dcache->stats);
+			if (h.l2) print_cache_stats(format_string("hart %zu l2_cache", i).c_str(), h.l2->stats);
+			debug("hart %zu llc: accesses=%" PRIu64 " misses=%" PRIu64 " miss_rate=%.2f%%"
+				" invalidations=%" PRIu64 " downgrades=%" PRIu64 " false_sharing=%" PRIu64,
+				i, h.stats.llc_accesses, h.stats.llc_misses,
+				h.stats.llc_accesses ? 100.0 * h.stats.llc_misses / h.stats.llc_accesses : 0.0,
+				h.stats.invalidations, h.stats.downgrades, h.stats.false_sharing);
+		}
+		print_cache_stats("llc", hier.llc.stats);
+
+		/* report sharing hotspots by guest address and symbol */
+		auto hotspots = hier.hotspots(10);
+		if (hotspots.size() == 0) return;
+		elf_file sym_elf;
+		sym_elf.load(filename);
+		for (auto &ent : hotspots) {
+			const Elf64_Sym *sym = sym_elf.sym_by_nearest_addr(ent.first);
+			std::string name = sym ? format_string("%s+0x%" PRIx64, sym_elf.sym_name(sym),
+				u64(ent.first - sym->st_value)) : "?";
+			debug("hotspot: 0x%016" PRIx64 " %-32s invalidations=%" PRIu64 " false_sharing=%" PRIu64,
+				u64(ent.first), name.c_str(), ent.second.invalidations, ent.second.false_sharing);
 		}
 	}
 
+	static const int elf_pma_flags(int v)
+	{
+		int prot = 0;
+		if (v & PF_X) prot |= pma_prot_execute;
+		if (v & PF_W) prot |= pma_prot_write;
+		if (v & PF_R) prot |= pma_prot_read;
+		return prot;
+	}
+
 	/* Map ELF load segments into mmu address space */
 	template <typename P>
 	void map_load_segment_mmu(P &proc, const char* filename, Elf64_Phdr &phdr)
@@ -613,7 +531,8 @@ struct riscv_emulator
 
 		/* add the loaded segment to the emulator mmu */
 		proc.mmu.mem.add_segment(phdr.p_vaddr, uintptr_t(addr), phdr.p_memsz,
-			pma_type_main | elf_pma_flags(phdr.p_flags));
+			pma_type_main | elf_pma_flags(phdr.p_flags) |
+			pma_cache_write_back | pma_cache_alloc_read | pma_cache_alloc_write);
 
 		if (emulator_debug) {
 			debug("elf: mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " %s",
@@ -622,30 +541,99 @@ struct riscv_emulator
 		}
 	}
 
-	/* Map ELF load segments into user address space */
-	template <typename P>
-	void map_load_segment_user(P &proc, const char* filename, Elf64_Phdr &phdr)
+	/* open a UART host file, output defaults to stdout and input to none */
+	static int open_uart_fd(std::string filename, bool output)
 	{
-		int fd = open(filename, O_RDONLY);
-		if (fd < 0) {
-			panic("map_executable: error: open: %s: %s", filename, strerror(errno));
+		if (filename.size() == 0) return output ? fileno(stdout) : -1;
+		if (filename == "-") return output ? fileno(stdout) : fileno(stdin);
+		int fd = output ? open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) :
+			open(filename.c_str(), O_RDONLY);
+		if (fd < 0) panic("uart: open: %s: %s", filename.c_str(), strerror(errno));
+		return fd;
+	}
+
+	/* size of a configured address range, a single address maps one register */
+	static u64 platform_range_size(riscv_address_range_ptr &range)
+	{
+		return range->end > range->start ? range->end - range->start + 1 : 8;
+	}
+
+	/* register address ranges without a device model as stub devices */
+	template <typename UX, typename M>
+	void map_platform_stubs(M &mem, const char *name, riscv_address_range_list &addr_list)
+	{
+		for (auto &range : addr_list) {
+			u64 end = range->start + platform_range_size(range) - 1;
+			if (end > u64(std::numeric_limits<UX>::max())) {
+				debug("platform: %s: 0x%" PRIx64 " - 0x%" PRIx64 " is outside the physical address space",
+					name, range->start, end);
+				continue;
+			}
+			mem.add_device(UX(range->start), platform_range_size(range),
+				std::make_shared<platform_stub_device<UX>>(name));
 		}
-		void *addr = mmap((void*)phdr.p_vaddr, phdr.p_memsz,
-			elf_p_flags_mmap(phdr.p_flags), MAP_FIXED | MAP_PRIVATE, fd, phdr.p_offset);
-		close(fd);
-		if (addr == MAP_FAILED) {
-			panic("map_executable: error: mmap: %s: %s", filename, strerror(errno));
+	}
+
+	/* harts in configuration order, the first is the boot hart */
+	std::vector<riscv_core_hart_ptr> platform_harts()
+	{
+		std::vector<riscv_core_hart_ptr> harts;
+		for (auto &core : platform->core_list) {
+			for (auto &node : core->node_list) {
+				for (auto &hart : node->hart_list) harts.push_back(hart);
+			}
 		}
+		if (harts.size() == 0) panic("platform: no harts configured");
+		return harts;
+	}
 
-		/* keep track of the mapped segment and set the heap_end */
-		proc.mmu.segments.push_back(std::pair<void*,size_t>((void*)phdr.p_vaddr, phdr.p_memsz));
-		uintptr_t seg_end = uintptr_t(phdr.p_vaddr + phdr.p_memsz);
-		if (proc.mmu.heap_begin < seg_end) proc.mmu.heap_begin = proc.mmu.heap_end = seg_end;
+	/* Build the memory map, RAM and devices from the platform configuration */
+	template <typename P, typename C, typename U>
+	void map_platform(P &proc, C &timer, std::shared_ptr<U> uart)
+	{
+		auto &mem = proc.mmu.mem;
+		auto harts = platform_harts();
 
-		if (emulator_debug) {
-			debug("elf: mmap: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " %s",
-				uintptr_t(phdr.p_vaddr), uintptr_t(phdr.p_vaddr + phdr.p_memsz),
-				elf_p_flags_name(phdr.p_flags).c_str());
+		/* CLINT mtime at the rtc address, mtimecmp and msip at each hart's timecmp and ipi address */
+		if (platform->rtc_list.size() > 0 && platform->rtc_list[0]->addr_list.size() > 0) {
+			timer.add_mtime(mem, platform->rtc_list[0]->addr_list[0]->start);
+		}
+		for (size_t i = 0; i < harts.size() && i < timer.harts.size(); i++) {
+			timer.add_timecmp(mem, harts[i]->timecmp, i);
+			if (harts[i]->ipi) timer.add_ipi(mem, harts[i]->ipi, i, 1);
+		}
+
+		/* UART at the first uart address */
+		if (platform->uart_list.size() > 0 && platform->uart_list[0]->addr_list.size() > 0) {
+			mem.add_device(platform->uart_list[0]->addr_list[0]->start, 8, uart);
+		}
+
+		/* devices without a model */
+		for (auto &leds : platform->leds_list) map_platform_stubs<typename P::ux>(mem, "leds", leds->addr_list);
+		for (auto &plic : platform->plic_list) {
+			if (plic->priority) map_platform_stubs<typename P::ux>(mem, "plic", plic->priority->addr_list);
+			if (plic->pending) map_platform_stubs<typename P::ux>(mem, "plic", plic->pending->addr_list);
+			for (auto &node : plic->node_list) {
+				for (auto &hart : node->hart_list) {
+					for (auto &mode : hart->mode_list) {
+						map_platform_stubs<typename P::ux>(mem, "plic", mode->ie_addr_list);
+						map_platform_stubs<typename P::ux>(mem, "plic", mode->ctl_addr_list);
+					}
+				}
+			}
+		}
+		for (auto &pcie : platform->pcie_list) {
+			for (auto &bus : pcie->bus_list) map_platform_stubs<typename P::ux>(mem, "pcie", bus->addr_list);
+			for (auto &bridge : pcie->bridge_list) map_platform_stubs<typename P::ux>(mem, "pcie", bridge->addr_list);
+		}
+
+		/* RAM nodes use the configured RAM backing */
+		for (auto &ram : platform->ram_list) {
+			for (auto &node : ram->node_list) {
+				for (auto &range : node->addr_list) {
+					mem.add_ram(range->start, platform_range_size(range));
+				}
+			}
 		}
 	}
 
@@ -665,6 +653,72 @@ struct riscv_emulator
 			{ "-p", "--privileged", cmdline_arg_type_none,
 				"Privileged ISA Emulation",
 				[&](std::string s) { return (priv_mode = true); } },
+			{ "-c", "--cache-sim", cmdline_arg_type_none,
+				"L1 Cache Simulation and Statistics (privileged mode)",
+				[&](std::string s) { return (cache_sim = true); } },
+			{ "-L", "--cache-l2", cmdline_arg_type_none,
+				"Private L2 Cache per hart (with --cache-sim)",
+				[&](std::string s) { return (cache_l2 = true); } },
+			{ "-R", "--cache-replace", cmdline_arg_type_string,
+				"L1 Cache Replacement Policy (LRU, PLRU, RANDOM)",
+				[&](std::string s) { return decode_cache_replace(s, cache_policy); } },
+			{ "-E", "--event-interval", cmdline_arg_type_string,
+				"Maximum instructions between interrupt checks (privileged mode)",
+				[&](std::string s) { return (event_interval = strtoull(s.c_str(), nullptr, 10)) > 0; } },
+			{ "-P", "--platform", cmdline_arg_type_string,
+				"Platform configuration file (privileged mode)",
+				[&](std::string s) { platform_filename = s; return true; } },
+			{ "-U", "--uart-out", cmdline_arg_type_string,
+				"UART output file (default stdout)",
+				[&](std::string s) { uart_out_filename = s; return true; } },
+			{ "-u", "--uart-in", cmdline_arg_type_string,
+				"UART input file, - for stdin (a regular file with --quantum)",
+				[&](std::string s) { uart_in_filename = s; return true; } },
+			{ "-T", "--time-mode", cmdline_arg_type_string,
+				"Timer source (INSTRET, WALLCLOCK)",
+				[&](std::string s) { return decode_time_mode(s, time_mode); } },
+			{ "-H", "--ram-backing", cmdline_arg_type_string,
+				"RAM backing (comma separated NORESERVE, THP, HUGETLB or NONE)",
+				[&](std::string s) { return decode_ram_backing(s, ram_backing); } },
+			{ "-N", "--numa-node", cmdline_arg_type_string,
+				"Bind RAM to NUMA node",
+				[&](std::string s) { numa_node = strtol(s.c_str(), nullptr, 10); return true; } },
+			{ "-S", "--harts", cmdline_arg_type_string,
+				"Number of harts, each on its own host thread (privileged mode, default 1)",
+				[&](std::string s) { return (hart_count = strtoull(s.c_str(), nullptr, 10)) > 0; } },
+			{ "-q", "--quantum", cmdline_arg_type_string,
+				"Run harts round-robin on one host thread with an instruction quantum (deterministic with --seed)",
+				[&](std::string s) { return (quantum = strtoull(s.c_str(), nullptr, 10)) > 0; } },
+			{ "-B", "--block-image", cmdline_arg_type_string,
+				"virtio block device disk image (privileged mode)",
+				[&](std::string s) { block_filename = s; return true; } },
+			{ "-W", "--block-workers", cmdline_arg_type_string,
+				"virtio block device worker threads (default 0, served by the hart)",
+				[&](std::string s) { block_workers = strtoull(s.c_str(), nullptr, 10); return true; } },
+			{ "-O", "--block-readonly", cmdline_arg_type_none,
+				"Map the virtio block device disk image read only",
+				[&](std::string s) { return (block_readonly = true); } },
+			{ "-b", "--buffer-output", cmdline_arg_type_none,
+				"Coalesce guest writes to stdout, stderr and regular files (proxy mode)",
+				[&](std::string s) { return (buffer_output = true); } },
+			{ "-C", "--clock", cmdline_arg_type_string,
+				"Guest time source (HOST, TSC, INSTRET) (proxy mode, default TSC)",
+				[&](std::string s) { return decode_clock_mode(s, clock_mode); } },
+			{ "-t", "--trace-syscalls", cmdline_arg_type_string,
+				"Record proxied syscalls to a binary trace file (proxy mode)",
+				[&](std::string s) { trace_filename = s; return (trace_syscalls = true); } },
+			{ "-y", "--trace-summary", cmdline_arg_type_none,
+				"Print syscall latency percentiles at exit (proxy mode)",
+				[&](std::string s) { return (trace_syscalls = trace_summary = true); } },
+			{ "-X", "--sandbox", cmdline_arg_type_none,
+				"Relocate guest memory into a masked host reservation (proxy mode)",
+				[&](std::string s) { return (sandbox = true); } },
+			{ "-Z", "--fork-server", cmdline_arg_type_string,
+				"Fork per input from a snapshot at stdin, ecall or <symbol> (proxy mode)",
+				[&](std::string s) { fork_marker = s; return true; } },
+			{ "-I", "--fork-inputs", cmdline_arg_type_string,
+				"File listing one fork server input per line (default stdin)",
+				[&](std::string s) { fork_inputs = s; return true; } },
 			{ "-r", "--log-int-registers", cmdline_arg_type_none,
 				"Log Integer Registers",
 				[&](std::string s) { return (log_flags |= reg_log_int); } },
@@ -695,18 +749,26 @@ struct riscv_emulator
 		auto result = cmdline_option::process_options(options, argc, argv);
 		if (!result.second) {
 			help_or_error = true;
-		} else if (result.first.size() != 1) {
+		} else if (result.first.size() < 1) {
 			printf("%s: wrong number of arguments\n", argv[0]);
 			help_or_error = true;
 		}
 
 		if (help_or_error) {
-			printf("usage: %s [<options>] <elf_file>\n", argv[0]);
+			printf("usage: %s [<options>] <elf_file> [<args>]\n", argv[0]);
 			cmdline_option::print_options(options);
 			exit(9);
 		}
 
+		/* the ELF file is argv[0] of the guest */
 		filename = result.first[0];
+		guest_args.assign(result.first.begin(), result.first.end());
+
+		/* load the platform configuration */
+		if (platform_filename.size() > 0) {
+			platform = std::make_shared<riscv_config>();
+			platform->read(platform_filename);
+		}
 
 		/* print process information */
 		if (memory_debug) {
@@ -729,7 +791,7 @@ struct riscv_emulator
 	}
 
 	template <typename P>
-	void seed_registers(P &proc, size_t n)
+	void seed_registers(P &proc, size_t n, u8 *random = nullptr)
 	{
 		// if no entropy is present, get n bits of entropy from the host
 		if (entropy.size() == 0) {
@@ -759,6 +821,13 @@ struct riscv_emulator
 		for (size_t i = riscv_ireg_x1; i < P::ireg_count; i++) {
 			proc.ireg[i].r.xu.val = distribution(twister);
 		}
+
+		// and the AT_RANDOM bytes on the proxy stack
+		if (random) {
+			for (size_t i = 0; i < proxy_stack_image::random_size; i++) {
+				random[i] = u8(twister());
+			}
+		}
 	}
 
 	/* Start the execuatable with the given privileged processor template */
@@ -768,15 +837,40 @@ struct riscv_emulator
 		/* clear floating point exceptions */
 		feclearexcept(FE_ALL_EXCEPT);
 
-		/* instantiate processor, set log options and program counter to entry address */
+		/* instantiate the boot hart, set log options and program counter to entry address */
 		P proc;
 		proc.flags = emulator_debug ? processor_flag_emulator_debug : 0;
 		proc.log_flags = log_flags;
 		proc.pc = elf.ehdr.e_entry;
+		proc.reset();
 
 		/* randomise integer register state with 512 bits of entropy */
 		seed_registers(proc, 512);
 
+		/* secondary harts start at the entry address with the same register state */
+		size_t num_harts = platform ? platform_harts().size() : hart_count;
+		std::vector<std::unique_ptr<P>> secondary;
+		std::vector<P*> harts = { &proc };
+		for (size_t i = 1; i < num_harts; i++) {
+			secondary.push_back(std::unique_ptr<P>(new P()));
+			P &hart = *secondary.back();
+			hart.hart_id = i;
+			hart.flags = proc.flags;
+			hart.log_flags = log_flags;
+			hart.pc = elf.ehdr.e_entry;
+			hart.reset();
+			memcpy(hart.ireg, proc.ireg, sizeof(proc.ireg));
+			harts.push_back(&hart);
+		}
+		if (quantum > 0) {
+			/* round-robin harts share virtual time and serve block requests in order */
+			time_mode = clint_time_virtual;
+			block_workers = 0;
+		} else if (num_harts > 1 && time_mode == clint_time_instret) {
+			debug("smp: %zu harts on host threads: using wallclock time", num_harts);
+			time_mode = clint_time_wallclock;
+		}
+
 		/* Find the ELF executable PT_LOAD segments and map them into the emulator mmu */
 		for (size_t i = 0; i < elf.phdrs.size(); i++) {
 			Elf64_Phdr &phdr = elf.phdrs[i];
@@ -785,11 +879,271 @@ struct riscv_emulator
 			}
 		}
 
-		/* Add 1GB RAM to the mmu (make this a command line option) */
-		proc.mmu.mem.add_ram(0x0, /*1GB*/0x40000000ULL);
+		/* UART console drained and filled by host threads */
+		typedef uart_16550<typename P::ux> uart_type;
+		auto uart = std::make_shared<uart_type>(open_uart_fd(uart_out_filename, true),
+			open_uart_fd(uart_in_filename, false));
+		uart->irq = [&proc](bool level) {
+			if (level) proc.raise_event(processor_event_external, processor_event_external_clear);
+			else proc.raise_event(processor_event_external_clear, processor_event_external);
+		};
 
-		/* Step the CPU until it halts */
-		while(proc.step(1024));
+		/* round-robin input is read between rounds, only a regular file reads the same way every run */
+		if (quantum > 0 && uart->in_fd >= 0) {
+			struct stat statbuf;
+			if (fstat(uart->in_fd, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) {
+				panic("uart: --uart-in must be a regular file with --quantum");
+			}
+			uart->rx_polled = true;
+		}
+
+		/* virtio block device serving requests from the mmap'd disk image */
+		typedef virtio_block<typename P::ux> block_type;
+		std::shared_ptr<block_type> block;
+		if (block_filename.size() > 0) {
+			block = std::make_shared<block_type>(&proc.mmu.mem);
+			if (!block->open_image(block_filename.c_str(), block_readonly)) {
+				panic("virtio-blk: can't map disk image: %s", block_filename.c_str());
+			}
+			block->irq = [&proc, uart](bool level) {
+				if (level) proc.raise_event(processor_event_external, processor_event_external_clear);
+				else if (uart->rx.empty()) proc.raise_event(processor_event_external_clear, processor_event_external);
+			};
+			uart->irq = [&proc, &block](bool level) {
+				if (level) proc.raise_event(processor_event_external, processor_event_external_clear);
+				else if (block->interrupt_status == 0) proc.raise_event(processor_event_external_clear, processor_event_external);
+			};
+		}
+
+		/* CLINT timer for the harts, wfi keeps waiting while a device can interrupt */
+		typedef typename P::clint_type clint_type;
+		clint_type timer(time_mode);
+		timer.event_interval = event_interval;
+		timer.device_active = [uart, &block] {
+			bool rx = uart->rx_polled ? uart->rx_pending() : uart->rx_open.load(std::memory_order_acquire);
+			return rx || (block && block->busy());
+		};
+		for (auto hart : harts) {
+			timer.add_hart(hart);
+			hart->timer = &timer;
+		}
+
+		/* Build the machine from the platform configuration or use the default map */
+		proc.mmu.mem.backing = ram_backing;
+		proc.mmu.mem.numa_node = numa_node;
+		if (block) {
+			proc.mmu.mem.add_device(virtio_block_addr, virtio_block_size, block);
+			block->start(block_workers);
+		}
+		if (platform) {
+			map_platform(proc, timer, uart);
+		} else {
+			/* CLINT, IPI, UART and 1GB RAM at the spike addresses */
+			timer.add_regions(proc.mmu.mem, 0x2000, 0x2008);
+			timer.add_ipi(proc.mmu.mem, 0x44000000, 0, num_harts);
+			proc.mmu.mem.add_device(0x48000000, 8, uart);
+			proc.mmu.mem.add_ram(0x0, /*1GB*/0x40000000ULL);
+		}
+		uart->start();
+
+		/* Track written pages to report the working set */
+		if (memory_debug) {
+			proc.mmu.mem.enable_dirty_tracking();
+		}
+
+		/* secondary harts share the boot hart's memory map but have their own TLBs and caches */
+		for (auto &hart : secondary) {
+			hart->mmu.mem.share_segments(proc.mmu.mem);
+		}
+
+		/* devices are single threaded, serialize them when harts run concurrently */
+		if (num_harts > 1 && quantum == 0) {
+			for (auto &seg : proc.mmu.mem.segments) {
+				if (seg.device) seg.device->threaded = true;
+			}
+		}
+
+		/* Enable cache simulation with each hart's L1 caches in a coherent hierarchy */
+		typedef typename P::mmu_type::cache_hierarchy_type cache_hierarchy_type;
+		std::unique_ptr<cache_hierarchy_type> hier;
+		if (cache_sim) {
+			hier = std::unique_ptr<cache_hierarchy_type>(new cache_hierarchy_type(&proc.mmu.mem, cache_l2));
+			hier->llc.replace = cache_policy;
+			hier->threaded = num_harts > 1 && quantum == 0;
+			for (auto hart : harts) {
+				hart->mmu.cache_enable = true;
+				hart->mmu.cache_hierarchy = hier.get();
+				hart->mmu.cache_hart = hier->add_hart(&hart->mmu.l1_icache, &hart->mmu.l1_dcache);
+				hart->mmu.l1_icache.replace = hart->mmu.l1_dcache.replace = cache_policy;
+				if (hier->harts.back().l2) hier->harts.back().l2->replace = cache_policy;
+			}
+		}
+
+		/*
+		 * Step each hart on its own host thread until it halts, checking events
+		 * at least every event_interval instructions. The boot hart runs on this
+		 * thread and halts the other harts when it stops.
+		 */
+		std::vector<u64> hart_ns(num_harts);
+		std::seed_seq seq(entropy.begin(), entropy.end());
+		round_robin_scheduler<P> sched(harts, timer, quantum, seq);
+		if (uart->rx_polled) sched.poll_devices = [uart] { uart->poll_input(); };
+		auto run_hart = [&](size_t i) {
+			P &hart = *harts[i];
+			u64 start = clint_type::host_ns();
+			while(hart.step(event_interval));
+			hart_ns[i] = clint_type::host_ns() - start;
+			timer.hart_stopped();
+			if (i == 0) {
+				for (size_t j = 1; j < num_harts; j++) harts[j]->raise_event(processor_event_halt);
+			}
+		};
+		std::vector<std::thread> threads;
+		if (quantum > 0) {
+			sched.run();
+			hart_ns = sched.hart_ns;
+		} else {
+			for (size_t i = 1; i < num_harts; i++) {
+				threads.push_back(std::thread(run_hart, i));
+			}
+			run_hart(0);
+			for (auto &t : threads) t.join();
+		}
+
+		/* Drain the UART and complete outstanding block requests */
+		uart->stop();
+		if (block) block->stop();
+
+		/* Report interrupt delivery latency in retired instructions */
+		if (emulator_debug) {
+			debug("interrupts: delivered=%" PRIu64 " latency_avg=%.1f latency_max=%" PRIu64 " instret",
+				proc.intr_delivered, proc.intr_delivered ?
+				double(proc.intr_latency) / proc.intr_delivered : 0.0, proc.intr_latency_max);
+			debug("clint: mtime=%" PRIu64 " wfi=%" PRIu64 " skipped_ticks=%" PRIu64 " ipi=%" PRIu64,
+				timer.mtime(proc), u64(timer.wfi_count), timer.skipped_ticks, u64(timer.ipi_count));
+			debug("uart: tx_bytes=%" PRIu64 " host_writes=%" PRIu64 " tx_full=%" PRIu64 " rx_bytes=%" PRIu64,
+				uart->tx_bytes, uart->host_writes, uart->tx_full, uart->rx_bytes);
+			if (block) {
+				debug("virtio-blk: requests=%" PRIu64 " read=%" PRIu64 " written=%" PRIu64
+					" flushes=%" PRIu64 " throughput=%.1f MB/s",
+					u64(block->requests), u64(block->bytes_read), u64(block->bytes_written),
+					u64(block->flushes), block->throughput_mbs());
+			}
+			if (quantum > 0) {
+				debug("scheduler: quantum=%zu rounds=%" PRIu64 " switches=%" PRIu64
+					" switch_overhead=%.1f ns", quantum, sched.rounds, sched.switches,
+					sched.switch_overhead_ns());
+			}
+			for (size_t i = 0; i < num_harts; i++) {
+				debug("hart %zu: instret=%" PRIu64 " time=%.3fs mips=%.1f", i,
+					u64(harts[i]->instret), hart_ns[i] / 1e9,
+					hart_ns[i] ? harts[i]->instret * 1e3 / hart_ns[i] : 0.0);
+			}
+		}
+
+		/* Write back the caches and print statistics */
+		if (cache_sim) {
+			proc.mmu.flush_caches();
+			print_cache_hierarchy_stats(*hier);
+		}
+
+		/* Report resident versus reserved guest memory */
+		if (memory_debug) {
+			print_memory_usage(proc.mmu.mem);
+		}
+	}
+
+	/*
+	 * Fork server. The guest is stepped once to the snapshot marker, then
+	 * the host process forks for each input listed in fork_inputs, so the
+	 * initialised guest memory is shared copy-on-write. Each child opens
+	 * its input as fd 0 and returns to finish the guest run; the parent
+	 * reports the exit status of each child and exits when the list ends.
+	 */
+	template <typename P>
+	void fork_server(proxy_process<P> &process)
+	{
+		P &proc = process.proc;
+		if (trace_syscalls) {
+			panic("fork-server: syscall tracing is not supported");
+		}
+
+		/* the marker is stdin, ecall or a symbol name */
+		if (fork_marker == "stdin") {
+			process.set_snapshot(abi_snapshot_stdin);
+		} else if (fork_marker == "ecall") {
+			process.set_snapshot(abi_snapshot_ecall);
+		} else {
+			elf_file sym_elf;
+			sym_elf.load(filename);
+			const Elf64_Sym *sym = sym_elf.sym_by_name(fork_marker.c_str());
+			if (!sym) {
+				panic("fork-server: symbol not found: %s", fork_marker.c_str());
+			}
+			process.set_snapshot(abi_snapshot_symbol, uintptr_t(sym->st_value));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		if (!process.run_to_snapshot()) {
+			panic("fork-server: guest stopped before reaching %s", fork_marker.c_str());
+		}
+		if (proc.mmu.threads->threads != 1) {
+			panic("fork-server: guest threads are running at the snapshot");
+		}
+		if (emulator_debug) {
+			debug("fork-server: snapshot: pc=0x%016" PRIx64 " instret=%" PRIu64 " time=%.3fms",
+				u64(proc.pc), u64(proc.instret), std::chrono::duration<double, std::milli>(
+					std::chrono::steady_clock::now() - start).count());
+		}
+
+		FILE *list = fork_inputs == "-" ? stdin : fopen(fork_inputs.c_str(), "r");
+		if (!list) {
+			panic("fork-server: fopen: %s: %s", fork_inputs.c_str(), strerror(errno));
+		}
+
+		/* output written before the snapshot must not be repeated by every child */
+		proc.mmu.output->flush_all();
+		fflush(stdout);
+		fflush(stderr);
+
+		char line[PATH_MAX];
+		size_t request = 0;
+		while (fgets(line, sizeof(line), list)) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if (line[0] == '\0') continue;
+			int fd = open(line, O_RDONLY);
+			if (fd < 0) {
+				debug("fork-server: open: %s: %s", line, strerror(errno));
+				continue;
+			}
+			request++;
+			start = std::chrono::steady_clock::now();
+			pid_t pid = fork();
+			if (pid < 0) {
+				panic("fork-server: fork: %s", strerror(errno));
+			}
+			if (pid == 0) {
+				dup2(fd, STDIN_FILENO);
+				close(fd);
+				if (list != stdin) fclose(list);
+				/* the snapshot ecall returns the request number in the child */
+				if (fork_marker == "ecall") proc.ireg[riscv_ireg_a0] = request;
+				return;
+			}
+			close(fd);
+			int status;
+			while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+			double wall_ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count();
+			if (WIFSIGNALED(status)) {
+				debug("fork-server: %zu %s: signal=%d time=%.3fms", request, line,
+					WTERMSIG(status), wall_ms);
+			} else {
+				debug("fork-server: %zu %s: exit=%d time=%.3fms", request, line,
+					WEXITSTATUS(status), wall_ms);
+			}
+		}
+		exit(0);
 	}
 
 	/* Start the execuatable with the given proxy processor template */
@@ -799,41 +1153,64 @@ struct riscv_emulator
 		/* clear floating point exceptions */
 		feclearexcept(FE_ALL_EXCEPT);
 
-		/* instantiate processor, set log options and program counter to entry address */
-		P proc;
+		/* instantiate the guest process and set log options */
+		proxy_process<P> process;
+		P &proc = process.proc;
 		proc.flags = emulator_debug ? processor_flag_emulator_debug : 0;
 		proc.log_flags = log_flags;
-		proc.pc = elf.ehdr.e_entry;
-
-		/* randomise integer register state with 512 bits of entropy */
-		seed_registers(proc, 512);
-
-		/* Find the ELF executable PT_LOAD segments and mmap them into user memory */
-		for (size_t i = 0; i < elf.phdrs.size(); i++) {
-			Elf64_Phdr &phdr = elf.phdrs[i];
-			if (phdr.p_flags & PT_LOAD) {
-				map_load_segment_user(proc, filename.c_str(), phdr);
+		proc.mmu.output->enabled = buffer_output;
+		proc.mmu.clock->start(clock_mode);
+
+		/* Guest threads push syscall records to their own trace rings */
+		if (trace_syscalls) {
+			proc.mmu.trace = std::make_shared<proxy_syscall_trace>();
+			if (!proc.mmu.trace->open(trace_filename)) {
+				panic("trace: fopen: %s: %s", trace_filename.c_str(), strerror(errno));
 			}
+			proc.mmu.trace->summary = trace_summary;
+			proc.mmu.trace_ring = proc.mmu.trace->add_ring();
+			proc.mmu.trace->start();
 		}
 
-		/* Map a stack and set the stack pointer */
-		map_stack(proc, stack_top, stack_size);
+		/* randomise integer register state and AT_RANDOM with 512 bits of entropy */
+		u8 random[proxy_stack_image::random_size];
+		seed_registers(proc, 512, random);
+
+		/* map the executable, heap and stack and start at the entry address */
+		process.load(elf, filename.c_str(), sandbox);
+
+		/* copy argc, argv, envp and auxv to the stack */
+		proxy_stack_image stack;
+		std::vector<u8> stack_buf;
+		stack.init(elf, proxy_stack_top, environ);
+		process.setup_stack(stack, stack_buf, guest_args, random);
+		process.start_threads();
+
+		/* syscalls return EFAULT for unmapped guest buffers, other guest faults exit with 128 + signal */
+		abi_install_fault_handler();
+
+		/* step to the snapshot once, only forked children return */
+		if (fork_marker.size() > 0) {
+			fork_server(process);
+		}
 
 #if defined (ENABLE_GPERFTOOL)
 		ProfilerStart("test-emulate.out");
 #endif
 
 		/* Step the CPU until it halts */
-		while(proc.step(1024));
+		int code = process.run();
 
 #if defined (ENABLE_GPERFTOOL)
 		ProfilerStop();
 #endif
 
-		/* Unmap memory segments */
-		for (auto &seg: proc.mmu.segments) {
-			munmap(seg.first, seg.second);
-		}
+		abi_flush_output(proc);
+
+		/* exit_group leaves other guest threads running, exit before unmapping their memory */
+		if (proc.mmu.threads->exiting) exit(code);
+		process.unmap();
+		if (proc.thread_exit) exit(code);
 	}
 
 	/* Start a specific processor implementation based on ELF type and ISA extensions */
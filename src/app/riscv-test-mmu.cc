@@ -11,10 +11,20 @@
 #include <cstdarg>
 #include <cerrno>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
 #include <string>
 #include <vector>
+#include <map>
+#include <mutex>
 
+#include <poll.h>
+#include <unistd.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 
 #include "riscv-endian.h"
 #include "riscv-types.h"
@@ -23,12 +33,45 @@
 #include "riscv-util.h"
 #include "riscv-pte.h"
 #include "riscv-pma.h"
+#include "riscv-atomic.h"
+#include "riscv-reservation.h"
 #include "riscv-memory.h"
 #include "riscv-cache.h"
+#include "riscv-coherence.h"
 #include "riscv-mmu.h"
+#include "riscv-ring.h"
+#include "riscv-uart.h"
 
 using namespace riscv;
 
+/* device that records the last access and returns a register file */
+struct test_device : user_memory_device<u64>
+{
+	u64 regs[4];
+	u64 last_offset;
+	size_t last_size;
+
+	test_device() : regs(), last_offset(0), last_size(0) {}
+
+	bool load(u64 offset, u64 &val, size_t size)
+	{
+		if (offset >= sizeof(regs)) return false;
+		last_offset = offset;
+		last_size = size;
+		val = regs[offset >> 3];
+		return true;
+	}
+
+	bool store(u64 offset, u64 val, size_t size)
+	{
+		if (offset >= sizeof(regs)) return false;
+		last_offset = offset;
+		last_size = size;
+		regs[offset >> 3] = val;
+		return true;
+	}
+};
+
 int main(int argc, char *argv[])
 {
 	assert(page_shift == 12);
@@ -92,6 +135,225 @@ int main(int argc, char *argv[])
 	// add RAM to the MMU emulation
 	mmu.mem.add_ram(0x0, /*1GB*/0x40000000ULL);
 
+	// RAM is reserved but only committed when touched
+	auto usage = mmu.mem.resident_size();
+	assert(usage.first == 0x40000000ULL && usage.second < usage.first / 2);
+	*(u8*)(mmu.mem.segments.front().uva + 0x20000000ULL) = 1;
+	assert(mmu.mem.resident_size().second > usage.second);
+
+	// dirty page tracking with per page write counts
+	{
+		mmu.mem.enable_dirty_tracking(true);
+		assert(mmu.store(mmu, 0x7000, u32(1)));
+		assert(mmu.store(mmu, 0x7008, u32(2)));
+		assert(mmu.store(mmu, 0x8ffe, u32(3))); /* straddles two pages */
+		assert(mmu.store(mmu, 0x20000, u8(4)));
+		assert(mmu.mem.dirty_write_count(0x7000) == 2);
+		std::vector<std::pair<u64,size_t>> ranges;
+		mmu.mem.for_each_dirty_range([&](u64 mpa, size_t len) {
+			ranges.push_back(std::pair<u64,size_t>(mpa, len));
+		});
+		assert(ranges.size() == 2);
+		assert(ranges[0].first == 0x7000 && ranges[0].second == 3 * page_size);
+		assert(ranges[1].first == 0x20000 && ranges[1].second == page_size);
+		assert(mmu.mem.test_and_clear_dirty(0x20000));
+		assert(!mmu.mem.test_and_clear_dirty(0x20000));
+		size_t count = 0;
+		mmu.mem.for_each_dirty_range([&](u64 mpa, size_t len) { count++; }, true);
+		assert(count == 1);
+		mmu.mem.for_each_dirty_range([&](u64 mpa, size_t len) { count++; });
+		assert(count == 1);
+		u64 v;
+		assert(mmu.load(mmu, 0x7000, v) && !mmu.mem.test_and_clear_dirty(0x7000));
+		mmu.mem.reset_dirty(true);
+		assert(mmu.mem.dirty_write_count(0x7000) == 0);
+	}
+
 	// look up the User Virtual Address for a Machine Physical Adress
 	assert(mmu.mem.mpa_to_uva(0x1000) == mmu.mem.segments.front().uva + 0x1000ULL);
+
+	// small 4-way cache with 4 sets of 64 byte lines for replacement tests
+	typedef as_tagged_cache_rv64<1024,4,64> small_cache_type;
+	const u64 pma_wb = pma_type_main | pma_cache_write_back | pma_cache_alloc_read | pma_cache_alloc_write;
+	const u64 pma_wt = pma_type_main | pma_cache_write_through | pma_cache_alloc_read;
+	const u64 set_stride = small_cache_type::num_entries * small_cache_type::line_size;
+	u8 *ram = (u8*)mmu.mem.segments.front().uva;
+	u64 val;
+
+	for (auto replace : { cache_replace_lru, cache_replace_plru, cache_replace_random }) {
+		std::unique_ptr<small_cache_type> cache(new small_cache_type());
+		cache->replace = replace;
+		*(u64*)(ram + 0x2000) = 0;
+
+		// write back: the write stays in the cache until the line is flushed
+		assert(cache->write(mmu.mem, 0x2000, 0x2, 0, pma_wb, u64(0x1122334455667788ULL)));
+		assert(*(u64*)(ram + 0x2000) == 0);
+		assert(cache->read(mmu.mem, 0x2000, 0x2, 0, pma_wb, val) && val == 0x1122334455667788ULL);
+		assert(cache->stats.write_misses == 1 && cache->stats.read_hits == 1);
+		cache->flush(mmu.mem);
+		assert(*(u64*)(ram + 0x2000) == 0x1122334455667788ULL);
+		assert(cache->stats.writebacks == 1);
+
+		// fill all ways of one set then one more line to force an eviction
+		cache->stats.clear();
+		for (u64 i = 0; i <= small_cache_type::num_ways; i++) {
+			u64 addr = 0x10000 + i * set_stride;
+			assert(cache->read(mmu.mem, addr, addr >> page_shift, 0, pma_wb, val));
+		}
+		assert(cache->stats.read_misses == small_cache_type::num_ways + 1);
+		assert(cache->stats.evictions == 1);
+	}
+
+	// lru evicts the least recently used way
+	{
+		std::unique_ptr<small_cache_type> cache(new small_cache_type());
+		for (u64 i = 0; i < small_cache_type::num_ways; i++) {
+			u64 addr = 0x10000 + i * set_stride;
+			assert(cache->read(mmu.mem, addr, addr >> page_shift, 0, pma_wb, val));
+		}
+		assert(cache->read(mmu.mem, 0x10000, 0x10, 0, pma_wb, val)); /* touch way 0 */
+		u64 addr = 0x10000 + small_cache_type::num_ways * set_stride;
+		assert(cache->read(mmu.mem, addr, addr >> page_shift, 0, pma_wb, val));
+		assert(cache->lookup(0x10000, 0x10, 0) >= 0);
+		assert(cache->lookup(0x10000 + set_stride, (0x10000 + set_stride) >> page_shift, 0) < 0);
+	}
+
+	// write through without write allocate updates memory and bypasses the cache
+	{
+		std::unique_ptr<small_cache_type> cache(new small_cache_type());
+		assert(cache->write(mmu.mem, 0x3000, 0x3, 0, pma_wt, u32(0xdeadbeef)));
+		assert(*(u32*)(ram + 0x3000) == 0xdeadbeef);
+		assert(cache->lookup(0x3000, 0x3, 0) < 0);
+		assert(cache->read(mmu.mem, 0x3000, 0x3, 0, pma_wt, val) && u32(val) == 0xdeadbeef);
+		assert(cache->write(mmu.mem, 0x3000, 0x3, 0, pma_wt, u32(0xcafebabe)));
+		assert(*(u32*)(ram + 0x3000) == 0xcafebabe);
+		assert(cache->stats.write_hits == 1 && cache->stats.writebacks == 0);
+	}
+
+	// loads and stores through the mmu with the L1 caches enabled
+	mmu.cache_enable = true;
+	assert(mmu.store(mmu, 0x4000, u64(42)));
+	assert(mmu.load(mmu, 0x4000, val) && val == 42);
+	assert(mmu.l1_dcache.stats.write_misses == 1 && mmu.l1_dcache.stats.read_hits == 1);
+	mmu.flush_caches();
+	assert(*(u64*)(ram + 0x4000) == 42);
+
+	// two harts in a coherent hierarchy sharing the same memory
+	{
+		typedef mmu_type::cache_hierarchy_type hierarchy_type;
+		typedef mmu_type::cache_type l1_type;
+		std::unique_ptr<hierarchy_type> hier(new hierarchy_type(&mmu.mem, true));
+		std::unique_ptr<l1_type> i0(new l1_type()), d0(new l1_type()), i1(new l1_type()), d1(new l1_type());
+		size_t h0 = hier->add_hart(i0.get(), d0.get());
+		size_t h1 = hier->add_hart(i1.get(), d1.get());
+
+		// a modified line is written back and shared when read by another hart
+		assert(hier->write(h0, 0x5000, pma_wb, u64(7)));
+		assert(hier->read(h1, 0x5000, pma_wb, val) && val == 7);
+		assert(hier->harts[h0].stats.downgrades == 1);
+		assert(d0->get_state(d0->lookup(0x5000, 0x5, 0)) == l1_type::ppn_state_shared);
+
+		// a write to a shared line invalidates the other copy
+		assert(hier->write(h1, 0x5000, pma_wb, u64(8)));
+		assert(d0->lookup(0x5000, 0x5, 0) < 0);
+		assert(hier->harts[h0].stats.invalidations == 1);
+		assert(hier->harts[h0].stats.false_sharing == 0);
+		assert(hier->read(h0, 0x5000, pma_wb, val) && val == 8);
+
+		// writes to disjoint bytes of the same line are false sharing
+		assert(hier->write(h0, 0x6000, pma_wb, u32(1)));
+		assert(hier->write(h1, 0x6008, pma_wb, u32(2)));
+		assert(hier->harts[h0].stats.false_sharing == 1);
+		auto hotspots = hier->hotspots(1);
+		assert(hotspots.size() == 1 && hotspots[0].first == 0x6000);
+
+		// an instruction fetch sees code written by another hart
+		assert(hier->write(h0, 0x7000, pma_wb, u32(0x13)));
+		u32 inst = 0;
+		assert(hier->fetch(h1, 0x7000, pma_wb, inst) && inst == 0x13);
+
+		hier->flush();
+		assert(*(u32*)(ram + 0x6000) == 1 && *(u32*)(ram + 0x6008) == 2);
+	}
+
+	// memory mapped device regions dispatch loads and stores to the device
+	{
+		std::shared_ptr<test_device> dev(new test_device());
+		mmu.mem.add_device(0x80000000ULL, page_size, dev);
+		assert(mmu.mem.mpa_to_segment(0x80000008ULL)->device.get() == dev.get());
+		assert(mmu.mem.mpa_to_uva(0x80000008ULL) == 0);
+		assert(mmu.store(mmu, 0x80000008ULL, u32(0x55aa)));
+		assert(dev->regs[1] == 0x55aa && dev->last_size == 4);
+		assert(mmu.load(mmu, 0x80000008ULL, val) && val == 0x55aa && dev->last_size == 8);
+		assert(!mmu.load(mmu, 0x80000020ULL, val));
+		assert(!mmu.store(mmu, 0x80001000ULL, u8(0)));
+		intptr_t pc_offset;
+		assert(mmu.fetch_inst(mmu, 0x80000000ULL, pc_offset) == 0 && pc_offset == 0);
+	}
+
+	// segments sharing a page fall back to the first matching segment
+	{
+		user_memory<u64> mem;
+		u8 a[64], b[64];
+		mem.add_segment(0x100000, uintptr_t(a), 16, pma_prot_read);
+		mem.add_segment(0x100010, uintptr_t(b), 16, pma_prot_read);
+		assert(mem.mpa_to_uva(0x100004) == uintptr_t(a + 4));
+		assert(mem.mpa_to_uva(0x100014) == uintptr_t(b + 4));
+		assert(mem.mpa_to_uva(0x100024) == 0);
+		assert(mem.mpa_to_segment(0x200000) == nullptr);
+		assert(mem.mpa_to_segment(~0ULL) == nullptr);
+
+		// accesses crossing the end of a segment fail
+		assert(mem.mpa_to_segment(0x100008, 8) == &mem.segments[0]);
+		assert(mem.mpa_to_segment(0x10000c, 8) == nullptr);
+		assert(mem.mpa_to_segment(0x10001c, 8) == nullptr);
+	}
+
+	// harts on their own threads writing one UART through their own mmus
+	{
+		const size_t num_harts = 4, bytes_per_hart = 1000000;
+		int fds[2];
+		assert(pipe(fds) == 0);
+		std::atomic<size_t> counts[256], total(0);
+		for (auto &count : counts) count = 0;
+		std::thread counter([&] {
+			u8 buf[4096];
+			ssize_t n;
+			while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+				for (ssize_t i = 0; i < n; i++) counts[buf[i]]++;
+				total += n;
+			}
+		});
+
+		auto uart = std::make_shared<uart_16550<u64>>(fds[1]);
+		uart->threaded = true;
+		uart->start();
+		mmu.mem.add_device(0x90000000ULL, 8, uart);
+		std::vector<std::unique_ptr<mmu_type>> harts;
+		for (size_t i = 0; i < num_harts; i++) {
+			harts.push_back(std::unique_ptr<mmu_type>(new mmu_type()));
+			harts.back()->mem.share_segments(mmu.mem);
+		}
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < num_harts; i++) {
+			threads.push_back(std::thread([&, i] {
+				mmu_type &m = *harts[i];
+				for (size_t j = 0; j < bytes_per_hart; j++) {
+					assert(m.store(m, 0x90000007ULL, u8(j)));
+					assert(m.store(m, 0x90000000ULL, u8('a' + i)));
+				}
+			}));
+		}
+		for (auto &t : threads) t.join();
+		assert(uart->tx_bytes == num_harts * bytes_per_hart);
+
+		/* check the output before stopping, a corrupted ring never drains */
+		for (int ms = 0; ms < 10000 && total < num_harts * bytes_per_hart; ms++) uart->idle();
+		assert(total == num_harts * bytes_per_hart);
+		for (size_t i = 0; i < num_harts; i++) assert(counts['a' + i] == bytes_per_hart);
+		uart->stop();
+		close(fds[1]);
+		counter.join();
+		close(fds[0]);
+	}
 }
@@ -0,0 +1,371 @@
+//
+//  riscv-test-proxy.cc
+//
+
+#undef NDEBUG
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cinttypes>
+#include <cstdarg>
+#include <cerrno>
+#include <cmath>
+#include <cfenv>
+#include <cassert>
+#include <csetjmp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <map>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+
+#include "riscv-endian.h"
+#include "riscv-types.h"
+#include "riscv-bits.h"
+#include "riscv-format.h"
+#include "riscv-meta.h"
+#include "riscv-util.h"
+#include "riscv-host.h"
+#include "riscv-codec.h"
+#include "riscv-elf.h"
+#include "riscv-elf-file.h"
+#include "riscv-elf-format.h"
+#include "riscv-strings.h"
+#include "riscv-disasm.h"
+#include "riscv-processor.h"
+#include "riscv-alu.h"
+#include "riscv-fpu.h"
+#include "riscv-pte.h"
+#include "riscv-pma.h"
+#include "riscv-atomic.h"
+#include "riscv-reservation.h"
+#include "riscv-memory.h"
+#include "riscv-cache.h"
+#include "riscv-coherence.h"
+#include "riscv-mmu.h"
+#include "riscv-interp.h"
+#include "riscv-ring.h"
+#include "riscv-abi-fault.h"
+#include "riscv-abi-types.h"
+#include "riscv-abi-clock.h"
+#include "riscv-abi-trace.h"
+#include "riscv-unknown-abi.h"
+#include "riscv-abi-syscalls.h"
+#include "riscv-proxy-process.h"
+
+using namespace riscv;
+
+/* guest word at guest address va of a stack image starting at sp */
+static u64 stack_word(const std::vector<u8> &buf, uintptr_t sp, uintptr_t va, size_t word_size)
+{
+	assert(va >= sp && va + word_size <= sp + buf.size());
+	if (word_size == 4) {
+		u32 w;
+		memcpy(&w, buf.data() + (va - sp), sizeof(w));
+		return w;
+	}
+	u64 w;
+	memcpy(&w, buf.data() + (va - sp), sizeof(w));
+	return w;
+}
+
+/* guest string at guest address va of a stack image starting at sp */
+static std::string stack_string(const std::vector<u8> &buf, uintptr_t sp, uintptr_t va)
+{
+	assert(va >= sp && va < sp + buf.size());
+	const char *s = (const char*)buf.data() + (va - sp);
+	assert(memchr(s, 0, buf.size() - (va - sp)));
+	return s;
+}
+
+/* build stack images for each argument count and check the layout seen by the guest */
+static void test_stack_image(int ei_class)
+{
+	size_t word_size = ei_class == ELFCLASS32 ? 4 : 8;
+	elf_file elf;
+	elf.ei_class = ei_class;
+	elf.ehdr.e_entry = 0x10078;
+	elf.ehdr.e_phoff = 0x40;
+	Elf64_Phdr phdr;
+	memset(&phdr, 0, sizeof(phdr));
+	phdr.p_type = PT_LOAD;
+	phdr.p_vaddr = 0x10000;
+	phdr.p_filesz = phdr.p_memsz = 0x1000;
+	elf.phdrs.push_back(phdr);
+
+	const char *envp[] = { "HOME=/", "TERM=dumb", "A=", nullptr };
+	proxy_stack_image image;
+	image.init(elf, proxy_stack_top, (char**)envp);
+	assert(image.word_size == word_size);
+
+	u8 random[proxy_stack_image::random_size];
+	for (size_t i = 0; i < sizeof(random); i++) random[i] = u8(0xa0 + i);
+
+	std::vector<u8> buf;
+	std::vector<std::string> args;
+	for (size_t n = 0; n < 8; n++) {
+		uintptr_t sp = image.build(buf, args, random);
+		assert((sp & 15) == 0);
+		assert(sp + buf.size() == proxy_stack_top);
+
+		/* argc and argv */
+		uintptr_t p = sp;
+		assert(stack_word(buf, sp, p, word_size) == args.size());
+		p += word_size;
+		for (auto &arg : args) {
+			assert(stack_string(buf, sp, stack_word(buf, sp, p, word_size)) == arg);
+			p += word_size;
+		}
+		assert(stack_word(buf, sp, p, word_size) == 0);
+		p += word_size;
+
+		/* envp */
+		for (const char **ep = envp; *ep; ep++) {
+			assert(stack_string(buf, sp, stack_word(buf, sp, p, word_size)) == *ep);
+			p += word_size;
+		}
+		assert(stack_word(buf, sp, p, word_size) == 0);
+		p += word_size;
+
+		/* auxv */
+		std::map<u64,u64> auxv;
+		for (;;) {
+			u64 type = stack_word(buf, sp, p, word_size);
+			u64 val = stack_word(buf, sp, p + word_size, word_size);
+			p += word_size * 2;
+			if (type == AT_NULL) break;
+			auxv[type] = val;
+		}
+		assert(auxv[AT_PHDR] == 0x10040);
+		assert(auxv[AT_PHENT] == (ei_class == ELFCLASS32 ? sizeof(Elf32_Phdr) : sizeof(Elf64_Phdr)));
+		assert(auxv[AT_PHNUM] == 1);
+		assert(auxv[AT_PAGESZ] == proxy_stack_image::page_size);
+		assert(auxv[AT_ENTRY] == 0x10078);
+
+		/* AT_RANDOM is the top of the stack, above every string */
+		assert(auxv[AT_RANDOM] == proxy_stack_top - proxy_stack_image::random_size);
+		assert(memcmp(buf.data() + (auxv[AT_RANDOM] - sp), random, sizeof(random)) == 0);
+		assert(p <= auxv[AT_RANDOM]);
+
+		args.push_back(std::string(n * 3 + 1, char('a' + n)));
+	}
+}
+
+/* bucket bounds and percentiles of the syscall latency histogram */
+static void test_trace_histogram()
+{
+	typedef abi_trace_histogram H;
+
+	/* each value falls in a bucket whose upper bound is within 1/16 above it */
+	std::vector<u64> vals;
+	for (u64 v = 0; v < 4096; v++) vals.push_back(v);
+	for (size_t e = 12; e < 64; e++) {
+		u64 p = 1ULL << e;
+		vals.push_back(p - 1);
+		vals.push_back(p);
+		vals.push_back(p + 1);
+		vals.push_back(p + (p >> 1) + 12345);
+	}
+	vals.push_back(~0ULL);
+	for (u64 v : vals) {
+		size_t i = H::index(v);
+		assert(i < H::bucket_count);
+		assert(H::upper(i) >= v);
+		assert(H::upper(i) - v <= v / H::sub_count);
+		assert(i == 0 || H::upper(i - 1) < v);
+	}
+	for (size_t i = 0; i < H::bucket_count; i++) {
+		assert(H::index(H::upper(i)) == i);
+	}
+
+	/* an empty histogram reports zero */
+	H empty;
+	assert(empty.percentile(0.5) == 0 && empty.percentile(1.0) == 0);
+
+	/* percentiles of 1..1000 are bucket bounds at or above the exact value, capped at max */
+	H hist;
+	for (u64 v = 1; v <= 1000; v++) hist.add(v);
+	assert(hist.count == 1000 && hist.total == 500500 && hist.max == 1000);
+	for (double p : { 0.01, 0.25, 0.5, 0.9, 0.99 }) {
+		u64 exact = u64(p * 1000 + 0.5), est = hist.percentile(p);
+		assert(est >= exact && est - exact <= exact / H::sub_count);
+	}
+	assert(hist.percentile(1.0) == 1000);
+	assert(hist.percentile(0.0) == 1);
+
+	/* a single outlier is the maximum, not its bucket bound */
+	H outlier;
+	for (int i = 0; i < 99; i++) outlier.add(10);
+	outlier.add(1000001);
+	assert(outlier.percentile(0.5) == 10);
+	assert(outlier.percentile(1.0) == 1000001);
+}
+
+/* tracked host segments after unmapping a range */
+static void test_remove_segments()
+{
+	typedef std::vector<std::pair<void*,size_t>> segment_list;
+	auto seg = [](uintptr_t addr, size_t len) { return std::pair<void*,size_t>((void*)addr, len); };
+
+	mmu_proxy mmu;
+	mmu.segments = { seg(0x10000, 0x4000), seg(0x20000, 0x1000), seg(0x30000, 0x3000) };
+
+	/* a range touching no segment leaves them alone */
+	mmu.remove_segments(0x14000, 0xc000);
+	assert(mmu.segments == segment_list({ seg(0x10000, 0x4000), seg(0x20000, 0x1000), seg(0x30000, 0x3000) }));
+
+	/* the middle of a segment splits it */
+	mmu.remove_segments(0x11000, 0x1000);
+	assert(mmu.segments == segment_list({ seg(0x10000, 0x1000), seg(0x12000, 0x2000),
+		seg(0x20000, 0x1000), seg(0x30000, 0x3000) }));
+
+	/* a range covering one segment and the ends of two others */
+	mmu.remove_segments(0x13000, 0x1e000);
+	assert(mmu.segments == segment_list({ seg(0x10000, 0x1000), seg(0x12000, 0x1000), seg(0x31000, 0x2000) }));
+
+	/* everything */
+	mmu.remove_segments(0, 0x40000);
+	assert(mmu.segments.empty());
+}
+
+/* first fit allocation from the mmap areas and reuse of released ranges */
+static void test_mmap_free()
+{
+	typedef std::map<uintptr_t,uintptr_t> range_map;
+
+	mmu_proxy mmu;
+	assert(mmu.mmap_alloc(0x1000) == 0);
+
+	/* two areas either side of a stack */
+	mmu.add_mmap_area(0x40000000, 0x77000000);
+	mmu.add_mmap_area(0x78000000, 0x80000000);
+	assert(mmu.mmap_free == range_map({ { 0x40000000, 0x77000000 }, { 0x78000000, 0x80000000 } }));
+
+	uintptr_t a = mmu.mmap_alloc(0x10000);
+	assert(a == 0x40000000);
+	mmu.mmap_reserve(a, a + 0x10000);
+	uintptr_t b = mmu.mmap_alloc(0x10000);
+	assert(b == 0x40010000);
+	mmu.mmap_reserve(b, b + 0x10000);
+
+	/* a released range is reused and coalesced with its neighbours */
+	mmu.mmap_release(a, a + 0x10000);
+	assert(mmu.mmap_alloc(0x10000) == a);
+	assert(mmu.mmap_alloc(0x20000) == b + 0x10000);
+	mmu.mmap_release(b, b + 0x10000);
+	assert(mmu.mmap_free == range_map({ { 0x40000000, 0x77000000 }, { 0x78000000, 0x80000000 } }));
+
+	/* requests too large for the first area come from the second, too large for both fail */
+	assert(mmu.mmap_alloc(0x38000000) == 0);
+	mmu.mmap_reserve(0x40000000, 0x76ff0000);
+	assert(mmu.mmap_alloc(0x20000) == 0x78000000);
+	assert(mmu.mmap_alloc(0x8000000) == 0x78000000);
+	assert(mmu.mmap_alloc(0x8001000) == 0);
+
+	/* releases are clipped to the areas, so the stack between them never becomes free */
+	mmu.mmap_release(0x70000000, 0x7a000000);
+	assert(mmu.mmap_free == range_map({ { 0x70000000, 0x77000000 }, { 0x78000000, 0x80000000 } }));
+	assert(mmu.mmap_alloc(0x8000000) == 0x78000000);
+
+	/* a reservation spanning several ranges splits the partial ones */
+	mmu.mmap_reserve(0x76000000, 0x79000000);
+	assert(mmu.mmap_free == range_map({ { 0x70000000, 0x76000000 }, { 0x79000000, 0x80000000 } }));
+}
+
+/* the registers, mmu and flags the mmap handler uses */
+template <int XLEN>
+struct test_mmap_proc
+{
+	enum { xlen = XLEN };
+
+	u64 ireg[32];
+	mmu_proxy mmu;
+	u64 flags;
+
+	test_mmap_proc() : ireg(), flags(0) {}
+};
+
+/* map the third page of a file, RV32 mmap2 passes the offset in pages and RV64 mmap in bytes */
+template <int XLEN> static void test_mmap_offset(int fd, u64 offset_arg)
+{
+	test_mmap_proc<XLEN> proc;
+	assert(proc.mmu.reserve_sandbox(32, 0x40000000));
+	proc.ireg[riscv_ireg_a0] = 0;
+	proc.ireg[riscv_ireg_a1] = 4096;
+	proc.ireg[riscv_ireg_a2] = abi_prot_read;
+	proc.ireg[riscv_ireg_a3] = abi_map_private;
+	proc.ireg[riscv_ireg_a4] = fd;
+	proc.ireg[riscv_ireg_a5] = offset_arg;
+	abi_sys_mmap(proc);
+	u64 addr = proc.ireg[riscv_ireg_a0];
+	assert(addr == 0x40000000);
+	const u8 *page = (const u8*)proc.mmu.host_addr(addr);
+	assert(page[0] == 2 && page[4095] == 2);
+
+	/* a byte offset that is not page aligned is rejected */
+	if (XLEN == 64) {
+		proc.ireg[riscv_ireg_a0] = 0;
+		proc.ireg[riscv_ireg_a5] = 0x2001;
+		abi_sys_mmap(proc);
+		assert(proc.ireg[riscv_ireg_a0] == u64(-EINVAL));
+	}
+
+	for (auto &seg : proc.mmu.segments) munmap(seg.first, seg.second);
+}
+
+static void test_mmap_file()
+{
+	char path[] = "/tmp/riscv-test-proxy-XXXXXX";
+	int fd = mkstemp(path);
+	assert(fd >= 0);
+	unlink(path);
+	u8 page[4096];
+	for (u8 i = 0; i < 3; i++) {
+		memset(page, i, sizeof(page));
+		assert(write(fd, page, sizeof(page)) == ssize_t(sizeof(page)));
+	}
+	test_mmap_offset<32>(fd, 2);
+	test_mmap_offset<64>(fd, 0x2000);
+	close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+	// initial stack layout for RV32 and RV64
+	test_stack_image(ELFCLASS32);
+	test_stack_image(ELFCLASS64);
+
+	// syscall trace latency histogram
+	test_trace_histogram();
+
+	// proxy mmu segment tracking and mmap allocation
+	test_remove_segments();
+	test_mmap_free();
+	test_mmap_file();
+}
@@ -0,0 +1,50 @@
+//
+//  riscv-atomic.h
+//
+
+#ifndef riscv_atomic_h
+#define riscv_atomic_h
+
+namespace riscv {
+
+	/*
+	 * Map the aq and rl bits of an atomic instruction to a host memory order.
+	 *
+	 * The __atomic builtins need the memory order as a constant, so fn is
+	 * called with a std::integral_constant holding the order and uses
+	 * decltype(mo)::value as the builtin's memorder argument. aq and rl
+	 * together are sequentially consistent. Loads cannot have release
+	 * semantics and stores cannot have acquire semantics, so lr.rl and
+	 * sc.aq are strengthened to sequentially consistent.
+	 */
+
+	template <int order> using amo_memory_order = std::integral_constant<int,order>;
+
+	template <typename F>
+	inline auto amo_mo(bool aq, bool rl, F fn) -> decltype(fn(amo_memory_order<__ATOMIC_RELAXED>()))
+	{
+		if (aq && rl) return fn(amo_memory_order<__ATOMIC_SEQ_CST>());
+		if (aq) return fn(amo_memory_order<__ATOMIC_ACQUIRE>());
+		if (rl) return fn(amo_memory_order<__ATOMIC_RELEASE>());
+		return fn(amo_memory_order<__ATOMIC_RELAXED>());
+	}
+
+	template <typename F>
+	inline auto amo_load_mo(bool aq, bool rl, F fn) -> decltype(fn(amo_memory_order<__ATOMIC_RELAXED>()))
+	{
+		if (rl) return fn(amo_memory_order<__ATOMIC_SEQ_CST>());
+		if (aq) return fn(amo_memory_order<__ATOMIC_ACQUIRE>());
+		return fn(amo_memory_order<__ATOMIC_RELAXED>());
+	}
+
+	template <typename F>
+	inline auto amo_store_mo(bool aq, bool rl, F fn) -> decltype(fn(amo_memory_order<__ATOMIC_RELAXED>()))
+	{
+		if (aq) return fn(amo_memory_order<__ATOMIC_SEQ_CST>());
+		if (rl) return fn(amo_memory_order<__ATOMIC_RELEASE>());
+		return fn(amo_memory_order<__ATOMIC_RELAXED>());
+	}
+
+}
+
+#endif
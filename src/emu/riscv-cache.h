@@ -118,6 +118,40 @@ namespace riscv {
 	template <const size_t tlb_entries> using as_tagged_tlb_rv64 = as_tagged_tlb<tlb_entries,u64,as_tagged_va_ppn_rv64>;
 
 
+	/* cache replacement policy */
+
+	enum cache_replace
+	{
+		cache_replace_lru,    /* least recently used */
+		cache_replace_plru,   /* tree pseudo least recently used */
+		cache_replace_random  /* random */
+	};
+
+
+	/* cache statistics */
+
+	struct cache_stats
+	{
+		u64 read_hits;
+		u64 read_misses;
+		u64 write_hits;
+		u64 write_misses;
+		u64 evictions;
+		u64 writebacks;
+
+		cache_stats() { clear(); }
+
+		void clear()
+		{
+			read_hits = read_misses = write_hits = write_misses = 0;
+			evictions = writebacks = 0;
+		}
+
+		u64 accesses() const { return read_hits + read_misses + write_hits + write_misses; }
+		u64 misses() const { return read_misses + write_misses; }
+	};
+
+
 	/* address space and physically tagged, virtually indexed cache */
 
 	template <typename UX, typename AST_PT_VA, const size_t cache_size, const size_t cache_ways, const size_t cache_line_size, typename MEMORY = user_memory<UX>>
@@ -126,6 +160,8 @@ namespace riscv {
 		static_assert(ispow2(cache_size), "cache_size must be a power of 2");
 		static_assert(ispow2(cache_ways), "cache_ways must be a power of 2");
 		static_assert(ispow2(cache_line_size), "cache_line_size must be a power of 2");
+		static_assert(cache_ways <= 64, "cache_ways must be <= 64");
+		static_assert(cache_line_size <= page_size, "cache_line_size must be <= page_size");
 
 		typedef AST_PT_VA as_tagged_va_ppn_type;
 		typedef MEMORY memory_type;
@@ -148,24 +184,61 @@ namespace riscv {
 			asid_bits =           AST_PT_VA::asid_bits,
 			ppn_bits =            AST_PT_VA::ppn_bits,
 
-			/* TBA cache state (encode in uppermost 2 bits of ppn) */
+			/* cache state (encoded in uppermost 2 bits of ppn) */
 			ppn_state_modified =  UX(0) << (ppn_bits - 2), /* modified */
 			ppn_state_exclusive = UX(1) << (ppn_bits - 2), /* exclusive */
 			ppn_state_shared =    UX(2) << (ppn_bits - 2), /* shared */
 			ppn_state_invalid =   UX(3) << (ppn_bits - 2), /* invalid */
 			ppn_state_mask    =   UX(3) << (ppn_bits - 2),
+			ppn_mask          =   (UX(1) << (ppn_bits - 2)) - 1,
 		};
 
 		// TODO - the cache index and the cache data will be mapped into the
 		// machine mode physical address space using user_memory::add_segment
 		as_tagged_va_ppn_type cache_key[num_entries * num_ways];
 		u8 cache_data[num_entries * num_ways * cache_line_size];
+		u8 cache_age[num_entries * num_ways];   /* lru rank, 0 is most recent */
+		u64 cache_plru[num_entries];            /* plru tree bits per set */
+
+		cache_replace replace;
+		cache_stats stats;
+		u64 random_state;
+
+		as_tagged_cache() : replace(cache_replace_lru), random_state(0x9e3779b97f4a7c15ULL)
+		{
+			for (size_t i = 0; i < num_entries * num_ways; i++) {
+				cache_age[i] = u8(i & (num_ways - 1));
+			}
+			memset(cache_plru, 0, sizeof(cache_plru));
+		}
+
+		static UX line_state(as_tagged_va_ppn_type *ent) { return UX(ent->ppn) & ppn_state_mask; }
+		static UX line_ppn(as_tagged_va_ppn_type *ent) { return UX(ent->ppn) & ppn_mask; }
+		static UX line_mpa(as_tagged_va_ppn_type *ent) {
+			return (line_ppn(ent) << page_shift) | (ent->va & ~page_mask);
+		}
+
+		u8* line_data(size_t line) { return cache_data + (line << cache_line_shift); }
+		UX get_state(size_t line) { return line_state(cache_key + line); }
+		void set_state(size_t line, UX state) { cache_key[line].ppn = line_ppn(cache_key + line) | state; }
+
+		/* write the line back to memory if it is modified and mark it as invalid */
+		void evict_line(memory_type &mem, size_t line)
+		{
+			as_tagged_va_ppn_type *ent = cache_key + line;
+			if (line_state(ent) == ppn_state_invalid) return;
+			if (line_state(ent) == ppn_state_modified) {
+				uintptr_t uva = mem.mpa_to_uva(line_mpa(ent));
+				if (uva) memcpy((void*)uva, line_data(line), line_size);
+				stats.writebacks++;
+			}
+			cache_key[line] = as_tagged_va_ppn_type();
+		}
 
 		void flush(memory_type &mem)
 		{
 			for (size_t i = 0; i < num_entries * num_ways; i++) {
-				// flush this line to memory
-				cache_key[i] = as_tagged_va_ppn_type();
+				evict_line(mem, i);
 			}
 		}
 
@@ -173,27 +246,213 @@ namespace riscv {
 		{
 			for (size_t i = 0; i < num_entries * num_ways; i++) {
 				if (cache_key[i].asid != asid) continue;
-				// flush this line to memory
-				cache_key[i] = as_tagged_va_ppn_type();
+				evict_line(mem, i);
 			}
 		}
 
-		u8* get_cache_line(memory_type &mem, UX vaddr, UX ppn, UX asid)
+		/* update replacement state for a way in a set */
+		void touch(size_t entry, size_t way)
 		{
-			UX va = vaddr & cache_line_mask;
-			UX entry = vaddr & num_entries_mask;
-			AST_PT_VA *ent = cache_key + (entry << num_ways_shift);
+			switch (replace) {
+				case cache_replace_lru: {
+					u8 *age = cache_age + (entry << num_ways_shift);
+					u8 prev = age[way];
+					for (size_t i = 0; i < num_ways; i++) {
+						if (age[i] < prev) age[i]++;
+					}
+					age[way] = 0;
+					break;
+				}
+				case cache_replace_plru: {
+					// walk from the root setting each node to point away from way
+					u64 &tree = cache_plru[entry];
+					for (size_t node = 1, level = num_ways_shift; level > 0; level--) {
+						size_t bit = (way >> (level - 1)) & 1;
+						if (bit) tree &= ~(1ULL << node); else tree |= (1ULL << node);
+						node = (node << 1) | bit;
+					}
+					break;
+				}
+				case cache_replace_random:
+					break;
+			}
+		}
+
+		/* choose a way to evict, preferring invalid ways */
+		size_t victim(size_t entry)
+		{
+			as_tagged_va_ppn_type *ent = cache_key + (entry << num_ways_shift);
 			for (size_t i = 0; i < num_ways; i++) {
-				if (ent->va == va && ent->ppn == ppn && ent->asid == asid) {
-					return cache_data + entry << cache_line_shift +
-						i << (cache_line_shift + num_ways_shift);
+				if (line_state(ent + i) == ppn_state_invalid) return i;
+			}
+			switch (replace) {
+				case cache_replace_lru: {
+					u8 *age = cache_age + (entry << num_ways_shift);
+					size_t way = 0;
+					for (size_t i = 1; i < num_ways; i++) {
+						if (age[i] > age[way]) way = i;
+					}
+					return way;
+				}
+				case cache_replace_plru: {
+					// follow the tree bits towards the least recently used way
+					u64 tree = cache_plru[entry];
+					size_t node = 1;
+					for (size_t level = 0; level < num_ways_shift; level++) {
+						node = (node << 1) | ((tree >> node) & 1);
+					}
+					return node - num_ways;
 				}
-				ent++;
+				case cache_replace_random:
+				default:
+					random_state ^= random_state << 13;
+					random_state ^= random_state >> 7;
+					random_state ^= random_state << 17;
+					return random_state & (num_ways - 1);
+			}
+		}
+
+		/* find the line for the given vaddr+ppn+asid, returns -1 on miss */
+		ssize_t lookup(UX vaddr, UX ppn, UX asid)
+		{
+			UX va = vaddr & cache_line_mask;
+			size_t entry = (vaddr >> cache_line_shift) & num_entries_mask;
+			size_t line = entry << num_ways_shift;
+			as_tagged_va_ppn_type *ent = cache_key + line;
+			for (size_t i = 0; i < num_ways; i++, ent++) {
+				if (ent->va == va && line_ppn(ent) == ppn && ent->asid == asid &&
+					line_state(ent) != ppn_state_invalid)
+				{
+					touch(entry, i);
+					return line + i;
+				}
+			}
+			return -1;
+		}
+
+		/* evict a victim and fill it from memory, returns -1 if not backed by memory */
+		ssize_t fill(memory_type &mem, UX vaddr, UX ppn, UX asid)
+		{
+			UX va = vaddr & cache_line_mask;
+			size_t entry = (vaddr >> cache_line_shift) & num_entries_mask;
+			uintptr_t uva = mem.mpa_to_uva((ppn << page_shift) | (va & ~page_mask));
+			if (!uva) return -1;
+			size_t way = victim(entry);
+			size_t line = (entry << num_ways_shift) + way;
+			if (line_state(cache_key + line) != ppn_state_invalid) {
+				evict_line(mem, line);
+				stats.evictions++;
+			}
+			memcpy(line_data(line), (void*)uva, line_size);
+			cache_key[line] = as_tagged_va_ppn_type(va, asid, ppn | ppn_state_exclusive);
+			touch(entry, way);
+			return line;
+		}
+
+		/*
+		 * tag only access used for outer cache levels in statistics mode.
+		 * allocates on miss without copying data, returns true on hit.
+		 */
+		bool probe(UX vaddr, UX ppn, UX asid, bool write)
+		{
+			if (lookup(vaddr, ppn, asid) >= 0) {
+				if (write) stats.write_hits++; else stats.read_hits++;
+				return true;
+			}
+			if (write) stats.write_misses++; else stats.read_misses++;
+			size_t entry = (vaddr >> cache_line_shift) & num_entries_mask;
+			size_t way = victim(entry);
+			size_t line = (entry << num_ways_shift) + way;
+			if (get_state(line) != ppn_state_invalid) {
+				if (get_state(line) == ppn_state_modified) stats.writebacks++;
+				stats.evictions++;
+			}
+			cache_key[line] = as_tagged_va_ppn_type(vaddr & cache_line_mask, asid,
+				ppn | (write ? ppn_state_modified : ppn_state_exclusive));
+			touch(entry, way);
+			return false;
+		}
+
+		/* return the line for vaddr, filling on miss, or nullptr if not backed by memory */
+		u8* get_cache_line(memory_type &mem, UX vaddr, UX ppn, UX asid)
+		{
+			ssize_t line = lookup(vaddr, ppn, asid);
+			if (line < 0) line = fill(mem, vaddr, ppn, asid);
+			return line < 0 ? nullptr : line_data(line);
+		}
+
+		/*
+		 * read through the cache using the allocation policy in the PMA flags.
+		 * regions without pma_cache_alloc_read are read around the cache.
+		 */
+		template <typename T> bool read(memory_type &mem, UX vaddr, UX ppn, UX asid, UX pma, T &val)
+		{
+			size_t offset = vaddr & ~cache_line_mask;
+			if (offset + sizeof(T) > line_size) {
+				return split_access(mem, vaddr, ppn, asid, pma, (u8*)&val, sizeof(T), false);
+			}
+			ssize_t line = lookup(vaddr, ppn, asid);
+			if (line >= 0) {
+				stats.read_hits++;
+			} else {
+				stats.read_misses++;
+				if (!(pma & pma_cache_alloc_read)) {
+					uintptr_t uva = mem.mpa_to_uva((ppn << page_shift) | (vaddr & ~page_mask));
+					if (!uva) return false;
+					memcpy(&val, (void*)uva, sizeof(T));
+					return true;
+				}
+				if ((line = fill(mem, vaddr, ppn, asid)) < 0) return false;
+			}
+			memcpy(&val, line_data(line) + offset, sizeof(T));
+			return true;
+		}
+
+		/*
+		 * write through the cache using the write and allocation policies in the
+		 * PMA flags. pma_cache_write_back and pma_cache_write_combine keep modified
+		 * lines until eviction, pma_cache_write_through also updates memory, and
+		 * regions without pma_cache_alloc_write write around the cache on a miss.
+		 */
+		template <typename T> bool write(memory_type &mem, UX vaddr, UX ppn, UX asid, UX pma, T val)
+		{
+			size_t offset = vaddr & ~cache_line_mask;
+			if (offset + sizeof(T) > line_size) {
+				return split_access(mem, vaddr, ppn, asid, pma, (u8*)&val, sizeof(T), true);
+			}
+			uintptr_t uva = 0;
+			ssize_t line = lookup(vaddr, ppn, asid);
+			if (line >= 0) {
+				stats.write_hits++;
+			} else {
+				stats.write_misses++;
+				if (!(pma & pma_cache_alloc_write)) {
+					if (!(uva = mem.mpa_to_uva((ppn << page_shift) | (vaddr & ~page_mask)))) return false;
+					memcpy((void*)uva, &val, sizeof(T));
+					return true;
+				}
+				if ((line = fill(mem, vaddr, ppn, asid)) < 0) return false;
+			}
+			memcpy(line_data(line) + offset, &val, sizeof(T));
+			if (pma & (pma_cache_write_back | pma_cache_write_combine)) {
+				set_state(line, ppn_state_modified);
+			} else {
+				if (!(uva = mem.mpa_to_uva((ppn << page_shift) | (vaddr & ~page_mask)))) return false;
+				memcpy((void*)uva, &val, sizeof(T));
+			}
+			return true;
+		}
+
+		/* access that straddles a cache line is split into byte accesses */
+		bool split_access(memory_type &mem, UX vaddr, UX ppn, UX asid, UX pma, u8 *buf, size_t len, bool is_write)
+		{
+			for (size_t i = 0; i < len; i++) {
+				UX va = vaddr + i;
+				UX pn = ppn + ((va >> page_shift) - (vaddr >> page_shift));
+				if (!(is_write ? write(mem, va, pn, asid, pma, buf[i]) :
+					read(mem, va, pn, asid, pma, buf[i]))) return false;
 			}
-			// choose a way to flush
-			// flush the line to memory
-			// fetch the new line from memory
-			return nullptr;
+			return true;
 		}
 	};
 
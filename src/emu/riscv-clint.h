@@ -0,0 +1,336 @@
+//
+//  riscv-clint.h
+//
+
+#ifndef riscv_clint_h
+#define riscv_clint_h
+
+namespace riscv {
+
+	/* source of mtime */
+
+	enum clint_time_mode
+	{
+		clint_time_instret,   /* virtual time derived from retired instructions */
+		clint_time_wallclock, /* host monotonic clock */
+		clint_time_virtual    /* virtual time advanced by the round-robin scheduler */
+	};
+
+	/*
+	 * Core local interruptor with a memory mapped mtime register and one
+	 * memory mapped mtimecmp register per hart.
+	 *
+	 * In instret mode mtime advances one tick every instret_per_tick retired
+	 * instructions plus any time skipped while all harts were waiting in wfi,
+	 * so timer deadlines can be converted to an instret deadline and checked
+	 * with a single compare. In wallclock mode mtime follows the host clock
+	 * and deadlines are polled every event interval. Harts running on their
+	 * own host threads must use wallclock mode, where wfi blocks the calling
+	 * thread until its deadline or an event such as an IPI arrives. In virtual
+	 * mode mtime follows virtual_instret, which the round-robin scheduler
+	 * advances by one quantum per round, deadlines are polled as in wallclock
+	 * mode and wfi parks the hart until the scheduler wakes it.
+	 *
+	 * Each hart also has a memory mapped msip register used to send IPIs.
+	 *
+	 * A hart in wfi with no timer deadline is halted only when no other
+	 * hart is running and device_active reports that no device, such as
+	 * a UART with open input or a block device with requests in flight,
+	 * can still raise an interrupt. Otherwise it waits for an event.
+	 *
+	 * H is the hart state type (processor_priv) providing instret, mtimecmp,
+	 * mip, timer_instret, wfi_waiting and raise_event. Stores from other
+	 * harts reach mip and timer_instret only as events for the owning hart.
+	 */
+
+	template <typename UX, typename H>
+	struct clint
+	{
+		typedef user_memory_device<UX> memory_device_type;
+
+		enum : u64 {
+			timebase_hz = 10000000,     /* mtime frequency */
+			no_deadline = ~0ULL
+		};
+
+		enum : u64 {
+			wfi_poll_ns = 50000         /* longest sleep between event polls in wfi */
+		};
+
+		/* device view of the mtime or mtimecmp registers, base_hart is the first timecmp */
+		struct clint_region : memory_device_type
+		{
+			clint *c;
+			bool timecmp;
+			size_t base_hart;
+
+			clint_region(clint *c, bool timecmp, size_t base_hart = 0) :
+				c(c), timecmp(timecmp), base_hart(base_hart) {}
+
+			bool load(UX offset, u64 &val, size_t size)
+			{
+				size_t hart = base_hart + (offset >> 3);
+				if (timecmp && hart >= c->harts.size()) return false;
+				u64 reg = timecmp ? c->harts[hart]->mtimecmp : c->mtime(*c->harts[0]);
+				val = reg >> ((offset & 7) << 3);
+				return true;
+			}
+
+			bool store(UX offset, u64 val, size_t size)
+			{
+				size_t hart = base_hart + (offset >> 3);
+				if (!timecmp || hart >= c->harts.size()) return false;
+				H &h = *c->harts[hart];
+				size_t shift = (offset & 7) << 3;
+				u64 mask = (size == 8 ? ~0ULL : ((1ULL << (size << 3)) - 1)) << shift;
+				c->set_mtimecmp(h, (h.mtimecmp & ~mask) | ((val << shift) & mask));
+				return true;
+			}
+		};
+
+		/* device view of the 32-bit msip registers, writing bit 0 sends an IPI */
+		struct ipi_region : memory_device_type
+		{
+			clint *c;
+			size_t base_hart;
+
+			ipi_region(clint *c, size_t base_hart = 0) : c(c), base_hart(base_hart) {}
+
+			bool load(UX offset, u64 &val, size_t size)
+			{
+				size_t hart = base_hart + (offset >> 2);
+				if (hart >= c->harts.size()) return false;
+				val = c->harts[hart]->mip.ip.msip;
+				return true;
+			}
+
+			bool store(UX offset, u64 val, size_t size)
+			{
+				size_t hart = base_hart + (offset >> 2);
+				if (hart >= c->harts.size()) return false;
+				H &h = *c->harts[hart];
+				if ((offset & 3) != 0) return true;
+				if (val & 1) {
+					h.raise_event(processor_event_software, processor_event_software_clear);
+					c->ipi_count++;
+				} else {
+					/* msip is cleared by the receiving hart's handler */
+					h.raise_event(processor_event_software_clear, processor_event_software);
+				}
+				return true;
+			}
+		};
+
+		clint_time_mode mode;
+		u64 instret_per_tick;
+		u64 time_skip;          /* ticks skipped by wfi fast-forward */
+		u64 wallclock_base;     /* host nanoseconds at start */
+		u64 virtual_instret;    /* scheduler rounds times quantum in virtual mode */
+		u64 event_interval;     /* instructions between deadline polls in wallclock mode */
+		std::vector<H*> harts;
+		std::atomic<size_t> harts_waiting;
+		std::atomic<size_t> harts_active; /* harts that have not stopped */
+		std::function<bool()> device_active; /* a device may still raise an interrupt */
+
+		u64 skipped_ticks;      /* statistics */
+		std::atomic<u64> wfi_count;
+		std::atomic<u64> ipi_count;
+
+		clint(clint_time_mode mode = clint_time_instret, u64 instret_per_tick = 100) :
+			mode(mode), instret_per_tick(instret_per_tick), time_skip(0),
+			wallclock_base(host_ns()), virtual_instret(0), event_interval(1024), harts_waiting(0), harts_active(0),
+			skipped_ticks(0), wfi_count(0), ipi_count(0) {}
+
+		static u64 host_ns()
+		{
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return u64(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+		}
+
+		/* add a hart, returns the hart index */
+		size_t add_hart(H *hart)
+		{
+			harts.push_back(hart);
+			harts_active++;
+			return harts.size() - 1;
+		}
+
+		/* a hart has stopped executing and will no longer wake waiting harts */
+		void hart_stopped()
+		{
+			harts_active--;
+		}
+
+		/* register the mtime region */
+		template <typename MEMORY>
+		void add_mtime(MEMORY &mem, UX mtime_addr)
+		{
+			mem.add_device(mtime_addr, 8,
+				std::shared_ptr<memory_device_type>(new clint_region(this, false)));
+		}
+
+		/* register the mtime region and contiguous mtimecmp registers for all harts */
+		template <typename MEMORY>
+		void add_regions(MEMORY &mem, UX mtime_addr, UX mtimecmp_addr)
+		{
+			add_mtime(mem, mtime_addr);
+			mem.add_device(mtimecmp_addr, harts.size() << 3,
+				std::shared_ptr<memory_device_type>(new clint_region(this, true)));
+		}
+
+		/* register a single hart's mtimecmp register at a configured address */
+		template <typename MEMORY>
+		void add_timecmp(MEMORY &mem, UX mtimecmp_addr, size_t hart)
+		{
+			mem.add_device(mtimecmp_addr, 8,
+				std::shared_ptr<memory_device_type>(new clint_region(this, true, hart)));
+		}
+
+		/* register msip registers for harts starting at base_hart */
+		template <typename MEMORY>
+		void add_ipi(MEMORY &mem, UX msip_addr, size_t base_hart, size_t count)
+		{
+			mem.add_device(msip_addr, count << 2,
+				std::shared_ptr<memory_device_type>(new ipi_region(this, base_hart)));
+		}
+
+		u64 mtime(const H &hart)
+		{
+			if (mode == clint_time_wallclock) {
+				return (host_ns() - wallclock_base) / (1000000000ULL / timebase_hz);
+			}
+			return time_skip + (mode == clint_time_virtual ? virtual_instret : hart.instret) / instret_per_tick;
+		}
+
+		bool devices_active()
+		{
+			return device_active && device_active();
+		}
+
+		/* no timer deadline, wait for a device event, false if no device can raise one */
+		bool wfi_device(H &hart)
+		{
+			while (hart.pending_events.load(std::memory_order_acquire) == 0) {
+				if (!devices_active()) return hart.pending_events.load(std::memory_order_acquire) != 0;
+				struct timespec ts = { 0, long(wfi_poll_ns) };
+				nanosleep(&ts, nullptr);
+			}
+			return true;
+		}
+
+		/* instret at which the hart must next check its timer */
+		u64 deadline_instret(const H &hart)
+		{
+			if (hart.mtimecmp == no_deadline) return no_deadline;
+			if (mode != clint_time_instret) return hart.instret + event_interval;
+			if (hart.mtimecmp <= time_skip) return hart.instret;
+			u64 ticks = hart.mtimecmp - time_skip;
+			return ticks > no_deadline / instret_per_tick ? no_deadline : ticks * instret_per_tick;
+		}
+
+		/* writing mtimecmp clears the timer interrupt and reschedules the deadline on the owning hart */
+		void set_mtimecmp(H &hart, u64 val)
+		{
+			hart.mtimecmp = val;
+			hart.raise_event(processor_event_timecmp);
+		}
+
+		/* called by the hart when its timer deadline is reached, returns true if expired */
+		bool check_timer(H &hart)
+		{
+			if (hart.mtimecmp != no_deadline && mtime(hart) >= hart.mtimecmp) {
+				hart.timer_instret = no_deadline;
+				hart.raise_event(processor_event_timer);
+				return true;
+			}
+			hart.timer_instret = deadline_instret(hart);
+			return false;
+		}
+
+		/*
+		 * A hart executed wfi with no interrupt pending. In instret mode,
+		 * when every hart is waiting, advance virtual time to the earliest
+		 * mtimecmp deadline. In wallclock mode block the calling thread until
+		 * its deadline passes or an event is raised for it. Returns false if
+		 * nothing can ever wake the hart.
+		 */
+		bool wfi(H &hart)
+		{
+			wfi_count++;
+			if (mode == clint_time_wallclock) return wfi_wallclock(hart);
+			if (mode == clint_time_virtual) {
+				hart.wfi_waiting = hart.pending_events.load(std::memory_order_acquire) == 0;
+				return true;
+			}
+			if (++harts_waiting < harts.size()) return true;
+			harts_waiting = 0;
+			u64 deadline = no_deadline;
+			for (auto h : harts) deadline = std::min(deadline, h->mtimecmp);
+			if (deadline == no_deadline) return wfi_device(hart);
+			u64 now = mtime(hart);
+			if (deadline > now) {
+				time_skip += deadline - now;
+				skipped_ticks += deadline - now;
+			}
+			for (auto h : harts) check_timer(*h);
+			return true;
+		}
+
+		/* virtual mode: a parked hart wakes on an event or when its deadline passes */
+		bool wfi_wake(H &hart)
+		{
+			if (hart.pending_events.load(std::memory_order_acquire) == 0 &&
+				(hart.mtimecmp == no_deadline || mtime(hart) < hart.mtimecmp)) return false;
+			hart.wfi_waiting = false;
+			check_timer(hart);
+			return true;
+		}
+
+		/* virtual mode: every hart is parked, skip time to the earliest deadline or run another round for a device */
+		bool skip_to_deadline()
+		{
+			u64 deadline = no_deadline;
+			for (auto h : harts) if (h->wfi_waiting) deadline = std::min(deadline, h->mtimecmp);
+			if (deadline == no_deadline) {
+				/* devices are polled between rounds, waiting on the host would not change what they deliver */
+				return devices_active();
+			}
+			u64 now = mtime(*harts[0]);
+			if (deadline > now) {
+				time_skip += deadline - now;
+				skipped_ticks += deadline - now;
+			}
+			return true;
+		}
+
+		/* harts_waiting counts harts blocked without a deadline, which only an event can wake */
+		bool wfi_wallclock(H &hart)
+		{
+			bool idle = hart.mtimecmp == no_deadline;
+			if (idle) harts_waiting++;
+			while (hart.pending_events.load(std::memory_order_acquire) == 0) {
+				u64 now = mtime(hart);
+				u64 ns = wfi_poll_ns;
+				if (idle) {
+					if (harts_waiting >= harts_active && !devices_active()) {
+						harts_waiting--;
+						return false;
+					}
+				} else if (now >= hart.mtimecmp) {
+					break;
+				} else {
+					ns = std::min(ns, (hart.mtimecmp - now) * (1000000000ULL / timebase_hz));
+				}
+				struct timespec ts = { 0, long(ns) };
+				nanosleep(&ts, nullptr);
+			}
+			if (idle) harts_waiting--;
+			check_timer(hart);
+			return true;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+//
+//  riscv-coherence.h
+//
+
+#ifndef riscv_coherence_h
+#define riscv_coherence_h
+
+namespace riscv {
+
+	/* per hart coherence statistics */
+
+	struct coherence_stats
+	{
+		u64 invalidations;  /* lines invalidated by another hart's write */
+		u64 downgrades;     /* modified or exclusive lines downgraded by another hart's read */
+		u64 false_sharing;  /* invalidations where the harts accessed disjoint bytes */
+		u64 llc_accesses;   /* accesses from this hart that reached the shared cache */
+		u64 llc_misses;     /* accesses from this hart that missed the shared cache */
+
+		coherence_stats() :
+			invalidations(0), downgrades(0), false_sharing(0), llc_accesses(0), llc_misses(0) {}
+	};
+
+	/* per cache line invalidation record used to report sharing hotspots */
+
+	struct coherence_line_record
+	{
+		u64 invalidations;
+		u64 false_sharing;
+
+		coherence_line_record() : invalidations(0), false_sharing(0) {}
+	};
+
+
+	/*
+	 * MESI coherent cache hierarchy with private L1 instruction and data caches
+	 * per hart, an optional private L2 per hart and a shared last level cache.
+	 *
+	 * The L1 caches hold data and snoop each other using the MESI states encoded
+	 * in the upper bits of the tag PPN. The L2 and last level caches are tag only
+	 * and are used for statistics. Each L1 data line keeps a mask of the bytes
+	 * the owning hart has accessed so that invalidations caused by writes to
+	 * bytes the victim never touched can be counted as false sharing.
+	 */
+
+	template <typename UX, typename L1, const size_t l2_size = 262144, const size_t l2_ways = 8,
+		const size_t llc_size = 2097152, const size_t llc_ways = 16, typename MEMORY = user_memory<UX>>
+	struct coherent_cache_hierarchy
+	{
+		typedef L1 l1_cache_type;
+		typedef as_tagged_cache<UX,typename L1::as_tagged_va_ppn_type,l2_size,l2_ways,L1::line_size,MEMORY> l2_cache_type;
+		typedef as_tagged_cache<UX,typename L1::as_tagged_va_ppn_type,llc_size,llc_ways,L1::line_size,MEMORY> llc_cache_type;
+		typedef MEMORY memory_type;
+
+		enum : UX {
+			line_size = L1::line_size,
+			line_mask = ~(UX(line_size) - 1),
+			mask_granule_shift = L1::cache_line_shift > 6 ? L1::cache_line_shift - 6 : 0,
+			num_lines = L1::num_entries * L1::num_ways
+		};
+
+		struct hart_caches
+		{
+			l1_cache_type *l1_icache;
+			l1_cache_type *l1_dcache;
+			std::unique_ptr<l2_cache_type> l2;
+			std::vector<u64> access_mask;
+			coherence_stats stats;
+		};
+
+		memory_type *mem;
+		std::vector<hart_caches> harts;
+		llc_cache_type llc;
+		bool enable_l2;
+		bool threaded;      /* harts access the hierarchy from their own host threads */
+		std::mutex lock;
+		std::map<UX,coherence_line_record> line_records;
+
+		coherent_cache_hierarchy(memory_type *mem, bool enable_l2) :
+			mem(mem), enable_l2(enable_l2), threaded(false) {}
+
+		/* serialize accesses when harts run concurrently */
+		std::unique_lock<std::mutex> access_lock()
+		{
+			std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+			if (threaded) guard.lock();
+			return guard;
+		}
+
+		/* add a hart's L1 caches to the coherence domain, returns the hart index */
+		size_t add_hart(l1_cache_type *l1_icache, l1_cache_type *l1_dcache)
+		{
+			harts.resize(harts.size() + 1);
+			hart_caches &h = harts.back();
+			h.l1_icache = l1_icache;
+			h.l1_dcache = l1_dcache;
+			if (enable_l2) h.l2 = std::unique_ptr<l2_cache_type>(new l2_cache_type());
+			h.access_mask.resize(num_lines);
+			return harts.size() - 1;
+		}
+
+		static u64 byte_mask(UX pa, size_t len)
+		{
+			size_t first = (pa & (line_size - 1)) >> mask_granule_shift;
+			size_t last = ((pa & (line_size - 1)) + len - 1) >> mask_granule_shift;
+			if (last > 63) last = 63;
+			return (last - first == 63 ? ~0ULL : ((1ULL << (last - first + 1)) - 1)) << first;
+		}
+
+		/* private L2 and shared last level cache accesses on an L1 miss */
+		void next_level(hart_caches &h, UX pa, bool write)
+		{
+			if (h.l2 && h.l2->probe(pa, pa >> page_shift, 0, write)) return;
+			h.stats.llc_accesses++;
+			if (!llc.probe(pa, pa >> page_shift, 0, write)) h.stats.llc_misses++;
+		}
+
+		/* another hart is reading the line, returns true if the line is shared */
+		bool snoop_read(size_t hart, UX pa)
+		{
+			bool shared = false;
+			for (size_t i = 0; i < harts.size(); i++) {
+				if (i == hart) continue;
+				l1_cache_type &c = *harts[i].l1_dcache;
+				ssize_t line = c.lookup(pa, pa >> page_shift, 0);
+				if (line < 0) continue;
+				shared = true;
+				UX state = c.get_state(line);
+				if (state == l1_cache_type::ppn_state_modified) {
+					uintptr_t uva = mem->mpa_to_uva(pa & line_mask);
+					if (uva) memcpy((void*)uva, c.line_data(line), line_size);
+					c.stats.writebacks++;
+				}
+				if (state != l1_cache_type::ppn_state_shared) {
+					c.set_state(line, l1_cache_type::ppn_state_shared);
+					harts[i].stats.downgrades++;
+				}
+			}
+			return shared;
+		}
+
+		/* another hart is writing the line, invalidate all other copies */
+		void snoop_write(size_t hart, UX pa, u64 mask)
+		{
+			for (size_t i = 0; i < harts.size(); i++) {
+				if (i == hart) continue;
+				hart_caches &h = harts[i];
+				ssize_t iline = h.l1_icache->lookup(pa, pa >> page_shift, 0);
+				if (iline >= 0) h.l1_icache->evict_line(*mem, iline);
+				ssize_t line = h.l1_dcache->lookup(pa, pa >> page_shift, 0);
+				if (line < 0) continue;
+				coherence_line_record &rec = line_records[pa & line_mask];
+				rec.invalidations++;
+				h.stats.invalidations++;
+				if ((h.access_mask[line] & mask) == 0) {
+					rec.false_sharing++;
+					h.stats.false_sharing++;
+				}
+				h.l1_dcache->evict_line(*mem, line);
+			}
+		}
+
+		template <typename T> bool fetch(size_t hart, UX pa, UX pma, T &val)
+		{
+			auto guard = access_lock();
+			hart_caches &h = harts[hart];
+			if (h.l1_icache->lookup(pa, pa >> page_shift, 0) < 0) {
+				snoop_read(hart, pa);
+				next_level(h, pa, false);
+			}
+			return h.l1_icache->read(*mem, pa, pa >> page_shift, 0, pma, val);
+		}
+
+		template <typename T> bool read(size_t hart, UX pa, UX pma, T &val)
+		{
+			auto guard = access_lock();
+			hart_caches &h = harts[hart];
+			l1_cache_type &c = *h.l1_dcache;
+			ssize_t line = c.lookup(pa, pa >> page_shift, 0);
+			bool shared = false;
+			if (line < 0) {
+				shared = snoop_read(hart, pa);
+				next_level(h, pa, false);
+			}
+			if (!c.read(*mem, pa, pa >> page_shift, 0, pma, val)) return false;
+			if (line < 0 && (line = c.lookup(pa, pa >> page_shift, 0)) >= 0) {
+				h.access_mask[line] = 0;
+				if (shared) c.set_state(line, l1_cache_type::ppn_state_shared);
+			}
+			if (line >= 0) h.access_mask[line] |= byte_mask(pa, sizeof(T));
+			return true;
+		}
+
+		template <typename T> bool write(size_t hart, UX pa, UX pma, T val)
+		{
+			auto guard = access_lock();
+			hart_caches &h = harts[hart];
+			l1_cache_type &c = *h.l1_dcache;
+			ssize_t line = c.lookup(pa, pa >> page_shift, 0);
+			u64 mask = byte_mask(pa, sizeof(T));
+			if (line < 0 || c.get_state(line) == l1_cache_type::ppn_state_shared) {
+				snoop_write(hart, pa, mask);
+			}
+			if (line < 0) next_level(h, pa, true);
+			if (!c.write(*mem, pa, pa >> page_shift, 0, pma, val)) return false;
+			if (line < 0 && (line = c.lookup(pa, pa >> page_shift, 0)) >= 0) {
+				h.access_mask[line] = 0;
+			}
+			if (line >= 0) {
+				h.access_mask[line] |= mask;
+				if (c.get_state(line) == l1_cache_type::ppn_state_shared) {
+					c.set_state(line, l1_cache_type::ppn_state_exclusive);
+				}
+			}
+			return true;
+		}
+
+		/* write back and invalidate a line in every hart's L1 data cache */
+		void evict(UX pa)
+		{
+			auto guard = access_lock();
+			for (auto &h : harts) {
+				ssize_t line = h.l1_dcache->lookup(pa, pa >> page_shift, 0);
+				if (line >= 0) h.l1_dcache->evict_line(*mem, line);
+			}
+		}
+
+		/* write back and invalidate all levels */
+		void flush()
+		{
+			for (auto &h : harts) {
+				h.l1_icache->flush(*mem);
+				h.l1_dcache->flush(*mem);
+			}
+		}
+
+		/* lines with the most false sharing and invalidations */
+		std::vector<std::pair<UX,coherence_line_record>> hotspots(size_t count)
+		{
+			std::vector<std::pair<UX,coherence_line_record>> lines(line_records.begin(), line_records.end());
+			std::sort(lines.begin(), lines.end(), [](const std::pair<UX,coherence_line_record> &a,
+				const std::pair<UX,coherence_line_record> &b) {
+				return a.second.false_sharing != b.second.false_sharing ?
+					a.second.false_sharing > b.second.false_sharing :
+					a.second.invalidations > b.second.invalidations;
+			});
+			if (lines.size() > count) lines.resize(count);
+			return lines;
+		}
+	};
+
+}
+
+#endif
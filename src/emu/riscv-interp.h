@@ -70,42 +70,42 @@ intptr_t exec_inst_rv32(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_lb:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s8*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s8 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_lh:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s16*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s16 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_lw:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s32 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_lbu:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = ux(*(u8*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				u8 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = ux(val);
 			};
 			break;
 		case riscv_op_lhu:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = ux(*(u16*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				u16 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = ux(val);
 			};
 			break;
 		case riscv_op_sb:
 			if (rvi) {
-				*((u8*)uintptr_t(proc.ireg[dec.rs1] + dec.imm)) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u8(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_sh:
 			if (rvi) {
-				*((u16*)uintptr_t(proc.ireg[dec.rs1] + dec.imm)) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u16(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_sw:
 			if (rvi) {
-				*((u32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm)) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u32(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_addi:
@@ -245,67 +245,67 @@ intptr_t exec_inst_rv32(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_lr_w:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; if (dec.rd > 0) proc.ireg[dec.rd] = sx(*((s32*)proc.ireg[dec.rs1]));
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; proc.lr = proc.ireg[dec.rs1]; if (dec.rd > 0) proc.ireg[dec.rd] = sx(load_reserved(proc, p, dec.aq, dec.rl));
 			};
 			break;
 		case riscv_op_sc_w:
 			if (rva) {
-				ux res; if (proc.lr == proc.ireg[dec.rs1]) { *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]); res = 0; } else { res = 1; }; if (dec.rd > 0) proc.ireg[dec.rd] = res;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; ux res = proc.lr == proc.ireg[dec.rs1] && store_conditional(proc, p, s32(proc.ireg[dec.rs2]), dec.aq, dec.rl) ? 0 : 1; proc.lr = -1; if (dec.rd > 0) proc.ireg[dec.rd] = res;
 			};
 			break;
 		case riscv_op_amoswap_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]); if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_exchange_n(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoadd_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) + t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_add(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoxor_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) ^ t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_xor(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoor_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) | t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_or(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoand_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) & t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_and(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomin_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) < t ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = s32(proc.ireg[dec.rs2]) < t ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomax_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) > t ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = s32(proc.ireg[dec.rs2]) > t ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amominu_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = u32(proc.ireg[dec.rs2]) < u32(t) ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = u32(proc.ireg[dec.rs2]) < u32(t) ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomaxu_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = u32(proc.ireg[dec.rs2]) > u32(t) ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = u32(proc.ireg[dec.rs2]) > u32(t) ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_flw:
 			if (rvf) {
-				proc.freg[dec.rd].r.s.val = *(f32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm);
+				f32 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; proc.freg[dec.rd].r.s.val = val;
 			};
 			break;
 		case riscv_op_fsw:
 			if (rvf) {
-				*(f32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm) = proc.freg[dec.rs2].r.s.val;
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, proc.freg[dec.rs2].r.s.val)) return 0;
 			};
 			break;
 		case riscv_op_fmadd_s:
@@ -430,12 +430,12 @@ intptr_t exec_inst_rv32(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_fld:
 			if (rvd) {
-				proc.freg[dec.rd].r.d.val = *(f64*)uintptr_t(proc.ireg[dec.rs1] + dec.imm);
+				f64 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; proc.freg[dec.rd].r.d.val = val;
 			};
 			break;
 		case riscv_op_fsd:
 			if (rvd) {
-				*(f64*)uintptr_t(proc.ireg[dec.rs1] + dec.imm) = proc.freg[dec.rs2].r.d.val;
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, proc.freg[dec.rs2].r.d.val)) return 0;
 			};
 			break;
 		case riscv_op_fmadd_d:
@@ -626,42 +626,42 @@ intptr_t exec_inst_rv64(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_lb:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s8*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s8 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_lh:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s16*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s16 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_lw:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s32 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_lbu:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = ux(*(u8*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				u8 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = ux(val);
 			};
 			break;
 		case riscv_op_lhu:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = ux(*(u16*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				u16 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = ux(val);
 			};
 			break;
 		case riscv_op_sb:
 			if (rvi) {
-				*((u8*)uintptr_t(proc.ireg[dec.rs1] + dec.imm)) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u8(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_sh:
 			if (rvi) {
-				*((u16*)uintptr_t(proc.ireg[dec.rs1] + dec.imm)) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u16(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_sw:
 			if (rvi) {
-				*((u32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm)) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u32(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_addi:
@@ -746,17 +746,17 @@ intptr_t exec_inst_rv64(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_lwu:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = ux(*(u32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				u32 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = ux(val);
 			};
 			break;
 		case riscv_op_ld:
 			if (rvi) {
-				if (dec.rd > 0) proc.ireg[dec.rd] = sx(*(s64*)uintptr_t(proc.ireg[dec.rs1] + dec.imm));
+				s64 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; if (dec.rd > 0) proc.ireg[dec.rd] = sx(val);
 			};
 			break;
 		case riscv_op_sd:
 			if (rvi) {
-				*(u64*)uintptr_t(proc.ireg[dec.rs1] + dec.imm) = proc.ireg[dec.rs2];
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, u64(proc.ireg[dec.rs2]))) return 0;
 			};
 			break;
 		case riscv_op_slli_rv64i:
@@ -886,122 +886,122 @@ intptr_t exec_inst_rv64(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_lr_w:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; if (dec.rd > 0) proc.ireg[dec.rd] = sx(*((s32*)proc.ireg[dec.rs1]));
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; proc.lr = proc.ireg[dec.rs1]; if (dec.rd > 0) proc.ireg[dec.rd] = sx(load_reserved(proc, p, dec.aq, dec.rl));
 			};
 			break;
 		case riscv_op_sc_w:
 			if (rva) {
-				ux res; if (proc.lr == proc.ireg[dec.rs1]) { *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]); res = 0; } else { res = 1; }; if (dec.rd > 0) proc.ireg[dec.rd] = res;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; ux res = proc.lr == proc.ireg[dec.rs1] && store_conditional(proc, p, s32(proc.ireg[dec.rs2]), dec.aq, dec.rl) ? 0 : 1; proc.lr = -1; if (dec.rd > 0) proc.ireg[dec.rd] = res;
 			};
 			break;
 		case riscv_op_amoswap_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]); if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_exchange_n(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoadd_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) + t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_add(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoxor_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) ^ t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_xor(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoor_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) | t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_or(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoand_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) & t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_and(p, s32(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomin_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) < t ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = s32(proc.ireg[dec.rs2]) < t ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomax_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = s32(proc.ireg[dec.rs2]) > t ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = s32(proc.ireg[dec.rs2]) > t ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amominu_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = u32(proc.ireg[dec.rs2]) < u32(t) ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = u32(proc.ireg[dec.rs2]) < u32(t) ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomaxu_w:
 			if (rva) {
-				s32 t(*(s32*)proc.ireg[dec.rs1]); *((s32*)proc.ireg[dec.rs1]) = u32(proc.ireg[dec.rs2]) > u32(t) ? s32(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s32 *p = proc.mmu.template atomic_ref<s32>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s32 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s32 n; do { n = u32(proc.ireg[dec.rs2]) > u32(t) ? s32(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_lr_d:
 			if (rva) {
-				proc.lr = proc.ireg[dec.rs1]; if (dec.rd > 0) proc.ireg[dec.rd] = sx(*((s64*)proc.ireg[dec.rs1]));
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; proc.lr = proc.ireg[dec.rs1]; if (dec.rd > 0) proc.ireg[dec.rd] = sx(load_reserved(proc, p, dec.aq, dec.rl));
 			};
 			break;
 		case riscv_op_sc_d:
 			if (rva) {
-				ux res; if (proc.lr == proc.ireg[dec.rs1]) { *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]); res = 0; } else { res = 1; }; if (dec.rd > 0) proc.ireg[dec.rd] = res;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; ux res = proc.lr == proc.ireg[dec.rs1] && store_conditional(proc, p, s64(proc.ireg[dec.rs2]), dec.aq, dec.rl) ? 0 : 1; proc.lr = -1; if (dec.rd > 0) proc.ireg[dec.rd] = res;
 			};
 			break;
 		case riscv_op_amoswap_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]); if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_exchange_n(p, s64(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoadd_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]) + t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_add(p, s64(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoxor_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]) ^ t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_xor(p, s64(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoor_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]) | t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_or(p, s64(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amoand_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]) & t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return __atomic_fetch_and(p, s64(proc.ireg[dec.rs2]), decltype(mo)::value); }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomin_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]) < t ? s64(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s64 n; do { n = s64(proc.ireg[dec.rs2]) < t ? s64(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomax_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = s64(proc.ireg[dec.rs2]) > t ? s64(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s64 n; do { n = s64(proc.ireg[dec.rs2]) > t ? s64(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amominu_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = u64(proc.ireg[dec.rs2]) < u64(t) ? s64(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s64 n; do { n = u64(proc.ireg[dec.rs2]) < u64(t) ? s64(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_amomaxu_d:
 			if (rva) {
-				s64 t(*(s64*)proc.ireg[dec.rs1]); *((s64*)proc.ireg[dec.rs1]) = u64(proc.ireg[dec.rs2]) > u64(t) ? s64(proc.ireg[dec.rs2]) : t; if (dec.rd > 0) proc.ireg[dec.rd] = t;
+				s64 *p = proc.mmu.template atomic_ref<s64>(proc, proc.ireg[dec.rs1]); if (!p) return 0; s64 t = __atomic_load_n(p, __ATOMIC_RELAXED); amo_mo(dec.aq, dec.rl, [&](auto mo) { s64 n; do { n = u64(proc.ireg[dec.rs2]) > u64(t) ? s64(proc.ireg[dec.rs2]) : t; } while (!__atomic_compare_exchange_n(p, &t, n, true, decltype(mo)::value, __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p); if (dec.rd > 0) proc.ireg[dec.rd] = t;
 			};
 			break;
 		case riscv_op_flw:
 			if (rvf) {
-				proc.freg[dec.rd].r.s.val = *(f32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm);
+				f32 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; proc.freg[dec.rd].r.s.val = val;
 			};
 			break;
 		case riscv_op_fsw:
 			if (rvf) {
-				*(f32*)uintptr_t(proc.ireg[dec.rs1] + dec.imm) = proc.freg[dec.rs2].r.s.val;
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, proc.freg[dec.rs2].r.s.val)) return 0;
 			};
 			break;
 		case riscv_op_fmadd_s:
@@ -1146,12 +1146,12 @@ intptr_t exec_inst_rv64(T &dec, P &proc, intptr_t pc_offset)
 			break;
 		case riscv_op_fld:
 			if (rvd) {
-				proc.freg[dec.rd].r.d.val = *(f64*)uintptr_t(proc.ireg[dec.rs1] + dec.imm);
+				f64 val; if (!proc.mmu.load(proc, proc.ireg[dec.rs1] + dec.imm, val)) return 0; proc.freg[dec.rd].r.d.val = val;
 			};
 			break;
 		case riscv_op_fsd:
 			if (rvd) {
-				*(f64*)uintptr_t(proc.ireg[dec.rs1] + dec.imm) = proc.freg[dec.rs2].r.d.val;
+				if (!proc.mmu.store(proc, proc.ireg[dec.rs1] + dec.imm, proc.freg[dec.rs2].r.d.val)) return 0;
 			};
 			break;
 		case riscv_op_fmadd_d:
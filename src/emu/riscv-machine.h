@@ -89,6 +89,20 @@ namespace riscv {
 		} counten;
 	};
 
+	/* asynchronous hart events, polled by the execution loop at block boundaries */
+
+	enum processor_event : u32
+	{
+		processor_event_interrupt = 1<<0, /* mip, mie or mstatus changed, re-evaluate interrupts */
+		processor_event_timer     = 1<<1, /* machine timer deadline reached */
+		processor_event_software  = 1<<2, /* machine software interrupt (IPI) */
+		processor_event_external  = 1<<3, /* machine external interrupt */
+		processor_event_halt      = 1<<4, /* stop the hart */
+		processor_event_timecmp   = 1<<5, /* mtimecmp written, clear mtip and recheck the deadline */
+		processor_event_software_clear = 1<<6, /* msip cleared */
+		processor_event_external_clear = 1<<7, /* external interrupt line lowered */
+	};
+
 	/* Processor state */
 
 	template <typename SX, typename UX, typename IREG, int IREG_COUNT, typename FREG, int FREG_COUNT>
@@ -142,7 +156,30 @@ namespace riscv {
 		u64          msinstret_delta; /* Machine Supervisor Number of Instructions Retired Delta */
 		u64          muinstret_delta; /* Machine User Number of Instructions Retired Delta */
 
-		processor_priv() : processor_type() {}
+		/* Asynchronous events and interrupt delivery statistics */
+
+		std::atomic<u32> pending_events; /* processor_event bits set by CSR writes, timers and devices */
+		u64          event_instret;   /* instret when the hart first saw an undelivered interrupt pending */
+		u64          timer_instret;   /* instret at which to check the mtimecmp deadline */
+		bool         wfi_waiting;     /* parked in wfi until the round-robin scheduler wakes it */
+		u64          intr_delivered;  /* Number of interrupts taken */
+		u64          intr_latency;    /* Total instructions retired between raise and delivery */
+		u64          intr_latency_max;/* Worst case instructions retired between raise and delivery */
+
+		processor_priv() : processor_type(), pending_events(0), event_instret(0), timer_instret(0), wfi_waiting(false),
+			intr_delivered(0), intr_latency(0), intr_latency_max(0) {}
+
+		/*
+		 * Set event bits from any thread, removing cancel bits so the last of
+		 * a raise and a clear wins. Only the owning hart consumes the events
+		 * and updates its own mip, stamps and deadlines.
+		 */
+		void raise_event(u32 events, u32 cancel = 0)
+		{
+			u32 old = pending_events.load(std::memory_order_relaxed);
+			while (!pending_events.compare_exchange_weak(old, (old & ~cancel) | events,
+				std::memory_order_release, std::memory_order_relaxed));
+		}
 	};
 
 	using processor_priv_rv32imafd = processor_priv<s32,u32,ireg_rv32,32,freg_fp64,32>;
@@ -7,36 +7,203 @@
 
 namespace riscv {
 
+	/*  RAM backing options. anonymous mappings are committed lazily on first
+	    touch, noreserve also skips swap reservation so large guest RAM costs
+	    nothing until used. thp and hugetlb reduce host TLB misses */
+	enum memory_backing
+	{
+		memory_backing_noreserve = 1<<0, /* MAP_NORESERVE */
+		memory_backing_thp       = 1<<1, /* madvise(MADV_HUGEPAGE) */
+		memory_backing_hugetlb   = 1<<2, /* MAP_HUGETLB, falls back to thp */
+	};
+
+	/*  memory mapped device interface. offsets are relative to the start of the
+	    device region and size is the access width in bytes. accesses are
+	    serialized with lock when harts run on their own host threads */
+	template <typename UX>
+	struct user_memory_device
+	{
+		bool threaded;      /* harts access the device from their own host threads */
+		std::mutex lock;
+
+		user_memory_device() : threaded(false) {}
+		virtual ~user_memory_device() {}
+
+		std::unique_lock<std::mutex> access_lock()
+		{
+			std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+			if (threaded) guard.lock();
+			return guard;
+		}
+
+		virtual bool load(UX offset, u64 &val, size_t size) = 0;
+		virtual bool store(UX offset, u64 val, size_t size) = 0;
+	};
+
+	/*  dirty page bitmap for a memory segment with optional per page write
+	    counts. bits are set by the soft-mmu store path and may be tested and
+	    cleared concurrently by another thread taking a snapshot */
+	struct user_memory_dirty_map
+	{
+		size_t pages;
+		size_t words;
+		std::unique_ptr<std::atomic<u64>[]> bits;
+		std::unique_ptr<std::atomic<u32>[]> counts;
+
+		user_memory_dirty_map(size_t pages, bool write_counts) :
+			pages(pages), words((pages + 63) >> 6),
+			bits(new std::atomic<u64>[words]),
+			counts(write_counts ? new std::atomic<u32>[pages] : nullptr)
+		{
+			reset(true);
+		}
+
+		void set(size_t page)
+		{
+			std::atomic<u64> &word = bits[page >> 6];
+			u64 bit = 1ULL << (page & 63);
+			if (!(word.load(std::memory_order_relaxed) & bit)) {
+				word.fetch_or(bit, std::memory_order_relaxed);
+			}
+			if (counts) counts[page].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		bool test(size_t page)
+		{
+			return (bits[page >> 6].load(std::memory_order_relaxed) >> (page & 63)) & 1;
+		}
+
+		bool test_and_clear(size_t page)
+		{
+			u64 bit = 1ULL << (page & 63);
+			return (bits[page >> 6].fetch_and(~bit, std::memory_order_acq_rel) & bit) != 0;
+		}
+
+		/* swap out a whole word of dirty bits */
+		u64 exchange_word(size_t word, u64 val)
+		{
+			return bits[word].exchange(val, std::memory_order_acq_rel);
+		}
+
+		void reset(bool clear_counts)
+		{
+			for (size_t i = 0; i < words; i++) {
+				bits[i].store(0, std::memory_order_relaxed);
+			}
+			if (counts && clear_counts) {
+				for (size_t i = 0; i < pages; i++) {
+					counts[i].store(0, std::memory_order_relaxed);
+				}
+			}
+		}
+	};
+
 	/*  user memory segment contains one mapping from a segment of emulated machine
-	    physical address space to user virtual address in the emulator process */
+	    physical address space to user virtual address in the emulator process
+	    or to a memory mapped device */
 	template <typename UX>
 	struct user_memory_segment
 	{
+		typedef user_memory_device<UX> memory_device_type;
+
 		UX mpa;         /* machine physical address (emulator address domain) */
 		uintptr_t uva;  /* user virtual address     (process address domain) */
 		size_t size;    /* segment size */
 		uint32_t flags; /* segment PMA flags */
+		std::shared_ptr<memory_device_type> device; /* device for IO segments */
+		std::shared_ptr<user_memory_dirty_map> dirty; /* optional dirty page bitmap */
 
-		user_memory_segment(UX mpa, uintptr_t uva, size_t size, UX flags) :
-			mpa(mpa), uva(uva), size(size), flags(0) {}
+		user_memory_segment(UX mpa, uintptr_t uva, size_t size, UX flags,
+			std::shared_ptr<memory_device_type> device = std::shared_ptr<memory_device_type>()) :
+			mpa(mpa), uva(uva), size(size), flags(flags), device(device) {}
 	};
 
 
 	/*  user_memory device contains mappings for mulitple segments of emulated
-	    physical address space to user virtual address space */
+	    physical address space to user virtual address space.
+
+	    Segments are indexed per page with a fixed depth radix tree so lookup
+	    cost does not depend on the number of segments. Leaf slots hold the
+	    segment index shifted left by one, with the low bit set if the page is
+	    not entirely covered by a single segment, in which case the lookup falls
+	    back to a scan of the segments in the order they were added */
 	template <typename UX>
 	struct user_memory
 	{
 		typedef user_memory_segment<UX> memory_segment_type;
+		typedef user_memory_device<UX> memory_device_type;
+
+		enum : size_t {
+			pa_bits = sizeof(UX) == 4 ? 32 : 56,
+			radix_bits = sizeof(UX) == 4 ? 10 : 11,
+			radix_size = size_t(1) << radix_bits,
+			radix_mask = radix_size - 1,
+			radix_levels = (pa_bits - page_shift + radix_bits - 1) / radix_bits,
+			radix_index_bits = radix_levels * radix_bits
+		};
+
+		enum : uintptr_t {
+			slot_partial = 1
+		};
+
+		/* interior nodes hold pointers to the next level, leaves hold segment slots */
+		struct radix_node
+		{
+			uintptr_t slot[radix_size];
+
+			radix_node() { memset(slot, 0, sizeof(slot)); }
+		};
 
 		std::vector<memory_segment_type> segments;
+		std::vector<std::unique_ptr<radix_node>> radix_nodes;
+		radix_node *radix_root;
+		int backing;   /* memory_backing flags for add_ram */
+		int numa_node; /* bind RAM to this NUMA node, -1 for the default policy */
+		bool shared;   /* segments are owned by another user_memory */
 
+		user_memory() : radix_root(new_radix_node()),
+			backing(memory_backing_noreserve), numa_node(-1), shared(false) {}
 		~user_memory() { clear_segments(); }
 
+		radix_node* new_radix_node()
+		{
+			radix_nodes.push_back(std::unique_ptr<radix_node>(new radix_node()));
+			return radix_nodes.back().get();
+		}
+
+		/* return the leaf slot for a page number, allocating interior nodes */
+		uintptr_t& radix_slot(uintptr_t pn)
+		{
+			radix_node *node = radix_root;
+			for (size_t level = radix_levels - 1; level > 0; level--) {
+				uintptr_t &slot = node->slot[(pn >> (level * radix_bits)) & radix_mask];
+				if (!slot) slot = uintptr_t(new_radix_node());
+				node = (radix_node*)slot;
+			}
+			return node->slot[pn & radix_mask];
+		}
+
+		/* index the pages of the last segment added */
+		void radix_insert()
+		{
+			const memory_segment_type &seg = segments.back();
+			uintptr_t index = segments.size() << 1;
+			uintptr_t begin = uintptr_t(seg.mpa), end = begin + seg.size;
+			if (seg.size == 0 || (begin >> page_shift) >> radix_index_bits) return;
+			for (uintptr_t pa = begin & ~uintptr_t(page_size - 1); pa < end; pa += page_size) {
+				if ((pa >> page_shift) >> radix_index_bits) break;
+				uintptr_t &slot = radix_slot(pa >> page_shift);
+				bool partial = pa < begin || pa + page_size > end;
+				if (slot) slot |= slot_partial;
+				else slot = index | (partial ? slot_partial : 0);
+			}
+		}
+
 		/* add existing memory segment given user physical address and size */
 		void add_segment(UX mpa, uintptr_t uva, size_t size, UX flags)
 		{
 			segments.push_back(memory_segment_type(mpa, uva, size, flags));
+			radix_insert();
 			debug("memory: uva: 0x%016" PRIxPTR " - 0x%016" PRIxPTR,
 				(uintptr_t)uva, (uintptr_t)uva + size);
 			debug("        mpa: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " %s%s%s",
@@ -46,38 +213,235 @@ namespace riscv {
 				(flags & pma_prot_execute) ? "+X" : "");
 		}
 
+		/* add memory mapped device segment given user physical address and size */
+		void add_device(UX mpa, size_t size, std::shared_ptr<memory_device_type> device,
+			UX flags = pma_type_io | pma_prot_read | pma_prot_write)
+		{
+			segments.push_back(memory_segment_type(mpa, 0, size, flags, device));
+			radix_insert();
+			debug("device: mpa: 0x%016" PRIxPTR " - 0x%016" PRIxPTR " %s%s",
+				(uintptr_t)mpa, (uintptr_t)mpa + size,
+				(flags & pma_prot_read) ? "+R" : "",
+				(flags & pma_prot_write) ? "+W" : "");
+		}
+
+		/* map the same RAM and devices as another user_memory, e.g. for another hart */
+		void share_segments(const user_memory &other)
+		{
+			clear_segments();
+			shared = true;
+			for (auto &seg : other.segments) {
+				segments.push_back(seg);
+				radix_insert();
+			}
+		}
+
+		/* mmap anonymous memory using the configured backing options */
+		void* map_ram(size_t size)
+		{
+			int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+		#if defined (MAP_NORESERVE)
+			if (backing & memory_backing_noreserve) flags |= MAP_NORESERVE;
+		#endif
+			void *addr = MAP_FAILED;
+		#if defined (MAP_HUGETLB)
+			if (backing & memory_backing_hugetlb) {
+				addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+				if (addr == MAP_FAILED) {
+					debug("memory: MAP_HUGETLB: %s: using transparent huge pages", strerror(errno));
+				}
+			}
+		#endif
+			if (addr == MAP_FAILED) {
+				addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+				if (addr == MAP_FAILED) return addr;
+		#if defined (MADV_HUGEPAGE)
+				if (backing & (memory_backing_thp | memory_backing_hugetlb)) {
+					if (madvise(addr, size, MADV_HUGEPAGE) < 0) {
+						debug("memory: MADV_HUGEPAGE: %s", strerror(errno));
+					}
+				}
+		#endif
+			}
+		#if defined (__linux__) && defined (SYS_mbind)
+			if (numa_node >= 0) {
+				/* MPOL_BIND with a single node mask */
+				unsigned long nodemask[4] = { 0 };
+				const unsigned long bits = sizeof(nodemask[0]) * 8;
+				if (size_t(numa_node) < sizeof(nodemask) * 8) {
+					nodemask[numa_node / bits] = 1UL << (numa_node % bits);
+				}
+				if (syscall(SYS_mbind, addr, size, 2 /* MPOL_BIND */, nodemask, sizeof(nodemask) * 8, 0) < 0) {
+					debug("memory: mbind: node %d: %s", numa_node, strerror(errno));
+				}
+			}
+		#endif
+			return addr;
+		}
+
 		/* mmap new main memory segment using fixed user physical address and size */
 		void add_ram(UX mpa, size_t size)
 		{
-			void *addr = mmap(nullptr, size,
-				PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+			void *addr = map_ram(size);
 			if (addr == MAP_FAILED) {
 				panic("memory: error: mmap: %s", strerror(errno));
 			}
 			add_segment(mpa, uintptr_t(addr), size,
-				pma_type_main | pma_prot_read | pma_prot_write);
+				pma_type_main | pma_prot_read | pma_prot_write | pma_prot_execute |
+				pma_cache_write_back | pma_cache_alloc_read | pma_cache_alloc_write);
+		}
+
+		/* bytes reserved and resident in host memory for main memory segments */
+		std::pair<size_t,size_t> resident_size()
+		{
+		#if defined (__APPLE__)
+			typedef char mincore_vec_type;
+		#else
+			typedef unsigned char mincore_vec_type;
+		#endif
+			size_t reserved = 0, resident = 0;
+			std::vector<mincore_vec_type> vec;
+			for (auto &seg : segments) {
+				if (!(seg.flags & pma_type_main) || !seg.uva) continue;
+				uintptr_t begin = seg.uva & ~uintptr_t(page_size - 1);
+				size_t pages = (seg.uva + seg.size - begin + page_size - 1) >> page_shift;
+				reserved += seg.size;
+				vec.resize(pages);
+				if (mincore((void*)begin, pages << page_shift, vec.data()) < 0) continue;
+				for (auto v : vec) {
+					if (v & 1) resident += page_size;
+				}
+			}
+			return std::pair<size_t,size_t>(reserved, resident);
+		}
+
+		/* track dirty pages in main memory segments */
+		void enable_dirty_tracking(bool write_counts = false)
+		{
+			for (auto &seg : segments) {
+				if (!(seg.flags & pma_type_main) || seg.dirty) continue;
+				size_t pages = (size_t(seg.mpa & (page_size - 1)) + seg.size + page_size - 1) >> page_shift;
+				seg.dirty = std::make_shared<user_memory_dirty_map>(pages, write_counts);
+			}
+		}
+
+		static size_t dirty_page_index(memory_segment_type &seg, UX mpa)
+		{
+			return (mpa >> page_shift) - (seg.mpa >> page_shift);
+		}
+
+		/* mark the pages covered by a store, called from the mmu store path and devices */
+		static void mark_dirty(memory_segment_type &seg, UX mpa, size_t len)
+		{
+			size_t first = dirty_page_index(seg, mpa);
+			size_t last = std::min(dirty_page_index(seg, mpa + len - 1), seg.dirty->pages - 1);
+			for (size_t page = first; page <= last; page++) seg.dirty->set(page);
+		}
+
+		/* test and clear the dirty bit for the page containing mpa */
+		bool test_and_clear_dirty(UX mpa)
+		{
+			memory_segment_type *seg = mpa_to_segment(mpa);
+			if (!seg || !seg->dirty) return false;
+			return seg->dirty->test_and_clear(dirty_page_index(*seg, mpa));
+		}
+
+		/* number of stores to the page containing mpa since the counts were reset */
+		u32 dirty_write_count(UX mpa)
+		{
+			memory_segment_type *seg = mpa_to_segment(mpa);
+			if (!seg || !seg->dirty || !seg->dirty->counts) return 0;
+			return seg->dirty->counts[dirty_page_index(*seg, mpa)].load(std::memory_order_relaxed);
+		}
+
+		/* call fn(mpa, len) for each run of dirty pages, optionally clearing them */
+		template <typename F>
+		void for_each_dirty_range(F fn, bool clear = false)
+		{
+			for (auto &seg : segments) {
+				if (!seg.dirty) continue;
+				user_memory_dirty_map &dirty = *seg.dirty;
+				UX base = seg.mpa & ~UX(page_size - 1);
+				size_t run_begin = 0, run_len = 0;
+				for (size_t w = 0; w < dirty.words; w++) {
+					u64 word = clear ? dirty.exchange_word(w, 0) :
+						dirty.bits[w].load(std::memory_order_relaxed);
+					if (word == 0 && run_len == 0) continue;
+					for (size_t b = 0; b < 64; b++) {
+						size_t page = (w << 6) + b;
+						if ((word >> b) & 1) {
+							if (run_len == 0) run_begin = page;
+							run_len++;
+						} else if (run_len) {
+							fn(UX(base + (run_begin << page_shift)), run_len << page_shift);
+							run_len = 0;
+						}
+						if ((word >> b) == 0 && run_len == 0) break;
+					}
+				}
+				if (run_len) fn(UX(base + (run_begin << page_shift)), run_len << page_shift);
+			}
+		}
+
+		/* clear all dirty bits, e.g. after taking a checkpoint */
+		void reset_dirty(bool clear_counts = false)
+		{
+			for (auto &seg : segments) {
+				if (seg.dirty) seg.dirty->reset(clear_counts);
+			}
 		}
 
 		/* Unmap memory segments */
 		void clear_segments()
 		{
 			for (auto &seg: segments) {
-				if (seg.flags & pma_type_main) {
+				if ((seg.flags & pma_type_main) && !shared) {
 					munmap((void*)seg.uva, seg.size);
 				}
 			}
 			segments.clear();
+			radix_nodes.clear();
+			radix_root = new_radix_node();
 		}
 
-		/* convert machine physical address to user virtual address */
-		uintptr_t mpa_to_uva(UX mpa)
+		/* scan segments in order for pages shared by more than one segment */
+		memory_segment_type* mpa_to_segment_scan(UX mpa)
 		{
 			for (auto &seg : segments) {
 				if (mpa >= seg.mpa && mpa < seg.mpa + seg.size) {
-					return seg.uva + (mpa - seg.mpa);
+					return &seg;
 				}
 			}
-			return 0;
+			return nullptr;
+		}
+
+		/* find the memory segment containing a machine physical address */
+		memory_segment_type* mpa_to_segment(UX mpa)
+		{
+			uintptr_t pn = uintptr_t(mpa) >> page_shift;
+			if (pn >> radix_index_bits) return nullptr;
+			const radix_node *node = radix_root;
+			for (size_t level = radix_levels - 1; level > 0; level--) {
+				node = (const radix_node*)node->slot[(pn >> (level * radix_bits)) & radix_mask];
+				if (!node) return nullptr;
+			}
+			uintptr_t slot = node->slot[pn & radix_mask];
+			if (slot & slot_partial) return mpa_to_segment_scan(mpa);
+			return slot ? &segments[(slot >> 1) - 1] : nullptr;
+		}
+
+		/* find the segment containing len bytes at mpa, null if they cross its end */
+		memory_segment_type* mpa_to_segment(UX mpa, size_t len)
+		{
+			memory_segment_type *seg = mpa_to_segment(mpa);
+			return seg && size_t(mpa - seg->mpa) + len <= seg->size ? seg : nullptr;
+		}
+
+		/* convert machine physical address to user virtual address */
+		uintptr_t mpa_to_uva(UX mpa)
+		{
+			memory_segment_type *seg = mpa_to_segment(mpa);
+			return seg && seg->uva ? seg->uva + (mpa - seg->mpa) : 0;
 		}
 
 	};
@@ -14,27 +14,148 @@ namespace riscv {
 		typedef CACHE cache_type;
 		typedef MEMORY memory_type;
 
+		typedef typename memory_type::memory_segment_type memory_segment_type;
+		typedef coherent_cache_hierarchy<UX,CACHE,262144,8,2097152,16,MEMORY> cache_hierarchy_type;
+
+		enum : UX {
+			pma_cache_alloc = pma_cache_alloc_read | pma_cache_alloc_write
+		};
+
 		tlb_type     l1_dtlb;
 		tlb_type     l1_itlb;
 		cache_type   l1_dcache;
 		cache_type   l1_icache;
 		memory_type  mem;
+		bool         cache_enable;
+
+		/* optional coherent hierarchy that this mmu's L1 caches belong to */
+		cache_hierarchy_type *cache_hierarchy;
+		size_t       cache_hart;
+
+		mmu() : cache_enable(false), cache_hierarchy(nullptr), cache_hart(0) {}
+
+		// TODO - translate va using the TLB and page table walker when vm is enabled
+
+		// T is one of u64, u32, u16
+		template <typename P, typename T> bool fetch_parcel(P &proc, UX pc, T &val)
+		{
+			memory_segment_type *seg = mem.mpa_to_segment(pc, sizeof(T));
+			if (!seg || !(seg->flags & pma_prot_execute) || seg->device) return false;
+			if (cache_enable && (seg->flags & pma_cache_alloc)) {
+				return cache_hierarchy ? cache_hierarchy->fetch(cache_hart, pc, seg->flags, val) :
+					l1_icache.read(mem, pc, pc >> page_shift, 0, seg->flags, val);
+			}
+			memcpy(&val, (void*)(seg->uva + (pc - seg->mpa)), sizeof(T));
+			return true;
+		}
 
-		template <typename P> u64 fetch_inst(P &proc, UX pc)
+		template <typename P> u64 fetch_inst(P &proc, UX pc, intptr_t &pc_offset)
 		{
-			return 0; // TODO
+			// NOTE: currently supports maximum instruction size of 64-bits
+			u16 p0, p1;
+			u32 p2;
+			pc_offset = 0;
+			if (!fetch_parcel(proc, pc, p0)) return 0;
+			u64 inst = htole16(p0);
+			if ((inst & 0b11) != 0b11) {
+				pc_offset = 2;
+				return inst;
+			}
+			if (!fetch_parcel(proc, pc + 2, p1)) return 0;
+			inst |= u64(htole16(p1)) << 16;
+			if ((inst & 0b11100) != 0b11100) {
+				pc_offset = 4;
+			} else if ((inst & 0b111111) == 0b011111) {
+				if (!fetch_parcel(proc, pc + 4, p1)) return 0;
+				inst |= u64(htole16(p1)) << 32;
+				pc_offset = 6;
+			} else if ((inst & 0b1111111) == 0b0111111) {
+				if (!fetch_parcel(proc, pc + 4, p2)) return 0;
+				inst |= u64(htole32(p2)) << 32;
+				pc_offset = 8;
+			} else {
+				inst = 0; /* illegal instruction */
+			}
+			return inst;
 		}
 
 		// T is one of u64, u32, u16, u8
 		template <typename P, typename T> bool load(P &proc, UX va, T &val)
 		{
-			return false; // TODO
+			memory_segment_type *seg = mem.mpa_to_segment(va, sizeof(T));
+			if (!seg || !(seg->flags & pma_prot_read)) return false;
+			if (seg->device) {
+				u64 dval = 0;
+				auto guard = seg->device->access_lock();
+				if (!seg->device->load(va - seg->mpa, dval, sizeof(T))) return false;
+				memcpy(&val, &dval, sizeof(T));
+				return true;
+			}
+			if (cache_enable && (seg->flags & pma_cache_alloc)) {
+				return cache_hierarchy ? cache_hierarchy->read(cache_hart, va, seg->flags, val) :
+					l1_dcache.read(mem, va, va >> page_shift, 0, seg->flags, val);
+			}
+			memcpy(&val, (void*)(seg->uva + (va - seg->mpa)), sizeof(T));
+			return true;
 		}
 
 		// T is one of u64, u32, u16, u8
 		template <typename P, typename T> bool store(P &proc, UX va, T val)
 		{
-			return false; // TODO
+			memory_segment_type *seg = mem.mpa_to_segment(va, sizeof(T));
+			if (!seg || !(seg->flags & pma_prot_write)) return false;
+			if (seg->device) {
+				u64 dval = 0;
+				memcpy(&dval, &val, sizeof(T));
+				auto guard = seg->device->access_lock();
+				return seg->device->store(va - seg->mpa, dval, sizeof(T));
+			}
+			if (seg->dirty) memory_type::mark_dirty(*seg, va, sizeof(T));
+			void *ptr = (void*)(seg->uva + (va - seg->mpa));
+			if (cache_enable && (seg->flags & pma_cache_alloc)) {
+				bool ok = cache_hierarchy ? cache_hierarchy->write(cache_hart, va, seg->flags, val) :
+					l1_dcache.write(mem, va, va >> page_shift, 0, seg->flags, val);
+				reservation_invalidate(ptr);
+				return ok;
+			}
+			memcpy(ptr, &val, sizeof(T));
+			reservation_invalidate(ptr);
+			return true;
+		}
+
+		/*
+		 * Host pointer for an atomic access to main memory, null if the
+		 * address is misaligned, unmapped, a device or not read-write.
+		 * Simulated cache lines holding the address are written back and
+		 * invalidated so the host atomic operates on current data.
+		 */
+		template <typename T, typename P> T* atomic_ref(P &proc, UX va)
+		{
+			const UX rw = pma_prot_read | pma_prot_write;
+			memory_segment_type *seg = mem.mpa_to_segment(va, sizeof(T));
+			if ((va & (sizeof(T) - 1)) || !seg || seg->device || !seg->uva ||
+				(seg->flags & rw) != rw) return nullptr;
+			if (cache_enable && (seg->flags & pma_cache_alloc)) {
+				if (cache_hierarchy) {
+					cache_hierarchy->evict(va);
+				} else {
+					ssize_t line = l1_dcache.lookup(va, va >> page_shift, 0);
+					if (line >= 0) l1_dcache.evict_line(mem, line);
+				}
+			}
+			if (seg->dirty) memory_type::mark_dirty(*seg, va, sizeof(T));
+			return (T*)(seg->uva + (va - seg->mpa));
+		}
+
+		/* write back and invalidate the L1 caches */
+		void flush_caches()
+		{
+			if (cache_hierarchy) {
+				cache_hierarchy->flush();
+				return;
+			}
+			l1_icache.flush(mem);
+			l1_dcache.flush(mem);
 		}
 
 		// PTM is one of sv32, sv39, sv48
@@ -0,0 +1,473 @@
+//
+//  riscv-processor-model.h
+//
+
+#ifndef riscv_processor_model_h
+#define riscv_processor_model_h
+
+namespace riscv {
+
+	/*
+	 * Processor templates and proxy processor models shared by
+	 * riscv-test-emulate and riscv-batch-emulate
+	 */
+
+	enum {
+		reg_log_int = 1,
+		reg_log_f32 = 2,
+		reg_log_f64 = 4,
+		reg_log_inst = 8,
+		reg_log_operands = 16,
+		reg_log_no_pseudo = 32,
+	};
+
+	/*
+	 * Processor base template
+	 */
+
+	template<typename T, typename P, typename M>
+	struct processor_base : P
+	{
+		typedef T decode_type;
+		typedef P processor_type;
+		typedef M mmu_type;
+
+		int log_flags;
+		mmu_type mmu;
+
+		processor_base() :
+			P(),
+			log_flags(0)
+		{}
+
+		std::string format_inst(uintptr_t pc)
+		{
+			char buf[20];
+			intptr_t pc_offset;
+			uint64_t inst = mmu.fetch_inst(*this, pc, pc_offset);
+			switch (pc_offset) {
+				case 2:  snprintf(buf, sizeof(buf), "    0x%04tx", inst); break;
+				case 4:  snprintf(buf, sizeof(buf), "0x%08tx", inst); break;
+				case 6:  snprintf(buf, sizeof(buf), "0x%012tx", inst); break;
+				case 8:  snprintf(buf, sizeof(buf), "0x%016tx", inst); break;
+				default: snprintf(buf, sizeof(buf), "(invalid)"); break;
+			}
+			return buf;
+		}
+
+		size_t regnum(T &dec, riscv_operand_name operand_name)
+		{
+			switch (operand_name) {
+				case riscv_operand_name_rd: return dec.rd;
+				case riscv_operand_name_rs1: return dec.rs1;
+				case riscv_operand_name_rs2: return dec.rs2;
+				case riscv_operand_name_frd: return dec.rd;
+				case riscv_operand_name_frs1: return dec.rs1;
+				case riscv_operand_name_frs2: return dec.rs2;
+				case riscv_operand_name_frs3: return dec.rs3;
+				default: return 0;
+			}
+		}
+
+		std::string format_operands(T &dec)
+		{
+			size_t reg;
+			char buf[256];
+			std::vector<std::string> ops;
+			const riscv_operand_data *operand_data = riscv_inst_operand_data[dec.op];
+			while (operand_data->type != riscv_type_none) {
+				std::string op;
+				switch (operand_data->type) {
+					case riscv_type_ireg:
+						reg = regnum(dec, operand_data->operand_name);
+						op += riscv_ireg_name_sym[reg];
+						op += "=";
+						snprintf(buf, sizeof(buf), riscv_type_primitives[operand_data->primitive].format,
+							P::ireg[reg].r.xu.val);
+						op += buf;
+						ops.push_back(op);
+						break;
+					case riscv_type_freg:
+						reg = regnum(dec, operand_data->operand_name);
+						op += riscv_freg_name_sym[reg];
+						op += "=";
+						// show hex value for +/-{inf|subnorm|nan}
+						if (operand_data->primitive == riscv_primitive_f64 ?
+							(f64_classify(P::freg[reg].r.d.val) & 0b1110100101) :
+							(f32_classify(P::freg[reg].r.s.val) & 0b1110100101))
+						{
+							snprintf(buf, sizeof(buf),
+								operand_data->primitive == riscv_primitive_f64 ?
+								"%.17g[0x%016llx]" : "%.9g[0x%08llx]",
+								operand_data->primitive == riscv_primitive_f64 ?
+								P::freg[reg].r.d.val : P::freg[reg].r.s.val,
+								operand_data->primitive == riscv_primitive_f64 ?
+								P::freg[reg].r.lu.val : P::freg[reg].r.wu.val);
+						} else {
+							snprintf(buf, sizeof(buf),
+								operand_data->primitive == riscv_primitive_f64 ?
+								"%.17g" : "%.9g",
+								operand_data->primitive == riscv_primitive_f64 ?
+								P::freg[reg].r.d.val : P::freg[reg].r.s.val);
+						}
+						op += buf;
+						ops.push_back(op);
+						break;
+					default: break;
+				}
+				operand_data++;
+			}
+
+	        std::stringstream ss;
+	        ss << "(";
+	        for (auto i = ops.begin(); i != ops.end(); i++) {
+	                ss << (i != ops.begin() ? ", " : "") << *i;
+	        }
+	        ss << ")";
+	        return ss.str();
+		}
+
+		void print_log(T &dec)
+		{
+			static const char *fmt_32 = "core %3zu: 0x%08tx (%s) %-30s %s\n";
+			static const char *fmt_64 = "core %3zu: 0x%016tx (%s) %-30s %s\n";
+			static const char *fmt_128 = "core %3zu: 0x%032tx (%s) %-30s %s\n";
+			if (log_flags & reg_log_inst) {
+				std::string op_args;
+				if (!(log_flags & reg_log_no_pseudo)) decode_pseudo_inst(dec);
+				std::string args = disasm_inst_simple(dec);
+				if (log_flags & reg_log_operands) {
+					op_args = format_operands(dec);
+				}
+				printf(P::xlen == 32 ? fmt_32 : P::xlen == 64 ? fmt_64 : fmt_128,
+					P::hart_id, uintptr_t(P::pc), format_inst(P::pc).c_str(), args.c_str(), op_args.c_str());
+			}
+			if (log_flags & reg_log_int) print_int_registers();
+			if (log_flags & reg_log_f32) print_f32_registers();
+			if (log_flags & reg_log_f64) print_f64_registers();
+		}
+
+		void print_int_registers()
+		{
+			for (size_t i = riscv_ireg_x0; i < P::ireg_count; i++) {
+				char fmt[32];
+				snprintf(fmt, sizeof(fmt), "%%-4s: 0x%%0%u%sx%%s",
+					(P::xlen >> 2), P::xlen == 64 ? "ll" : "");
+				printf(fmt, riscv_ireg_name_sym[i],
+					P::ireg[i].r.xu.val, (i + 1) % 4 == 0 ? "\n" : " ");
+			}
+		}
+
+		void print_f32_registers()
+		{
+			for (size_t i = riscv_freg_f0; i < P::freg_count; i++) {
+				printf("%-4s: s %16.5f%s", riscv_freg_name_sym[i],
+					P::freg[i].r.s.val, (i + 1) % 4 == 0 ? "\n" : " ");
+			}
+		}
+
+		void print_f64_registers()
+		{
+			for (size_t i = riscv_freg_f0; i < P::freg_count; i++) {
+				printf("%-4s: d %16.5f%s", riscv_freg_name_sym[i],
+					P::freg[i].r.d.val, (i + 1) % 4 == 0 ? "\n" : " ");
+			}
+		}
+	};
+
+
+	/* Decode and Exec template parameters */
+
+#define RV_32  /*rv32*/true,  /*rv64*/false
+#define RV_64  /*rv32*/false, /*rv64*/true
+
+#define RV_IMA    /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/false,/*D*/false,/*C*/false
+#define RV_IMAC   /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/false,/*D*/false,/*C*/true
+#define RV_IMAFD  /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/true, /*D*/true, /*C*/false
+#define RV_IMAFDC /*I*/true, /*M*/true, /*A*/true, /*S*/true, /*F*/true, /*D*/true, /*C*/true
+
+
+	/* RV32 Partial processor specialization templates (RV32IMA, RV32IMAC, RV32IMAFD, RV32IMAFDC) */
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv32ima_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_32,RV_IMA>(dec, inst);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv32<RV_IMA>(dec, *this, pc_offset);
+		}
+	};
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv32imac_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_32,RV_IMAC>(dec, inst);
+			decompress_inst_rv32<T>(dec);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv32<RV_IMAC>(dec, *this, pc_offset);
+		}
+	};
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv32imafd_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_32,RV_IMAFD>(dec, inst);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv32<RV_IMAFD>(dec, *this, pc_offset);
+		}
+	};
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv32imafdc_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_32,RV_IMAFDC>(dec, inst);
+			decompress_inst_rv32<T>(dec);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv32<RV_IMAFDC>(dec, *this, pc_offset);
+		}
+	};
+
+
+	/* RV64 Partial processor specialization templates (RV64IMA, RV64IMAC, RV64IMAFD, RV64IMAFDC) */
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv64ima_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_64,RV_IMA>(dec, inst);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv64<RV_IMA>(dec, *this, pc_offset);
+		}
+	};
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv64imac_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_64,RV_IMAC>(dec, inst);
+			decompress_inst_rv64<T>(dec);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv64<RV_IMAC>(dec, *this, pc_offset);
+		}
+	};
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv64imafd_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_64,RV_IMAFD>(dec, inst);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv64<RV_IMAFD>(dec, *this, pc_offset);
+		}
+	};
+
+	template <typename T, typename P, typename M, typename B = processor_base<T,P,M>>
+	struct processor_rv64imafdc_unit : B
+	{
+		void inst_decode(T &dec, uint64_t inst) {
+			decode_inst<T,RV_64,RV_IMAFDC>(dec, inst);
+			decompress_inst_rv64<T>(dec);
+		}
+
+		intptr_t inst_exec(T &dec, intptr_t pc_offset) {
+			return exec_inst_rv64<RV_IMAFDC>(dec, *this, pc_offset);
+		}
+	};
+
+
+	/* Processor ABI/AEE proxy emulator that delegates ecall to an abi proxy */
+
+	template <typename P>
+	struct processor_proxy : P
+	{
+		typedef processor_proxy<P> proxy_type;
+
+		enum csr_op { csr_rw, csr_rs, csr_rc };
+
+		/* guest thread state */
+		long tid;
+		uintptr_t clear_child_tid;
+		bool thread_exit;
+		int exit_code;
+
+		/* fork server snapshot, stepping stops when a jump or ecall reaches snapshot_pc */
+		abi_snapshot_marker snapshot_marker;
+		uintptr_t snapshot_pc;
+
+		processor_proxy() : P(), tid(getpid()), clear_child_tid(0), thread_exit(false), exit_code(0),
+			snapshot_marker(abi_snapshot_none), snapshot_pc(~uintptr_t(0)) {}
+
+		template <typename T>
+		void update_csr(typename P::decode_type &dec, csr_op op, T &csr, typename P::ux value,
+			size_t msb, size_t lsb)
+		{
+			const size_t shift = lsb, mask = (1 << (msb - lsb + 1)) - 1;
+			if (dec.rd != riscv_ireg_x0) P::ireg[dec.rd] = (csr >> shift) & mask;
+			switch (op) {
+				case csr_rw: csr = value; break;
+				case csr_rs: if (value) csr |= ((value & mask) << shift); break;
+				case csr_rc: if (value) csr &= ~((value & mask) << shift); break;
+			}
+		}
+
+		template <typename T>
+		void read_csr(typename P::decode_type &dec, csr_op op, T &csr, typename P::ux value)
+		{
+			if (dec.rd != riscv_ireg_x0) P::ireg[dec.rd] = csr;
+		}
+
+		template <typename T>
+		void read_csr_hi(typename P::decode_type &dec, csr_op op, T &csr, typename P::ux value)
+		{
+			if (dec.rd != riscv_ireg_x0) P::ireg[dec.rd] = s32(u32(csr >> 32));
+		}
+
+		intptr_t inst_csr(typename P::decode_type &dec, csr_op op, int csr, typename P::ux value, intptr_t pc_offset)
+		{
+			switch (csr) {
+				case riscv_csr_fflags:   fenv_getflags(P::fcsr);
+				                         update_csr(dec, op, P::fcsr, value, 4, 0);
+				                         fenv_clearflags(P::fcsr);                  break;
+				case riscv_csr_frm:      update_csr(dec, op, P::fcsr, value, 7, 5);
+				                         fenv_setrm((P::fcsr >> 5) & 0x7);          break;
+				case riscv_csr_fcsr:     fenv_getflags(P::fcsr);
+				                         update_csr(dec, op, P::fcsr, value, 7, 0);
+				                         fenv_clearflags(P::fcsr);
+				                         fenv_setrm((P::fcsr >> 5) & 0x7);          break;
+				case riscv_csr_cycle:    update_cycle();
+				                         read_csr(dec, op, P::cycle, value);     	break;
+				case riscv_csr_time:     update_time();
+				                         read_csr(dec, op, P::time, value);         break;
+				case riscv_csr_instret:  read_csr(dec, op, P::instret, value);      break;
+				case riscv_csr_cycleh:   update_cycle();
+				                         read_csr_hi(dec, op, P::cycle, value);     break;
+				case riscv_csr_timeh:    update_time();
+				                         read_csr_hi(dec, op, P::time, value);      break;
+				case riscv_csr_instreth: read_csr_hi(dec, op, P::instret, value);   break;
+				default: return 0; /* illegal instruction */
+			}
+			return pc_offset;
+		}
+
+		/* cycle follows instret in deterministic time mode */
+		void update_cycle()
+		{
+			P::cycle = P::mmu.clock->mode == proxy_clock_instret ? P::instret : cpu_cycle_clock();
+		}
+
+		void update_time()
+		{
+			P::time = P::mmu.clock->time_csr(P::instret);
+		}
+
+		/* the proxy has no asynchronous events, only guest thread and process exit and the snapshot */
+		bool check_events()
+		{
+			return !thread_exit && !P::mmu.threads->exiting && uintptr_t(P::pc) != snapshot_pc;
+		}
+
+		intptr_t inst_priv(typename P::decode_type &dec, intptr_t pc_offset) {
+			switch (dec.op) {
+				case riscv_op_ecall:  proxy_syscall(*this); return pc_offset;
+				case riscv_op_fence:  __atomic_thread_fence(__ATOMIC_SEQ_CST); return pc_offset;
+				case riscv_op_fence_i: return pc_offset;
+				case riscv_op_csrrw:  return inst_csr(dec, csr_rw, dec.imm & 0xfff, P::ireg[dec.rs1], pc_offset);
+				case riscv_op_csrrs:  return inst_csr(dec, csr_rs, dec.imm & 0xfff, P::ireg[dec.rs1], pc_offset);
+				case riscv_op_csrrc:  return inst_csr(dec, csr_rc, dec.imm & 0xfff, P::ireg[dec.rs1], pc_offset);
+				case riscv_op_csrrwi: return inst_csr(dec, csr_rw, dec.imm & 0xfff, dec.rs1, pc_offset);
+				case riscv_op_csrrsi: return inst_csr(dec, csr_rs, dec.imm & 0xfff, dec.rs1, pc_offset);
+				case riscv_op_csrrci: return inst_csr(dec, csr_rc, dec.imm & 0xfff, dec.rs1, pc_offset);
+				default: break;
+			}
+			return 0; /* illegal instruction */
+		}
+	};
+
+
+	/* Simple processor stepper with instruction cache */
+
+	template <typename P>
+	struct processor_stepper : P
+	{
+		static const size_t inst_cache_size = 8191;
+
+		struct riscv_inst_cache_ent
+		{
+			uint64_t inst;
+			typename P::decode_type dec;
+		};
+
+		riscv_inst_cache_ent inst_cache[inst_cache_size];
+
+		bool step(size_t count)
+		{
+			typename P::decode_type dec;
+			size_t i = 0;
+			uint64_t inst;
+			intptr_t pc_offset, new_offset;
+			while (i < count) {
+				inst = P::mmu.fetch_inst(*this, P::pc, pc_offset);
+				uint64_t inst_cache_key = inst % inst_cache_size;
+				if (inst_cache[inst_cache_key].inst == inst) {
+					dec = inst_cache[inst_cache_key].dec;
+				} else {
+					P::inst_decode(dec, inst);
+					inst_cache[inst_cache_key].inst = inst;
+					inst_cache[inst_cache_key].dec = dec;
+				}
+				typename P::ux next_pc = P::pc + pc_offset;
+				if ((new_offset = P::inst_exec(dec, pc_offset)) ||
+					(new_offset = P::inst_priv(dec, pc_offset)))
+				{
+					P::pc += new_offset;
+					P::cycle++;
+					P::instret++;
+					i++;
+					if (P::log_flags) P::print_log(dec);
+					/* poll asynchronous events at the end of each basic block, ecall and wfi */
+					if ((P::pc != next_pc || dec.op == riscv_op_ecall || dec.op == riscv_op_wfi) &&
+						!P::check_events()) return false;
+					continue;
+				}
+				debug("illegal instruciton: pc=0x%tx inst=%s",
+					uintptr_t(P::pc), P::format_inst(P::pc).c_str());
+				return false;
+			}
+			/* and at least every count instructions to bound interrupt latency */
+			return P::check_events();
+		}
+	};
+
+
+	/* Parameterized ABI proxy processor models */
+
+	using proxy_emulator_rv32ima = processor_stepper<processor_proxy<processor_rv32ima_unit<decode,processor_rv32imafd,mmu_proxy>>>;
+	using proxy_emulator_rv32imac = processor_stepper<processor_proxy<processor_rv32imac_unit<decode,processor_rv32imafd,mmu_proxy>>>;
+	using proxy_emulator_rv32imafd = processor_stepper<processor_proxy<processor_rv32imafd_unit<decode,processor_rv32imafd,mmu_proxy>>>;
+	using proxy_emulator_rv32imafdc = processor_stepper<processor_proxy<processor_rv32imafdc_unit<decode,processor_rv32imafd,mmu_proxy>>>;
+	using proxy_emulator_rv64ima = processor_stepper<processor_proxy<processor_rv64ima_unit<decode,processor_rv64imafd,mmu_proxy>>>;
+	using proxy_emulator_rv64imac = processor_stepper<processor_proxy<processor_rv64imac_unit<decode,processor_rv64imafd,mmu_proxy>>>;
+	using proxy_emulator_rv64imafd = processor_stepper<processor_proxy<processor_rv64imafd_unit<decode,processor_rv64imafd,mmu_proxy>>>;
+	using proxy_emulator_rv64imafdc = processor_stepper<processor_proxy<processor_rv64imafdc_unit<decode,processor_rv64imafd,mmu_proxy>>>;
+
+}
+
+#endif
@@ -153,7 +153,9 @@ namespace riscv {
 		size_t hart_id;
 		u64 flags;
 		UX pc;
-		SX lr;
+		SX lr;                        /* LR/SC reserved address, -1 if none */
+		u64 lr_version;               /* reservation table slot observed by LR */
+		u64 lr_value;                 /* value loaded by LR */
 
 		IREG ireg[ireg_count];
 		FREG freg[freg_count];
@@ -165,7 +167,7 @@ namespace riscv {
 		u64          instret;         /* User Number of Instructions Retired  */
 		UX           fcsr;            /* Floating-Point Control and Status Register */
 
-		processor() : node_id(0), hart_id(0), flags(0), pc(0), lr(-1), ireg(), freg(),
+		processor() : node_id(0), hart_id(0), flags(0), pc(0), lr(-1), lr_version(0), lr_value(0), ireg(), freg(),
 			time(0), cycle(0), instret(0), fcsr(0) {}
 	};
 
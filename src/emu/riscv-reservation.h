@@ -0,0 +1,118 @@
+//
+//  riscv-reservation.h
+//
+
+#ifndef riscv_reservation_h
+#define riscv_reservation_h
+
+namespace riscv {
+
+	/*
+	 * LR/SC reservation table shared by all harts.
+	 *
+	 * Host addresses are hashed at cache line granularity to a slot holding
+	 * a version number shifted left by one and a reserved bit. LR sets the
+	 * reserved bit and records the slot value and the loaded value in the
+	 * hart. Every store to guest memory (interpreter, AMO or device) calls
+	 * invalidate, which costs one hashed load unless the line is reserved,
+	 * in which case the version is bumped and the bit cleared. SC succeeds
+	 * if the slot still holds the recorded value and a compare and exchange
+	 * against the loaded value succeeds; the compare and exchange catches a
+	 * store whose invalidate was reordered after the LR. Lines that hash to
+	 * the same slot cause spurious SC failures, which the ISA permits.
+	 */
+
+	struct reservation_table
+	{
+		enum : size_t {
+			table_bits = 12,
+			table_size = size_t(1) << table_bits,
+			line_shift = 6
+		};
+
+		enum : u64 {
+			reserved = 1
+		};
+
+		std::atomic<u64> slots[table_size];
+
+		static size_t index(const void *addr)
+		{
+			return size_t(((uintptr_t(addr) >> line_shift) * 0x9e3779b97f4a7c15ULL) >> (64 - table_bits));
+		}
+
+		/* reserve the line containing addr, returns the value SC must observe */
+		u64 reserve(const void *addr)
+		{
+			return slots[index(addr)].fetch_or(reserved, std::memory_order_acq_rel) | reserved;
+		}
+
+		bool valid(const void *addr, u64 version)
+		{
+			return slots[index(addr)].load(std::memory_order_acquire) == version;
+		}
+
+		/* break any reservation on the line containing addr, called after a store */
+		void invalidate(const void *addr)
+		{
+			std::atomic<u64> &slot = slots[index(addr)];
+			u64 val = slot.load(std::memory_order_relaxed);
+			if (val & reserved) slot.compare_exchange_strong(val, val + 1, std::memory_order_release);
+		}
+
+		void invalidate_range(const void *addr, size_t len)
+		{
+			uintptr_t line = uintptr_t(addr) >> line_shift;
+			uintptr_t last = (uintptr_t(addr) + len - 1) >> line_shift;
+			for (; line <= last; line++) invalidate((const void*)(line << line_shift));
+		}
+
+		static reservation_table& global();
+	};
+
+	template <typename T = void>
+	struct reservation_table_global
+	{
+		static reservation_table table;
+	};
+
+	template <typename T> reservation_table reservation_table_global<T>::table;
+
+	inline reservation_table& reservation_table::global()
+	{
+		return reservation_table_global<>::table;
+	}
+
+	inline void reservation_invalidate(const void *addr)
+	{
+		reservation_table::global().invalidate(addr);
+	}
+
+	/* LR: reserve the line then load, recording the reservation in the hart */
+	template <typename P, typename T>
+	T load_reserved(P &proc, T *addr, bool aq, bool rl)
+	{
+		proc.lr_version = reservation_table::global().reserve(addr);
+		T val = amo_load_mo(aq, rl, [&](auto mo) { return __atomic_load_n(addr, decltype(mo)::value); });
+		proc.lr_value = u64(val);
+		return val;
+	}
+
+	/* SC: store if the reservation is intact, returns true on success */
+	template <typename P, typename T, typename V>
+	bool store_conditional(P &proc, T *addr, V val, bool aq, bool rl)
+	{
+		reservation_table &table = reservation_table::global();
+		if (!table.valid(addr, proc.lr_version)) return false;
+		T expected = T(proc.lr_value);
+		bool success = amo_mo(aq, rl, [&](auto mo) {
+			return __atomic_compare_exchange_n(addr, &expected, T(val), false,
+				decltype(mo)::value, __ATOMIC_RELAXED);
+		});
+		if (success) table.invalidate(addr);
+		return success;
+	}
+
+}
+
+#endif
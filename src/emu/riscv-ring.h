@@ -0,0 +1,84 @@
+//
+//  riscv-ring.h
+//
+
+#ifndef riscv_ring_h
+#define riscv_ring_h
+
+namespace riscv {
+
+	/*
+	 * Single producer single consumer lock-free ring buffer.
+	 *
+	 * The producer owns tail and the consumer owns head. Each side keeps
+	 * them on separate cache lines so that enqueue is a store to the slot
+	 * and a release store of tail.
+	 */
+
+	template <typename T, const size_t ring_size>
+	struct spsc_ring
+	{
+		static_assert((ring_size & (ring_size - 1)) == 0, "ring_size must be a power of 2");
+
+		enum : size_t { mask = ring_size - 1 };
+
+		alignas(64) std::atomic<size_t> head;
+		alignas(64) std::atomic<size_t> tail;
+		alignas(64) T buf[ring_size];
+
+		spsc_ring() : head(0), tail(0) {}
+
+		bool empty() const
+		{
+			return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+		}
+
+		size_t size() const
+		{
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+		/* producer: returns false if the ring is full */
+		bool push(const T &val)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == ring_size) return false;
+			buf[t & mask] = val;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* producer: enqueue up to count items, returns the number enqueued */
+		size_t push(const T *vals, size_t count)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			size_t n = std::min(count, ring_size - (t - head.load(std::memory_order_acquire)));
+			for (size_t i = 0; i < n; i++) buf[(t + i) & mask] = vals[i];
+			tail.store(t + n, std::memory_order_release);
+			return n;
+		}
+
+		/* consumer: returns false if the ring is empty */
+		bool pop(T &val)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return false;
+			val = buf[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* consumer: dequeue up to count items, returns the number dequeued */
+		size_t pop(T *vals, size_t count)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			size_t n = std::min(count, tail.load(std::memory_order_acquire) - h);
+			for (size_t i = 0; i < n; i++) vals[i] = buf[(h + i) & mask];
+			head.store(h + n, std::memory_order_release);
+			return n;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+//
+//  riscv-scheduler.h
+//
+
+#ifndef riscv_scheduler_h
+#define riscv_scheduler_h
+
+namespace riscv {
+
+	/*
+	 * Deterministic round-robin scheduler running all harts on one host thread.
+	 *
+	 * Each round visits the harts in an order drawn from a seeded generator
+	 * and steps each runnable hart for one instruction quantum. Time is the
+	 * clint's virtual time, which advances one quantum per round, so the
+	 * interleaving and every value the guest can observe depend only on the
+	 * seed, the quantum and the program. Harts parked in wfi are skipped
+	 * until an event is pending or their deadline passes, and when every
+	 * hart is parked virtual time skips to the earliest deadline. Host
+	 * input reaches devices only through poll_devices at the start of
+	 * each round, so it arrives at the same instruction in every run.
+	 *
+	 * The harts are the same objects stepped by the parallel mode, and as
+	 * in parallel mode the run ends when the boot hart stops.
+	 */
+
+	template <typename P>
+	struct round_robin_scheduler
+	{
+		typedef typename P::clint_type clint_type;
+
+		std::vector<P*> harts;
+		clint_type &timer;
+		u64 quantum;
+		std::mt19937 twister;
+		std::vector<bool> stopped;
+		std::vector<u64> hart_ns;   /* host time spent stepping each hart */
+		std::function<void()> poll_devices; /* feeds host input to devices between rounds */
+
+		u64 rounds;                 /* statistics */
+		u64 switches;
+		u64 total_ns;
+
+		round_robin_scheduler(std::vector<P*> harts, clint_type &timer, u64 quantum, std::seed_seq &seq) :
+			harts(harts), timer(timer), quantum(quantum), twister(seq),
+			stopped(harts.size()), hart_ns(harts.size()),
+			rounds(0), switches(0), total_ns(0) {}
+
+		/* Fisher-Yates shuffle on raw generator output, identical across standard libraries */
+		void shuffle(std::vector<size_t> &order)
+		{
+			for (size_t i = order.size() - 1; i > 0; i--) {
+				std::swap(order[i], order[twister() % (i + 1)]);
+			}
+		}
+
+		void run()
+		{
+			std::vector<size_t> order(harts.size());
+			for (size_t i = 0; i < order.size(); i++) order[i] = i;
+			u64 start = clint_type::host_ns();
+			while (!stopped[0]) {
+				if (poll_devices) poll_devices();
+				shuffle(order);
+				bool ran = false;
+				for (size_t i : order) {
+					P &hart = *harts[i];
+					if (stopped[i] || (hart.wfi_waiting && !timer.wfi_wake(hart))) continue;
+					u64 step_start = clint_type::host_ns();
+					bool running = hart.step(quantum);
+					hart_ns[i] += clint_type::host_ns() - step_start;
+					switches++;
+					ran = true;
+					if (!running && !hart.wfi_waiting) {
+						stopped[i] = true;
+						timer.hart_stopped();
+					}
+				}
+				timer.virtual_instret += quantum;
+				rounds++;
+				if (!ran && !timer.skip_to_deadline()) {
+					debug("wfi: no timer deadline or device interrupt: halting");
+					break;
+				}
+			}
+			total_ns = clint_type::host_ns() - start;
+		}
+
+		/* host time spent outside the harts, per hart switch */
+		double switch_overhead_ns()
+		{
+			u64 step_ns = 0;
+			for (auto ns : hart_ns) step_ns += ns;
+			return switches ? double(total_ns - step_ns) / switches : 0.0;
+		}
+	};
+
+}
+
+#endif
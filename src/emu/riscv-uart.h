@@ -0,0 +1,238 @@
+//
+//  riscv-uart.h
+//
+
+#ifndef riscv_uart_h
+#define riscv_uart_h
+
+namespace riscv {
+
+	/*
+	 * 16550 compatible UART with byte wide registers.
+	 *
+	 * Transmitted bytes are enqueued on a lock-free ring that a host writer
+	 * thread drains to the output fd with large writes. A host reader thread
+	 * fills the receive ring from the input fd, or with rx_polled the owner
+	 * fills it with poll_input at points it chooses, which makes the bytes
+	 * the guest sees at each point reproducible for a regular file. The
+	 * guest never waits on host I/O; a transmit is a single ring enqueue
+	 * unless the ring is full.
+	 */
+
+	template <typename UX>
+	struct uart_16550 : user_memory_device<UX>
+	{
+		enum : size_t {
+			ring_size = 65536,
+			write_chunk = 4096
+		};
+
+		enum reg {
+			reg_rbr_thr_dll = 0, /* receive buffer, transmit holding, divisor latch low */
+			reg_ier_dlm     = 1, /* interrupt enable, divisor latch high */
+			reg_iir_fcr     = 2, /* interrupt identification, fifo control */
+			reg_lcr         = 3, /* line control */
+			reg_mcr         = 4, /* modem control */
+			reg_lsr         = 5, /* line status */
+			reg_msr         = 6, /* modem status */
+			reg_scr         = 7, /* scratch */
+		};
+
+		enum : u8 {
+			ier_rx_avail    = 1<<0,
+			ier_tx_empty    = 1<<1,
+			iir_no_intr     = 0x01,
+			iir_tx_empty    = 0x02,
+			iir_rx_avail    = 0x04,
+			iir_fifo_enable = 0xc0,
+			lcr_dlab        = 1<<7,
+			lsr_data_ready  = 1<<0,
+			lsr_thr_empty   = 1<<5,
+			lsr_tx_empty    = 1<<6,
+			msr_dcd_dsr_cts = 0xb0,
+		};
+
+		spsc_ring<u8,ring_size> tx;
+		spsc_ring<u8,ring_size> rx;
+
+		std::atomic<u8> ier;        /* read by the reader thread */
+		u8 lcr, mcr, scr, dll, dlm, fcr;
+		int out_fd, in_fd;
+		std::atomic<bool> running;
+		std::atomic<bool> rx_open;  /* the input may still raise receive interrupts */
+		bool rx_polled;             /* input is read by poll_input instead of the reader thread */
+		std::thread writer;
+		std::thread reader;
+		std::function<void(bool)> irq; /* receive interrupt line, raised from the reader thread */
+
+		u64 tx_bytes;               /* statistics */
+		u64 rx_bytes;
+		u64 host_writes;
+		u64 tx_full;
+
+		uart_16550(int out_fd = fileno(stdout), int in_fd = -1) :
+			ier(0), lcr(0), mcr(0), scr(0), dll(0), dlm(0), fcr(0),
+			out_fd(out_fd), in_fd(in_fd), running(false), rx_open(false), rx_polled(false),
+			tx_bytes(0), rx_bytes(0), host_writes(0), tx_full(0) {}
+
+		~uart_16550() { stop(); }
+
+		void start()
+		{
+			running = true;
+			writer = std::thread(&uart_16550::writer_loop, this);
+			if (in_fd >= 0) {
+				rx_open = true;
+				if (!rx_polled) reader = std::thread(&uart_16550::reader_loop, this);
+			}
+		}
+
+		/* stop the host threads after draining the transmit ring */
+		void stop()
+		{
+			if (!running) return;
+			running = false;
+			if (writer.joinable()) writer.join();
+			if (reader.joinable()) reader.join();
+		}
+
+		static void idle()
+		{
+			struct timespec ts = { 0, 1000000 };
+			nanosleep(&ts, nullptr);
+		}
+
+		void writer_loop()
+		{
+			u8 buf[write_chunk];
+			for (;;) {
+				bool stopping = !running.load(std::memory_order_acquire);
+				size_t n = tx.pop(buf, sizeof(buf));
+				if (n == 0) {
+					if (stopping) break;
+					idle();
+					continue;
+				}
+				for (size_t off = 0; off < n; ) {
+					ssize_t ret = write(out_fd, buf + off, n - off);
+					if (ret <= 0) break;
+					off += ret;
+				}
+				host_writes++;
+			}
+		}
+
+		void reader_loop()
+		{
+			u8 buf[write_chunk];
+			struct pollfd pfd = { in_fd, POLLIN, 0 };
+			while (running.load(std::memory_order_acquire)) {
+				/* wait for the guest to drain a full ring, a zero length read is not EOF */
+				size_t space = std::min(sizeof(buf), ring_size - rx.size());
+				if (space == 0) {
+					idle();
+					continue;
+				}
+				if (poll(&pfd, 1, 100) <= 0) continue;
+				ssize_t n = read(in_fd, buf, space);
+				if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+				if (n <= 0) break;
+				for (size_t off = 0; off < size_t(n) && running.load(std::memory_order_acquire); ) {
+					off += rx.push(buf + off, n - off);
+					if (off < size_t(n)) idle();
+				}
+				if ((ier & ier_rx_avail) && irq) irq(true);
+			}
+			rx_open = false;
+		}
+
+		/* rx_polled: fill the receive ring with as much input as fits */
+		void poll_input()
+		{
+			if (!rx_open.load(std::memory_order_relaxed)) return;
+			u8 buf[write_chunk];
+			size_t space = std::min(sizeof(buf), ring_size - rx.size());
+			if (space == 0) return;
+			ssize_t n;
+			do n = read(in_fd, buf, space); while (n < 0 && errno == EINTR);
+			if (n <= 0) {
+				rx_open = false;
+				return;
+			}
+			rx.push(buf, n);
+			if ((ier & ier_rx_avail) && irq) irq(true);
+		}
+
+		/* rx_polled: true while poll_input can still deliver input */
+		bool rx_pending()
+		{
+			return rx_open.load(std::memory_order_relaxed) && rx.size() < ring_size;
+		}
+
+		u8 iir()
+		{
+			u8 id = iir_no_intr;
+			if ((ier & ier_rx_avail) && !rx.empty()) id = iir_rx_avail;
+			else if (ier & ier_tx_empty) id = iir_tx_empty;
+			return id | ((fcr & 1) ? iir_fifo_enable : 0);
+		}
+
+		bool load(UX offset, u64 &val, size_t size)
+		{
+			u8 c = 0;
+			switch (offset) {
+				case reg_rbr_thr_dll:
+					if (lcr & lcr_dlab) c = dll;
+					else if (rx.pop(c)) {
+						rx_bytes++;
+						if (rx.empty() && irq) irq(false);
+					}
+					break;
+				case reg_ier_dlm: c = (lcr & lcr_dlab) ? dlm : ier.load(); break;
+				case reg_iir_fcr: c = iir(); break;
+				case reg_lcr:     c = lcr; break;
+				case reg_mcr:     c = mcr; break;
+				case reg_lsr:     c = lsr_thr_empty | lsr_tx_empty | (rx.empty() ? 0 : lsr_data_ready); break;
+				case reg_msr:     c = msr_dcd_dsr_cts; break;
+				case reg_scr:     c = scr; break;
+				default: return false;
+			}
+			val = c;
+			return true;
+		}
+
+		bool store(UX offset, u64 val, size_t size)
+		{
+			u8 c = u8(val);
+			switch (offset) {
+				case reg_rbr_thr_dll:
+					if (lcr & lcr_dlab) {
+						dll = c;
+					} else {
+						while (!tx.push(c)) {
+							tx_full++;
+							idle();
+						}
+						tx_bytes++;
+					}
+					break;
+				case reg_ier_dlm:
+					if (lcr & lcr_dlab) dlm = c;
+					else ier = c & 0x0f;
+					if (irq) irq((ier & ier_rx_avail) && !rx.empty());
+					break;
+				case reg_iir_fcr: fcr = c; break;
+				case reg_lcr:     lcr = c; break;
+				case reg_mcr:     mcr = c; break;
+				case reg_lsr:     break;
+				case reg_msr:     break;
+				case reg_scr:     scr = c; break;
+				default: return false;
+			}
+			return true;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,453 @@
+//
+//  riscv-virtio.h
+//
+
+#ifndef riscv_virtio_h
+#define riscv_virtio_h
+
+namespace riscv {
+
+	/* virtio-mmio version 2 register offsets */
+
+	enum virtio_mmio_reg
+	{
+		virtio_mmio_magic_value         = 0x000,
+		virtio_mmio_version             = 0x004,
+		virtio_mmio_device_id           = 0x008,
+		virtio_mmio_vendor_id           = 0x00c,
+		virtio_mmio_device_features     = 0x010,
+		virtio_mmio_device_features_sel = 0x014,
+		virtio_mmio_driver_features     = 0x020,
+		virtio_mmio_driver_features_sel = 0x024,
+		virtio_mmio_queue_sel           = 0x030,
+		virtio_mmio_queue_num_max       = 0x034,
+		virtio_mmio_queue_num           = 0x038,
+		virtio_mmio_queue_ready         = 0x044,
+		virtio_mmio_queue_notify        = 0x050,
+		virtio_mmio_interrupt_status    = 0x060,
+		virtio_mmio_interrupt_ack       = 0x064,
+		virtio_mmio_status              = 0x070,
+		virtio_mmio_queue_desc_low      = 0x080,
+		virtio_mmio_queue_desc_high     = 0x084,
+		virtio_mmio_queue_driver_low    = 0x090,
+		virtio_mmio_queue_driver_high   = 0x094,
+		virtio_mmio_queue_device_low    = 0x0a0,
+		virtio_mmio_queue_device_high   = 0x0a4,
+		virtio_mmio_config_generation   = 0x0fc,
+		virtio_mmio_config              = 0x100,
+	};
+
+	/* split virtqueue layout */
+
+	struct virtq_desc
+	{
+		u64 addr;
+		u32 len;
+		u16 flags;
+		u16 next;
+	};
+
+	enum : u16 {
+		virtq_desc_f_next  = 1,
+		virtq_desc_f_write = 2
+	};
+
+	struct virtq_used_elem
+	{
+		u32 id;
+		u32 len;
+	};
+
+	/* block request header */
+
+	struct virtio_blk_req
+	{
+		u32 type;
+		u32 reserved;
+		u64 sector;
+	};
+
+	enum : u32 {
+		virtio_blk_t_in     = 0,
+		virtio_blk_t_out    = 1,
+		virtio_blk_t_flush  = 4,
+		virtio_blk_t_get_id = 8
+	};
+
+	enum : u8 {
+		virtio_blk_s_ok     = 0,
+		virtio_blk_s_ioerr  = 1,
+		virtio_blk_s_unsupp = 2
+	};
+
+	/*
+	 * virtio-mmio block device backed by an mmap'd disk image.
+	 *
+	 * Requests are served with memcpy between guest RAM and the shared
+	 * mapping so reads and writes make no host syscalls. Flush is msync.
+	 * With workers > 0 requests are served on a pool of host threads and
+	 * the notifying hart returns immediately; completion is signalled
+	 * through the used ring and the irq callback.
+	 */
+
+	template <typename UX, typename MEMORY = user_memory<UX>>
+	struct virtio_block : user_memory_device<UX>
+	{
+		typedef MEMORY memory_type;
+		typedef typename memory_type::memory_segment_type memory_segment_type;
+
+		enum : u32 {
+			magic = 0x74726976,   /* "virt" */
+			device_id_block = 2,
+			vendor_id = 0x554d4551,
+			queue_num_max = 256,
+			sector_size = 512
+		};
+
+		enum : u64 {
+			feature_blk_flush = 1ULL << 9,
+			feature_version_1 = 1ULL << 32
+		};
+
+		memory_type *mem;
+		int fd;
+		u8 *image;
+		size_t image_size;
+
+		/* device registers */
+		u32 device_features_sel, driver_features_sel, queue_sel, status;
+		u64 driver_features;
+		u32 queue_num, queue_ready;
+		u64 desc_addr, avail_addr, used_addr;
+		std::atomic<u32> interrupt_status;
+		u16 last_avail;
+
+		/* completion and worker pool */
+		std::mutex used_lock;
+		std::mutex work_lock;
+		std::condition_variable work_cond;
+		std::deque<u16> work;
+		std::vector<std::thread> workers;
+		std::atomic<u32> in_flight;   /* requests queued or being served by workers */
+		bool running;
+		std::function<void(bool)> irq;
+
+		/* statistics */
+		std::atomic<u64> requests, bytes_read, bytes_written, flushes, service_ns;
+
+		virtio_block(memory_type *mem) : mem(mem), fd(-1), image(nullptr), image_size(0),
+			device_features_sel(0), driver_features_sel(0), queue_sel(0), status(0),
+			driver_features(0), queue_num(0), queue_ready(0),
+			desc_addr(0), avail_addr(0), used_addr(0), interrupt_status(0), last_avail(0),
+			in_flight(0), running(false), requests(0), bytes_read(0), bytes_written(0), flushes(0), service_ns(0) {}
+
+		~virtio_block()
+		{
+			stop();
+			if (image) munmap(image, image_size);
+			if (fd >= 0) close(fd);
+		}
+
+		/* map the disk image */
+		bool open_image(const char *filename, bool readonly)
+		{
+			struct stat statbuf;
+			fd = open(filename, readonly ? O_RDONLY : O_RDWR);
+			if (fd < 0 || fstat(fd, &statbuf) < 0) {
+				debug("virtio-blk: open: %s: %s", filename, strerror(errno));
+				return false;
+			}
+			image_size = statbuf.st_size & ~size_t(sector_size - 1);
+			void *addr = mmap(nullptr, image_size, PROT_READ | (readonly ? 0 : PROT_WRITE),
+				MAP_SHARED, fd, 0);
+			if (addr == MAP_FAILED) {
+				debug("virtio-blk: mmap: %s: %s", filename, strerror(errno));
+				return false;
+			}
+			image = (u8*)addr;
+			return true;
+		}
+
+		static u64 host_ns()
+		{
+			struct timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return u64(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+		}
+
+		/* throughput in MB/s over the time spent serving reads and writes */
+		double throughput_mbs()
+		{
+			u64 ns = service_ns;
+			return ns ? double(bytes_read + bytes_written) * 1000.0 / double(ns) : 0;
+		}
+
+		void start(size_t num_workers)
+		{
+			running = true;
+			for (size_t i = 0; i < num_workers; i++) {
+				workers.push_back(std::thread(&virtio_block::worker_loop, this));
+			}
+		}
+
+		void stop()
+		{
+			{
+				std::unique_lock<std::mutex> lock(work_lock);
+				running = false;
+			}
+			work_cond.notify_all();
+			for (auto &t : workers) t.join();
+			workers.clear();
+		}
+
+		void worker_loop()
+		{
+			for (;;) {
+				u16 head;
+				{
+					std::unique_lock<std::mutex> lock(work_lock);
+					work_cond.wait(lock, [&] { return work.size() > 0 || !running; });
+					if (work.size() == 0) return;
+					head = work.front();
+					work.pop_front();
+				}
+				serve(head);
+				in_flight--;
+			}
+		}
+
+		/* translate a guest physical buffer to a host pointer */
+		u8* guest_ptr(u64 pa, size_t len, bool write)
+		{
+			memory_segment_type *seg = mem->mpa_to_segment(UX(pa));
+			if (!seg || !seg->uva || pa + len > u64(seg->mpa) + seg->size) return nullptr;
+			if (write && seg->dirty) memory_type::mark_dirty(*seg, UX(pa), len);
+			return (u8*)(seg->uva + (UX(pa) - seg->mpa));
+		}
+
+		template <typename T> T* guest_struct(u64 pa, bool write = false)
+		{
+			return (T*)guest_ptr(pa, sizeof(T), write);
+		}
+
+		/* device writes to guest memory break LR/SC reservations */
+		static void guest_written(const void *ptr, size_t len)
+		{
+			reservation_table::global().invalidate_range(ptr, len);
+		}
+
+		/* consume available descriptor chain heads */
+		void notify()
+		{
+			if (!queue_ready || queue_num == 0) return;
+			u16 *avail_idx = guest_struct<u16>(avail_addr + 2);
+			if (!avail_idx) return;
+			u16 idx = __atomic_load_n(avail_idx, __ATOMIC_ACQUIRE);
+			while (last_avail != idx) {
+				u16 *ring = guest_struct<u16>(avail_addr + 4 + 2 * (last_avail % queue_num));
+				last_avail++;
+				if (!ring) continue;
+				if (workers.size() > 0) {
+					std::unique_lock<std::mutex> lock(work_lock);
+					in_flight++;
+					work.push_back(*ring);
+				} else {
+					serve(*ring);
+				}
+			}
+			if (workers.size() > 0) work_cond.notify_all();
+		}
+
+		/* a completion interrupt may still be raised from a worker thread */
+		bool busy()
+		{
+			return in_flight.load(std::memory_order_acquire) > 0;
+		}
+
+		/* serve one request and post it to the used ring */
+		/* read a descriptor once, the guest may change it while the request is served */
+		bool read_desc(u64 table, u32 num, u16 index, virtq_desc &desc)
+		{
+			virtq_desc *d = guest_struct<virtq_desc>(table + sizeof(virtq_desc) * (index % num));
+			if (!d) return false;
+			desc = *d;
+			return true;
+		}
+
+		void serve(u16 head)
+		{
+			u32 num = queue_num;
+			u64 table = desc_addr;
+			if (num == 0) return;
+			u64 start = host_ns();
+			u32 written = 0;
+			u8 status_val = virtio_blk_s_ioerr;
+			virtq_desc desc;
+			virtio_blk_req req, *req_ptr = nullptr;
+			if (read_desc(table, num, head, desc)) req_ptr = guest_struct<virtio_blk_req>(desc.addr);
+			if (req_ptr) req = *req_ptr;
+			u8 *status_ptr = nullptr;
+			bool transfer = false;
+			if (req_ptr) {
+				status_val = virtio_blk_s_ok;
+				u32 type = req.type;
+				transfer = type == virtio_blk_t_in || type == virtio_blk_t_out;
+				/* the sector is guest controlled, check it before scaling so the offset cannot wrap */
+				u64 offset = 0;
+				if (transfer && req.sector > image_size / sector_size) {
+					status_val = virtio_blk_s_ioerr;
+				} else {
+					offset = req.sector * sector_size;
+				}
+				/* a chain longer than the queue has a cycle */
+				u32 hops = 0;
+				while (desc.flags & virtq_desc_f_next) {
+					if (++hops > num) { status_val = virtio_blk_s_ioerr; break; }
+					if (!read_desc(table, num, desc.next, desc)) { status_val = virtio_blk_s_ioerr; break; }
+					if (!(desc.flags & virtq_desc_f_next)) {
+						status_ptr = guest_ptr(desc.addr, 1, true);
+						break;
+					}
+					u32 len = desc.len;
+					u8 *buf = guest_ptr(desc.addr, len, type == virtio_blk_t_in);
+					if (!buf) { status_val = virtio_blk_s_ioerr; continue; }
+					switch (type) {
+						case virtio_blk_t_in:
+						case virtio_blk_t_out:
+							if (status_val != virtio_blk_s_ok || offset > image_size ||
+								len > image_size - offset) {
+								status_val = virtio_blk_s_ioerr;
+							} else if (type == virtio_blk_t_in) {
+								memcpy(buf, image + offset, len);
+								guest_written(buf, len);
+								written += len;
+								bytes_read += len;
+							} else {
+								memcpy(image + offset, buf, len);
+								bytes_written += len;
+							}
+							offset += len;
+							break;
+						case virtio_blk_t_get_id:
+							memset(buf, 0, len);
+							memcpy(buf, "riscv-meta", std::min(size_t(len), size_t(10)));
+							guest_written(buf, len);
+							written += len;
+							break;
+						default:
+							break;
+					}
+				}
+				if (type == virtio_blk_t_flush) {
+					flushes++;
+					if (msync(image, image_size, MS_SYNC) < 0) status_val = virtio_blk_s_ioerr;
+				} else if (type != virtio_blk_t_in && type != virtio_blk_t_out &&
+					type != virtio_blk_t_get_id) {
+					status_val = virtio_blk_s_unsupp;
+				}
+			}
+			if (status_ptr) {
+				*status_ptr = status_val;
+				guest_written(status_ptr, 1);
+				written++;
+			}
+			requests++;
+			if (transfer) service_ns += host_ns() - start;
+			complete(head, written);
+		}
+
+		void complete(u16 head, u32 len)
+		{
+			u32 num = queue_num;
+			if (num == 0) return;
+			{
+				std::unique_lock<std::mutex> lock(used_lock);
+				u16 *used_idx = guest_struct<u16>(used_addr + 2, true);
+				if (!used_idx) return;
+				u16 idx = *used_idx;
+				virtq_used_elem *elem = guest_struct<virtq_used_elem>(used_addr + 4 +
+					sizeof(virtq_used_elem) * (idx % num), true);
+				if (elem) {
+					elem->id = head;
+					elem->len = len;
+					guest_written(elem, sizeof(*elem));
+				}
+				__atomic_store_n(used_idx, u16(idx + 1), __ATOMIC_RELEASE);
+				guest_written(used_idx, sizeof(*used_idx));
+			}
+			interrupt_status.fetch_or(1);
+			if (irq) irq(true);
+		}
+
+		u64 device_features()
+		{
+			return feature_version_1 | feature_blk_flush;
+		}
+
+		bool load(UX offset, u64 &val, size_t size)
+		{
+			if (offset >= virtio_mmio_config) {
+				u64 capacity = image_size / sector_size;
+				size_t off = offset - virtio_mmio_config;
+				val = off < 8 ? capacity >> (off << 3) : 0;
+				return true;
+			}
+			switch (offset) {
+				case virtio_mmio_magic_value:       val = magic; break;
+				case virtio_mmio_version:           val = 2; break;
+				case virtio_mmio_device_id:         val = device_id_block; break;
+				case virtio_mmio_vendor_id:         val = vendor_id; break;
+				case virtio_mmio_device_features:   val = u32(device_features() >> (device_features_sel ? 32 : 0)); break;
+				case virtio_mmio_queue_num_max:     val = queue_sel == 0 ? queue_num_max : 0; break;
+				case virtio_mmio_queue_ready:       val = queue_ready; break;
+				case virtio_mmio_interrupt_status:  val = interrupt_status.load(); break;
+				case virtio_mmio_status:            val = status; break;
+				case virtio_mmio_config_generation: val = 0; break;
+				default: val = 0; break;
+			}
+			return true;
+		}
+
+		static void set_low(u64 &reg, u64 val) { reg = (reg & ~0xffffffffULL) | u32(val); }
+		static void set_high(u64 &reg, u64 val) { reg = (reg & 0xffffffffULL) | (u64(u32(val)) << 32); }
+
+		bool store(UX offset, u64 val, size_t size)
+		{
+			switch (offset) {
+				case virtio_mmio_device_features_sel: device_features_sel = u32(val); break;
+				case virtio_mmio_driver_features:
+					if (driver_features_sel) set_high(driver_features, val);
+					else set_low(driver_features, val);
+					break;
+				case virtio_mmio_driver_features_sel: driver_features_sel = u32(val); break;
+				case virtio_mmio_queue_sel:           queue_sel = u32(val); break;
+				case virtio_mmio_queue_num:           queue_num = std::min(u32(val), u32(queue_num_max)); break;
+				case virtio_mmio_queue_ready:         queue_ready = (u32(val) & 1) && queue_num != 0; break;
+				case virtio_mmio_queue_notify:        notify(); break;
+				case virtio_mmio_interrupt_ack:
+					if ((interrupt_status.fetch_and(~u32(val)) & ~u32(val)) == 0 && irq) irq(false);
+					break;
+				case virtio_mmio_status:
+					status = u32(val);
+					if (status == 0) {
+						queue_ready = 0;
+						last_avail = 0;
+						interrupt_status = 0;
+					}
+					break;
+				case virtio_mmio_queue_desc_low:      set_low(desc_addr, val); break;
+				case virtio_mmio_queue_desc_high:     set_high(desc_addr, val); break;
+				case virtio_mmio_queue_driver_low:    set_low(avail_addr, val); break;
+				case virtio_mmio_queue_driver_high:   set_high(avail_addr, val); break;
+				case virtio_mmio_queue_device_low:    set_low(used_addr, val); break;
+				case virtio_mmio_queue_device_high:   set_high(used_addr, val); break;
+				default: break;
+			}
+			return true;
+		}
+	};
+
+}
+
+#endif
@@ -27,6 +27,110 @@ std::vector<cmdline_option> riscv_gen_interp::get_cmdline_options()
 	};
 }
 
+/*
+ * Rewrite a pseudocode load or store of the form *(T*)ptr(addr) into a call
+ * to proc.mmu.load or proc.mmu.store so that the proxy mmu and the soft-mmu
+ * can interpose on memory accesses. A failed access is an illegal instruction.
+ */
+static std::string mmu_access(std::string inst)
+{
+	size_t ptr_begin = inst.find("ptr(");
+	if (ptr_begin == std::string::npos || ptr_begin < 2) return inst;
+
+	// find the dereference and the pointer type e.g. *(s32*) or *((u32*)
+	size_t deref_begin = inst.rfind("*(", ptr_begin - 2);
+	size_t type_end = ptr_begin - 2;
+	size_t type_begin = inst.rfind('(', type_end) + 1;
+	if (deref_begin == std::string::npos) return inst;
+	std::string type = inst.substr(type_begin, type_end - type_begin);
+	bool extra_paren = inst.compare(deref_begin, 3, "*((") == 0;
+
+	// find the matching parenthesis for the address expression
+	size_t addr_begin = ptr_begin + 4, addr_end = addr_begin;
+	for (int depth = 1; addr_end < inst.size(); addr_end++) {
+		if (inst[addr_end] == '(') depth++;
+		else if (inst[addr_end] == ')' && --depth == 0) break;
+	}
+	std::string addr = inst.substr(addr_begin, addr_end - addr_begin);
+	size_t deref_end = addr_end + (extra_paren ? 2 : 1);
+
+	// store if the dereference is the left hand side of an assignment
+	std::string rest = inst.substr(deref_end);
+	if (deref_begin == 0 && rest.compare(0, 3, " = ") == 0) {
+		std::string val = rest.substr(3);
+		if (val.compare(0, type.size() + 1, type + "(") != 0) {
+			val = type + "(" + val + ")";
+		}
+		return "if (!proc.mmu.store(proc, " + addr + ", " + val + ")) return 0";
+	}
+
+	// otherwise load into a temporary and substitute the temporary
+	return type + " val; if (!proc.mmu.load(proc, " + addr + ", val)) return 0; " +
+		inst.substr(0, deref_begin) + "val" + rest;
+}
+
+/*
+ * Rewrite the pseudocode of LR, SC and AMO instructions, which dereference
+ * rs1 directly, into __atomic builtins on a host pointer returned by
+ * proc.mmu.atomic_ref so that harts running on host threads observe each
+ * other's atomics. The memory order comes from the aq and rl bits via the
+ * amo_mo helpers. AMOs without a matching fetch builtin (min and max) use a
+ * compare and exchange loop around the pseudocode expression. LR and SC use
+ * the shared reservation table and AMOs break reservations on their line.
+ */
+static std::string atomic_access(riscv_opcode_ptr opcode, std::string inst)
+{
+	static const std::map<std::string,std::string> fetch_builtins = {
+		{ "amoswap", "__atomic_exchange_n" },
+		{ "amoadd",  "__atomic_fetch_add" },
+		{ "amoxor",  "__atomic_fetch_xor" },
+		{ "amoor",   "__atomic_fetch_or" },
+		{ "amoand",  "__atomic_fetch_and" },
+	};
+
+	std::string op = opcode->name.substr(0, opcode->name.find('.'));
+	if (op != "lr" && op != "sc" && op.compare(0, 3, "amo") != 0) return inst;
+
+	// find the access type from the dereference of rs1 e.g. *(s32*)rs1
+	size_t type_end = inst.find("*)rs1)");
+	if (type_end == std::string::npos) return inst;
+	size_t type_begin = inst.rfind('(', type_end) + 1;
+	std::string type = inst.substr(type_begin, type_end - type_begin);
+	std::string deref = "*((" + type + "*)rs1)";
+	std::string mo = "decltype(mo)::value";
+	std::string ref = type + " *p = proc.mmu.template atomic_ref<" + type + ">(proc, rs1); " +
+		"if (!p) return 0; ";
+
+	if (op == "lr") {
+		return ref + replace(inst, deref, "load_reserved(proc, p, dec.aq, dec.rl)");
+	}
+
+	// the stored value is the right hand side of the assignment to the dereference
+	size_t store_begin = inst.find(deref + " = ");
+	if (store_begin == std::string::npos) return inst;
+	size_t val_begin = store_begin + deref.size() + 3;
+	size_t val_end = inst.find(';', val_begin);
+	std::string val = inst.substr(val_begin, val_end - val_begin);
+
+	// SC always clears the reservation
+	if (op == "sc") {
+		return ref + "ux res = lr == rs1 && store_conditional(proc, p, " + val +
+			", dec.aq, dec.rl) ? 0 : 1; lr = -1; rd = res";
+	}
+
+	// AMO pseudocode has the form: T t(*(T*)rs1); *((T*)rs1) = expr(t, rs2); rd = t
+	std::string rest = inst.substr(val_end);
+	auto fi = fetch_builtins.find(op);
+	if (fi != fetch_builtins.end()) {
+		return ref + type + " t = amo_mo(dec.aq, dec.rl, [&](auto mo) { return " +
+			fi->second + "(p, " + type + "(rs2), " + mo + "); }); reservation_invalidate(p)" + rest;
+	}
+	return ref + type + " t = __atomic_load_n(p, __ATOMIC_RELAXED); " +
+		"amo_mo(dec.aq, dec.rl, [&](auto mo) { " + type + " n; " +
+		"do { n = " + val + "; } while (!__atomic_compare_exchange_n(p, &t, n, true, " +
+		mo + ", __ATOMIC_RELAXED)); return n; }); reservation_invalidate(p)" + rest;
+}
+
 static void print_interp_h(riscv_gen *gen)
 {
 	printf(kCHeader, "riscv-interp.h");
@@ -55,6 +159,8 @@ static void print_interp_h(riscv_gen *gen)
 			if (inst.size() == 0) continue;
 			if (!opcode->include_isa(isa_width.first)) continue;
 			printf("\t\tcase %s:\n", riscv_meta_model::opcode_format("riscv_op_", opcode, "_").c_str());
+			inst = atomic_access(opcode, inst);
+			inst = mmu_access(inst);
 			inst = replace(inst, "imm", "dec.imm");
 			inst = replace(inst, "ptr", "uintptr_t");
 			inst = replace(inst, "fcsr", "proc.fcsr");
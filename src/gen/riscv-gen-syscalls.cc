@@ -0,0 +1,324 @@
+//
+//  riscv-gen-syscalls.cc
+//
+
+#include <cstdio>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+
+#include "riscv-util.h"
+#include "riscv-cmdline.h"
+#include "riscv-model.h"
+#include "riscv-gen.h"
+
+std::vector<cmdline_option> riscv_gen_syscalls::get_cmdline_options()
+{
+	return std::vector<cmdline_option>{
+		{ "-YH", "--print-abi-types-h", cmdline_arg_type_none,
+			"Print proxy ABI syscall numbers and struct layouts header",
+			[&](std::string s) { return gen->set_option("print_abi_types_h"); } },
+		{ "-YS", "--print-abi-syscalls-h", cmdline_arg_type_none,
+			"Print proxy ABI syscall stubs and dispatch table header",
+			[&](std::string s) { return gen->set_option("print_abi_syscalls_h"); } },
+	};
+}
+
+/* scalar argument types: guest register view and host type */
+
+struct riscv_syscall_scalar
+{
+	const char *name;
+	const char *reg;
+	const char *host_type;
+};
+
+static const riscv_syscall_scalar syscall_scalars[] = {
+	{ "int",   "x",  "int" },
+	{ "uint",  "xu", "unsigned" },
+	{ "long",  "x",  "long" },
+	{ "ulong", "xu", "unsigned long" },
+	{ "size",  "xu", "size_t" },
+	{ "off",   "x",  "off_t" },
+	{ "mode",  "xu", "mode_t" },
+	{ "fd",    "x",  "int" },
+	{ "rfd",   "x",  "int" },
+	{ "cfd",   "x",  "int" },
+	{ nullptr, nullptr, nullptr }
+};
+
+static const riscv_syscall_scalar* lookup_scalar(std::string type)
+{
+	for (const riscv_syscall_scalar *s = syscall_scalars; s->name; s++) {
+		if (type == s->name) return s;
+	}
+	return nullptr;
+}
+
+static std::string guest_field_type(std::string type)
+{
+	if (type == "int") return "typename P::int_t";
+	if (type == "uint") return "typename P::uint_t";
+	if (type == "long") return "typename P::long_t";
+	if (type == "ulong") return "typename P::ulong_t";
+	panic("syscall-structs: unknown field type: %s", type.c_str());
+	return "";
+}
+
+static size_t syscall_limit(riscv_gen *gen)
+{
+	size_t limit = 0;
+	for (auto syscall : gen->syscalls) {
+		limit = std::max(limit, size_t(strtoul(syscall->number.c_str(), nullptr, 0)) + 1);
+	}
+	return limit;
+}
+
+/* syscalls in number order */
+static riscv_syscall_list sorted_syscalls(riscv_gen *gen)
+{
+	riscv_syscall_list list = gen->syscalls;
+	std::stable_sort(list.begin(), list.end(), [](const riscv_syscall_ptr &a, const riscv_syscall_ptr &b) {
+		return strtoul(a->number.c_str(), nullptr, 0) < strtoul(b->number.c_str(), nullptr, 0);
+	});
+	return list;
+}
+
+static void print_abi_struct(riscv_gen *gen, riscv_syscall_struct_ptr st)
+{
+	std::string name = st->name;
+	std::string host = "struct " + name;
+
+	printf("\ttemplate <typename P> struct abi_%s\n\t{\n", name.c_str());
+	for (auto field : st->fields) {
+		printf("\t\t%-20s%s;\n", guest_field_type(field->type).c_str(), field->name.c_str());
+	}
+	printf("\t};\n\n");
+
+	printf("\t/* true if a guest abi_%s can be passed to the host as %s */\n", name.c_str(), host.c_str());
+	printf("\ttemplate <typename P> constexpr bool abi_%s_same_layout()\n\t{\n", name.c_str());
+	printf("\t\treturn sizeof(abi_%s<P>) == sizeof(%s)", name.c_str(), host.c_str());
+	for (auto field : st->fields) {
+		if (field->host_field == "-") continue;
+		printf("\n\t\t\t&& offsetof(abi_%s<P>, %s) == offsetof(%s, %s)",
+			name.c_str(), field->name.c_str(), host.c_str(), field->host_field.c_str());
+		printf("\n\t\t\t&& sizeof(((abi_%s<P>*)0)->%s) == sizeof(((%s*)0)->%s)",
+			name.c_str(), field->name.c_str(), host.c_str(), field->host_field.c_str());
+	}
+	printf(";\n\t}\n\n");
+
+	printf("\ttemplate <typename P> void cvt_abi_%s_to_host(%s *host, const abi_%s<P> *guest)\n\t{\n",
+		name.c_str(), host.c_str(), name.c_str());
+	printf("\t\tmemset(host, 0, sizeof(*host));\n");
+	for (auto field : st->fields) {
+		if (field->host_field == "-") continue;
+		printf("\t\thost->%s = guest->%s;\n", field->host_field.c_str(), field->name.c_str());
+	}
+	printf("\t}\n\n");
+
+	printf("\ttemplate <typename P> void cvt_abi_%s_to_guest(abi_%s<P> *guest, const %s *host)\n\t{\n",
+		name.c_str(), name.c_str(), host.c_str());
+	printf("\t\tmemset(guest, 0, sizeof(*guest));\n");
+	for (auto field : st->fields) {
+		if (field->host_field == "-") continue;
+		printf("\t\tguest->%s = host->%s;\n", field->name.c_str(), field->host_field.c_str());
+	}
+	printf("\t}\n\n");
+
+	printf("\t/* host view of a guest abi_%s read by the host, copied into tmp unless the layouts match, false on a fault */\n", name.c_str());
+	printf("\ttemplate <typename P> bool abi_%s_in(uintptr_t va, %s &tmp, %s *&host)\n\t{\n",
+		name.c_str(), host.c_str(), host.c_str());
+	printf("\t\tif (!va || abi_%s_same_layout<P>()) {\n", name.c_str());
+	printf("\t\t\thost = (%s*)va;\n", host.c_str());
+	printf("\t\t\treturn true;\n\t\t}\n");
+	printf("\t\tabi_%s<P> guest;\n", name.c_str());
+	printf("\t\tif (!abi_copy_guest(&guest, (const void*)va, sizeof(guest))) return false;\n");
+	printf("\t\tcvt_abi_%s_to_host(&tmp, &guest);\n", name.c_str());
+	printf("\t\thost = &tmp;\n");
+	printf("\t\treturn true;\n\t}\n\n");
+
+	printf("\t/* host view of a guest abi_%s written by the host, tmp unless the layouts match */\n", name.c_str());
+	printf("\ttemplate <typename P> %s* abi_%s_out(uintptr_t va, %s &tmp)\n\t{\n",
+		host.c_str(), name.c_str(), host.c_str());
+	printf("\t\tif (!va || abi_%s_same_layout<P>()) return (%s*)va;\n", name.c_str(), host.c_str());
+	printf("\t\tmemset(&tmp, 0, sizeof(tmp));\n");
+	printf("\t\treturn &tmp;\n\t}\n\n");
+
+	printf("\t/* write back a host %s to the guest unless the host wrote it in place, false on a fault */\n", host.c_str());
+	printf("\ttemplate <typename P> bool abi_%s_copyout(uintptr_t va, const %s *host)\n\t{\n",
+		name.c_str(), host.c_str());
+	printf("\t\tif (!va || (uintptr_t)host == va) return true;\n");
+	printf("\t\tabi_%s<P> guest;\n", name.c_str());
+	printf("\t\tcvt_abi_%s_to_guest(&guest, host);\n", name.c_str());
+	printf("\t\treturn abi_copy_guest((void*)va, &guest, sizeof(guest));\n");
+	printf("\t}\n\n");
+}
+
+static void print_abi_types_h(riscv_gen *gen)
+{
+	printf(kCHeader, "riscv-abi-types.h");
+	printf("#ifndef riscv_abi_types_h\n");
+	printf("#define riscv_abi_types_h\n");
+	printf("\n");
+	printf("#if defined (__APPLE__)\n");
+	printf("#define st_atim st_atimespec\n");
+	printf("#define st_mtim st_mtimespec\n");
+	printf("#define st_ctim st_ctimespec\n");
+	printf("#endif\n");
+	printf("\n");
+	printf("namespace riscv {\n\n");
+
+	printf("\tenum abi_syscall\n\t{\n");
+	for (auto syscall : sorted_syscalls(gen)) {
+		printf("\t\t%-40s= %s,\n",
+			format_string("abi_syscall_%s", syscall->name.c_str()).c_str(),
+			syscall->number.c_str());
+	}
+	printf("\t};\n\n");
+
+	printf("\tenum : size_t { abi_syscall_limit = %zu };\n\n", syscall_limit(gen));
+
+	for (auto st : gen->syscall_structs) {
+		print_abi_struct(gen, st);
+	}
+
+	printf("}\n\n");
+	printf("#endif\n");
+}
+
+static void print_abi_stub(riscv_gen *gen, riscv_syscall_ptr syscall)
+{
+	std::vector<std::string> handler = split(syscall->handler, ":");
+	std::string host_fn = handler.size() > 1 ? handler[1] : syscall->name;
+	bool raw_syscall = handler[0] == "syscall";
+	bool linux_only = handler[0] == "linux" || raw_syscall;
+
+	printf("\ttemplate <typename P> void abi_sys_%s(P &proc)\n\t{\n", syscall->name.c_str());
+	if (linux_only) printf("\t#if defined (__linux__)\n");
+
+	std::vector<std::string> call_args, copyouts;
+	for (size_t i = 0; i < syscall->args.size(); i++) {
+		std::string type = syscall->args[i];
+		std::string reg = format_string("proc.ireg[riscv_ireg_a%zu]", i);
+		const riscv_syscall_scalar *scalar = lookup_scalar(type);
+		if (scalar) {
+			printf("\t\t%s arg%zu = %s.r.%s.val;\n", scalar->host_type, i, reg.c_str(), scalar->reg);
+			if (type == "fd") printf("\t\tproc.mmu.output->sync(arg%zu);\n", i);
+			if (type == "rfd") printf("\t\tproc.mmu.output->before_read(arg%zu);\n", i);
+			if (type == "cfd") printf("\t\tproc.mmu.output->sync(arg%zu, true);\n", i);
+		} else if (type == "str") {
+			printf("\t\tconst char *arg%zu = (const char*)proc.mmu.host_buffer(%s.r.xu.val, 0);\n", i, reg.c_str());
+		} else if (type == "in:buf" || type == "out:buf") {
+			/* a buffer followed by a size argument is checked against the sandbox for that length */
+			std::string len = i + 1 < syscall->args.size() && syscall->args[i + 1] == "size" ?
+				format_string("proc.ireg[riscv_ireg_a%zu].r.xu.val", i + 1) : "0";
+			printf("\t\tabi_buffer arg%zu(proc.mmu.host_buffer(%s.r.xu.val, %s));\n", i, reg.c_str(), len.c_str());
+			if (raw_syscall) {
+				call_args.push_back(format_string("(void*)arg%zu", i));
+				continue;
+			}
+		} else if (type.find("in:") == 0 || type.find("out:") == 0) {
+			std::vector<std::string> dir = split(type, ":");
+			if (gen->syscall_structs_by_name.find(dir[1]) == gen->syscall_structs_by_name.end()) {
+				panic("syscalls: %s: unknown argument type: %s", syscall->name.c_str(), type.c_str());
+			}
+			/* out-of-sandbox pointers map to a guard address, fail them before any copy */
+			printf("\t\tif (!proc.mmu.in_sandbox(%s.r.xu.val, sizeof(abi_%s<P>))) {\n", reg.c_str(), dir[1].c_str());
+			printf("\t\t\tproc.ireg[riscv_ireg_a0] = -EFAULT;\n");
+			printf("\t\t\treturn;\n\t\t}\n");
+			printf("\t\tuintptr_t va%zu = proc.mmu.host_buffer(%s.r.xu.val, sizeof(abi_%s<P>));\n",
+				i, reg.c_str(), dir[1].c_str());
+			if (dir[0] == "in") {
+				printf("\t\tstruct %s tmp%zu, *arg%zu;\n", dir[1].c_str(), i, i);
+				printf("\t\tif (!abi_%s_in<P>(va%zu, tmp%zu, arg%zu)) {\n", dir[1].c_str(), i, i, i);
+				printf("\t\t\tproc.ireg[riscv_ireg_a0] = -EFAULT;\n");
+				printf("\t\t\treturn;\n\t\t}\n");
+			} else {
+				printf("\t\tstruct %s tmp%zu, *arg%zu = abi_%s_out<P>(va%zu, tmp%zu);\n",
+					dir[1].c_str(), i, i, dir[1].c_str(), i, i);
+				copyouts.push_back(format_string("abi_%s_copyout<P>(va%zu, arg%zu)", dir[1].c_str(), i, i));
+			}
+		} else {
+			panic("syscalls: %s: unknown argument type: %s", syscall->name.c_str(), type.c_str());
+		}
+		call_args.push_back(format_string("arg%zu", i));
+	}
+
+	if (raw_syscall) {
+		call_args.insert(call_args.begin(), "SYS_" + host_fn);
+		host_fn = "syscall";
+	}
+	printf("\t\tlong ret = %s(%s);\n", host_fn.c_str(), join(call_args, ", ").c_str());
+	if (copyouts.size() > 0) {
+		std::string copied = copyouts.size() == 1 ? "!" + copyouts[0] : "!(" + join(copyouts, " && ") + ")";
+		printf("\t\tif (ret >= 0 && %s) {\n", copied.c_str());
+		printf("\t\t\tproc.ireg[riscv_ireg_a0] = -EFAULT;\n");
+		printf("\t\t\treturn;\n\t\t}\n");
+	}
+	printf("\t\tproc.ireg[riscv_ireg_a0] = ret < 0 ? -errno : ret;\n");
+
+	if (linux_only) {
+		printf("\t#else\n");
+		printf("\t\tproc.ireg[riscv_ireg_a0] = -ENOSYS;\n");
+		printf("\t#endif\n");
+	}
+	printf("\t}\n\n");
+}
+
+static void print_abi_syscalls_h(riscv_gen *gen)
+{
+	printf(kCHeader, "riscv-abi-syscalls.h");
+	printf("#ifndef riscv_abi_syscalls_h\n");
+	printf("#define riscv_abi_syscalls_h\n");
+	printf("\n");
+	printf("namespace riscv {\n\n");
+
+	for (auto syscall : sorted_syscalls(gen)) {
+		std::string kind = split(syscall->handler, ":")[0];
+		if (kind == "host" || kind == "linux" || kind == "syscall") {
+			print_abi_stub(gen, syscall);
+		} else if (kind != "proxy" && kind != "ignore") {
+			panic("syscalls: %s: unknown handler: %s", syscall->name.c_str(), syscall->handler.c_str());
+		}
+	}
+
+	size_t limit = syscall_limit(gen);
+	std::vector<riscv_syscall_ptr> by_number(limit);
+	for (auto syscall : gen->syscalls) {
+		by_number[strtoul(syscall->number.c_str(), nullptr, 0)] = syscall;
+	}
+
+	printf("\ttemplate <typename P> const typename abi_syscall_table<P>::handler\n");
+	printf("\tabi_syscall_table<P>::handlers[abi_syscall_limit] = {\n");
+	for (size_t i = 0; i < limit; i++) {
+		auto syscall = by_number[i];
+		std::string fn = !syscall ? "abi_sys_unimplemented" :
+			syscall->handler == "ignore" ? "abi_sys_ignore" : "abi_sys_" + syscall->name;
+		printf("\t\t/* %3zu */ %s<P>,\n", i, fn.c_str());
+	}
+	printf("\t};\n\n");
+
+	printf("\ttemplate <typename P> const char* const\n");
+	printf("\tabi_syscall_table<P>::names[abi_syscall_limit] = {\n");
+	for (size_t i = 0; i < limit; i++) {
+		auto syscall = by_number[i];
+		printf("\t\t/* %3zu */ %s,\n", i,
+			syscall ? format_string("\"%s\"", syscall->name.c_str()).c_str() : "nullptr");
+	}
+	printf("\t};\n\n");
+
+	printf("}\n\n");
+	printf("#endif\n");
+}
+
+void riscv_gen_syscalls::generate()
+{
+	if (gen->has_option("print_abi_types_h")) print_abi_types_h(gen);
+	if (gen->has_option("print_abi_syscalls_h")) print_abi_syscalls_h(gen);
+}
@@ -49,6 +49,7 @@ riscv_gen::riscv_gen()
 	generators.push_back(std::make_shared<riscv_gen_operands>(this));
 	generators.push_back(std::make_shared<riscv_gen_strings>(this));
 	generators.push_back(std::make_shared<riscv_gen_switch>(this));
+	generators.push_back(std::make_shared<riscv_gen_syscalls>(this));
 }
 
 void riscv_gen::generate(int argc, const char *argv[])
@@ -92,6 +92,13 @@ struct riscv_gen_switch : riscv_gen_abstract
 	void generate();
 };
 
+struct riscv_gen_syscalls : riscv_gen_abstract
+{
+	riscv_gen_syscalls(riscv_gen *gen) : riscv_gen_abstract(gen) {}
+	std::vector<cmdline_option> get_cmdline_options();
+	void generate();
+};
+
 struct riscv_codec_node
 {
 	std::vector<ssize_t> bits;
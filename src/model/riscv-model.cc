@@ -32,6 +32,8 @@ static const char* CODECS_FILE                = "codecs";
 static const char* EXTENSIONS_FILE            = "extensions";
 static const char* REGISTERS_FILE             = "registers";
 static const char* CSRS_FILE                  = "csrs";
+static const char* SYSCALLS_FILE              = "syscalls";
+static const char* SYSCALL_STRUCTS_FILE       = "syscall-structs";
 static const char* OPCODES_FILE               = "opcodes";
 static const char* CONSTRAINTS_FILE           = "constraints";
 static const char* COMPRESSION_FILE           = "compression";
@@ -808,6 +810,30 @@ void riscv_meta_model::parse_csr(std::vector<std::string> &part)
 	csrs.push_back(csr);
 }
 
+void riscv_meta_model::parse_syscall(std::vector<std::string> &part)
+{
+	if (part.size() < 3) {
+		panic("syscalls requires 3 or more parameters: %s", join(part, " ").c_str());
+	}
+	auto syscall = syscalls_by_name[part[1]] = std::make_shared<riscv_syscall>(
+		part[0], part[1], part[2], std::vector<std::string>(part.begin() + 3, part.end())
+	);
+	syscalls.push_back(syscall);
+}
+
+void riscv_meta_model::parse_syscall_struct(std::vector<std::string> &part)
+{
+	if (part.size() < 4) {
+		panic("syscall-structs requires 4 parameters: %s", join(part, " ").c_str());
+	}
+	auto &st = syscall_structs_by_name[part[0]];
+	if (!st) {
+		st = std::make_shared<riscv_syscall_struct>(part[0]);
+		syscall_structs.push_back(st);
+	}
+	st->fields.push_back(std::make_shared<riscv_syscall_field>(part[1], part[2], part[3]));
+}
+
 void riscv_meta_model::parse_opcode(std::vector<std::string> &part)
 {
 	std::vector<std::string> extensions;
@@ -1072,6 +1098,8 @@ bool riscv_meta_model::read_metadata(std::string dirname)
 	for (auto part : read_file(dirname + std::string("/") + EXTENSIONS_FILE)) parse_extension(part);
 	for (auto part : read_file(dirname + std::string("/") + REGISTERS_FILE)) parse_register(part);
 	for (auto part : read_file(dirname + std::string("/") + CSRS_FILE)) parse_csr(part);
+	for (auto part : read_file(dirname + std::string("/") + SYSCALL_STRUCTS_FILE)) parse_syscall_struct(part);
+	for (auto part : read_file(dirname + std::string("/") + SYSCALLS_FILE)) parse_syscall(part);
 	for (auto part : read_file(dirname + std::string("/") + OPCODES_FILE)) parse_opcode(part);
 	for (auto part : read_file(dirname + std::string("/") + CONSTRAINTS_FILE)) parse_constraint(part);
 	for (auto part : read_file(dirname + std::string("/") + COMPRESSION_FILE)) parse_compression(part);
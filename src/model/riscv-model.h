@@ -15,6 +15,9 @@ struct riscv_extension;
 struct riscv_format;
 struct riscv_register;
 struct riscv_csr;
+struct riscv_syscall;
+struct riscv_syscall_field;
+struct riscv_syscall_struct;
 struct riscv_opcode;
 struct riscv_constraint;
 struct riscv_compressed;
@@ -47,6 +50,14 @@ typedef std::map<std::string,riscv_register_ptr> riscv_register_map;
 typedef std::shared_ptr<riscv_csr> riscv_csr_ptr;
 typedef std::vector<riscv_csr_ptr> riscv_csr_list;
 typedef std::map<std::string,riscv_csr_ptr> riscv_csr_map;
+typedef std::shared_ptr<riscv_syscall> riscv_syscall_ptr;
+typedef std::vector<riscv_syscall_ptr> riscv_syscall_list;
+typedef std::map<std::string,riscv_syscall_ptr> riscv_syscall_map;
+typedef std::shared_ptr<riscv_syscall_field> riscv_syscall_field_ptr;
+typedef std::vector<riscv_syscall_field_ptr> riscv_syscall_field_list;
+typedef std::shared_ptr<riscv_syscall_struct> riscv_syscall_struct_ptr;
+typedef std::vector<riscv_syscall_struct_ptr> riscv_syscall_struct_list;
+typedef std::map<std::string,riscv_syscall_struct_ptr> riscv_syscall_struct_map;
 typedef std::pair<riscv_bitrange,size_t> riscv_opcode_mask;
 typedef std::vector<riscv_opcode_mask> riscv_opcode_mask_list;
 typedef std::shared_ptr<riscv_opcode> riscv_opcode_ptr;
@@ -251,6 +262,35 @@ struct riscv_csr
 		: number(number), access(access), name(name), description(description) {}
 };
 
+struct riscv_syscall
+{
+	std::string number;
+	std::string name;
+	std::string handler;
+	std::vector<std::string> args;
+
+	riscv_syscall(std::string number, std::string name, std::string handler, std::vector<std::string> args)
+		: number(number), name(name), handler(handler), args(args) {}
+};
+
+struct riscv_syscall_field
+{
+	std::string name;
+	std::string type;
+	std::string host_field;
+
+	riscv_syscall_field(std::string name, std::string type, std::string host_field)
+		: name(name), type(type), host_field(host_field) {}
+};
+
+struct riscv_syscall_struct
+{
+	std::string name;
+	riscv_syscall_field_list fields;
+
+	riscv_syscall_struct(std::string name) : name(name) {}
+};
+
 struct riscv_opcode
 {
 	std::string key;
@@ -364,6 +404,10 @@ struct riscv_meta_model
 	riscv_register_map       registers_by_name;
 	riscv_csr_list           csrs;
 	riscv_csr_map            csrs_by_name;
+	riscv_syscall_list       syscalls;
+	riscv_syscall_map        syscalls_by_name;
+	riscv_syscall_struct_list syscall_structs;
+	riscv_syscall_struct_map syscall_structs_by_name;
 	riscv_opcode_list        opcodes;
 	riscv_opcode_map         opcodes_by_key;
 	riscv_opcode_list_map    opcodes_by_name;
@@ -411,6 +455,8 @@ struct riscv_meta_model
 	void parse_format(std::vector<std::string> &part);
 	void parse_register(std::vector<std::string> &part);
 	void parse_csr(std::vector<std::string> &part);
+	void parse_syscall(std::vector<std::string> &part);
+	void parse_syscall_struct(std::vector<std::string> &part);
 	void parse_opcode(std::vector<std::string> &part);
 	void parse_constraint(std::vector<std::string> &part);
 	void parse_compression(std::vector<std::string> &part);